@@ -523,6 +523,7 @@ enum StoreOp : uint8_t {
   StoreOp_Store,
   StoreOp_MsaaResolve,
   StoreOp_None,
+  StoreOp_MsaaResolveAndStore, // resolve, and keep the multisampled attachment for a following render pass
 };
 
 enum ShaderStage : uint8_t {
@@ -746,7 +747,7 @@ enum BufferUsageBits : uint8_t {
   BufferUsageBits_Index = 1 << 0,
   BufferUsageBits_Vertex = 1 << 1,
   BufferUsageBits_Uniform = 1 << 2,
-  BufferUsageBits_Storage = 1 << 3,
+  BufferUsageBits_Storage = 1 << 3, // also a transfer source and destination, see ICommandBuffer::cmdCopyBuffers()
   BufferUsageBits_Indirect = 1 << 4,
   // ray tracing
   BufferUsageBits_ShaderBindingTable = 1 << 5,
@@ -762,6 +763,14 @@ struct BufferDesc final {
   const char* debugName = "";
 };
 
+struct BufferCopyRegion final {
+  BufferHandle srcBuffer;
+  size_t srcOffset = 0;
+  BufferHandle dstBuffer;
+  size_t dstOffset = 0;
+  size_t size = 0;
+};
+
 struct Offset3D {
   int32_t x = 0;
   int32_t y = 0;
@@ -945,6 +954,14 @@ class ICommandBuffer {
 
   virtual void cmdFillBuffer(BufferHandle buffer, size_t bufferOffset, size_t size, uint32_t data) = 0;
   virtual void cmdUpdateBuffer(BufferHandle buffer, size_t bufferOffset, size_t size, const void* data) = 0;
+  // The buffers are storage buffers. All the regions share one barrier before the copies (shader and transfer writes) and one
+  // after them (shader, indirect and vertex reads; host reads for mapped destinations), so batch the copies of a pass
+  virtual void cmdCopyBuffers(const BufferCopyRegion* regions, uint32_t numRegions) = 0;
+  void cmdCopyBuffer(BufferHandle srcBuffer, size_t srcOffset, BufferHandle dstBuffer, size_t dstOffset, size_t size) {
+    const BufferCopyRegion region = {
+        .srcBuffer = srcBuffer, .srcOffset = srcOffset, .dstBuffer = dstBuffer, .dstOffset = dstOffset, .size = size};
+    this->cmdCopyBuffers(&region, 1);
+  }
   template<typename Struct>
   void cmdUpdateBuffer(BufferHandle buffer, const Struct& data, size_t bufferOffset = 0) {
     this->cmdUpdateBuffer(buffer, bufferOffset, sizeof(Struct), &data);
@@ -1027,6 +1044,7 @@ class IContext {
 
   virtual SubmitHandle submit(ICommandBuffer& commandBuffer, TextureHandle present = {}) = 0;
   virtual void wait(SubmitHandle handle) = 0; // waiting on an empty handle results in vkDeviceWaitIdle()
+  [[nodiscard]] virtual bool isReady(SubmitHandle handle) const = 0; // non-blocking, an empty handle is always ready
 
   [[nodiscard]] virtual Holder<BufferHandle> createBuffer(const BufferDesc& desc,
                                                           const char* debugName = nullptr,
@@ -1091,6 +1109,12 @@ class IContext {
   // MSAA level is supported if ((samples & bitmask) != 0), where samples must be power of two.
   virtual uint32_t getFramebufferMSAABitMask() const = 0;
 
+  // the largest buffer createBuffer() accepts (limited by VkPhysicalDeviceLimits::maxStorageBufferRange)
+  virtual uint32_t getMaxStorageBufferRange() const = 0;
+
+  // task and mesh shaders (VK_EXT_mesh_shader) are enabled when the device supports them
+  virtual bool isMeshShaderSupported() const = 0;
+
 #pragma region Performance queries
   virtual double getTimestampPeriodToMs() const = 0;
   virtual bool getQueryPoolResults(QueryPoolHandle pool,
@@ -228,6 +228,8 @@ VkAttachmentStoreOp storeOpToVkAttachmentStoreOp(lvk::StoreOp a) {
 	 // the MSAA color attachment's content is not needed after the pass, so using DontCare
 	 // the resolve data will be stored into the resolve attachment mentioned above
     return VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  case lvk::StoreOp_MsaaResolveAndStore:
+    return VK_ATTACHMENT_STORE_OP_STORE;
   case lvk::StoreOp_None:
     return VK_ATTACHMENT_STORE_OP_NONE;
   }
@@ -2034,8 +2036,9 @@ void lvk::CommandBuffer::cmdDispatchThreadGroups(const Dimensions& threadgroupCo
     const lvk::VulkanBuffer* buf = ctx_->buffersPool_.get(deps.buffers[i]);
     LVK_ASSERT_MSG(buf->vkUsageFlags_ & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                    "Did you forget to specify BufferUsageBits_Storage on your buffer?");
+    // include previous dispatches, so chained compute passes can read what the previous one wrote
     bufferBarrier(deps.buffers[i],
-                  VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                  VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
   }
 
@@ -2267,7 +2270,7 @@ void lvk::CommandBuffer::cmdBeginRendering(const lvk::RenderPass& renderPass, co
     };
     // handle MSAA
 	 // if MSAA is enabled
-    if (descColor.storeOp == StoreOp_MsaaResolve) {
+    if (descColor.storeOp == StoreOp_MsaaResolve || descColor.storeOp == StoreOp_MsaaResolveAndStore) {
       LVK_ASSERT(samples > 1);
       LVK_ASSERT_MSG(!attachment.resolveTexture.empty(), "Framebuffer attachment should contain a resolve texture");
       lvk::VulkanImage& colorResolveTexture = *ctx_->texturesPool_.get(attachment.resolveTexture);
@@ -2301,7 +2304,7 @@ void lvk::CommandBuffer::cmdBeginRendering(const lvk::RenderPass& renderPass, co
     };
     // handle depth MSAA
 	 // if MSAA is enabled
-    if (descDepth.storeOp == StoreOp_MsaaResolve) {
+    if (descDepth.storeOp == StoreOp_MsaaResolve || descDepth.storeOp == StoreOp_MsaaResolveAndStore) {
       LVK_ASSERT(depthTexture.vkSamples_ == samples);
       const lvk::Framebuffer::AttachmentDesc& attachment = fb.depthStencil;
       LVK_ASSERT_MSG(!attachment.resolveTexture.empty(), "Framebuffer depth attachment should contain a resolve texture");
@@ -2553,6 +2556,122 @@ void lvk::CommandBuffer::cmdUpdateBuffer(BufferHandle buffer, size_t bufferOffse
   bufferBarrier(buffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT, dstStage);
 }
 
+void lvk::CommandBuffer::cmdCopyBuffers(const BufferCopyRegion* regions, uint32_t numRegions) {
+  LVK_PROFILER_FUNCTION();
+  LVK_ASSERT(regions || !numRegions);
+
+  if (!numRegions) {
+    return;
+  }
+
+  // storage buffers are written by shaders and transfers, and read as indirect and vertex data on top of that
+  VkPipelineStageFlags2 shaderStages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+  if (ctx_->hasMeshShader_) {
+    shaderStages |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+  }
+  const VkPipelineStageFlags2 writeStages = shaderStages | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  const VkPipelineStageFlags2 readStages =
+      writeStages | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+  const VkAccessFlags2 writeAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  const VkAccessFlags2 readAccess = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                                    VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT;
+
+  std::vector<VkBufferCopy> copies(numRegions);
+  std::vector<VkBufferMemoryBarrier2> barriersBefore;
+  std::vector<VkBufferMemoryBarrier2> barriersAfter;
+  barriersBefore.reserve(2 * numRegions);
+  barriersAfter.reserve(2 * numRegions);
+
+  auto barrier = [](VkBuffer buffer,
+                    size_t offset,
+                    size_t size,
+                    VkPipelineStageFlags2 srcStage,
+                    VkAccessFlags2 srcAccess,
+                    VkPipelineStageFlags2 dstStage,
+                    VkAccessFlags2 dstAccess) {
+    return VkBufferMemoryBarrier2{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .srcStageMask = srcStage,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = dstStage,
+        .dstAccessMask = dstAccess,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = buffer,
+        .offset = offset,
+        .size = size,
+    };
+  };
+
+  for (uint32_t i = 0; i != numRegions; i++) {
+    const BufferCopyRegion& r = regions[i];
+
+    LVK_ASSERT(r.srcBuffer.valid());
+    LVK_ASSERT(r.dstBuffer.valid());
+    LVK_ASSERT(r.size);
+
+    lvk::VulkanBuffer* src = ctx_->buffersPool_.get(r.srcBuffer);
+    lvk::VulkanBuffer* dst = ctx_->buffersPool_.get(r.dstBuffer);
+
+    LVK_ASSERT(r.srcOffset + r.size <= src->bufferSize_);
+    LVK_ASSERT(r.dstOffset + r.size <= dst->bufferSize_);
+
+    copies[i] = {
+        .srcOffset = r.srcOffset,
+        .dstOffset = r.dstOffset,
+        .size = r.size,
+    };
+
+    // the source regions: earlier writes become visible to the copy, later writes wait for it
+    barriersBefore.push_back(barrier(src->vkBuffer_,
+                                     r.srcOffset,
+                                     r.size,
+                                     writeStages,
+                                     writeAccess,
+                                     VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_READ_BIT));
+    barriersAfter.push_back(barrier(src->vkBuffer_, r.srcOffset, r.size, VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, writeStages, 0));
+
+    // the destination regions: earlier reads and writes finish before the copy, later reads see it
+    VkPipelineStageFlags2 dstStages = readStages;
+    VkAccessFlags2 dstAccess = readAccess | writeAccess;
+    if (dst->isMapped()) {
+      dstStages |= VK_PIPELINE_STAGE_2_HOST_BIT;
+      dstAccess |= VK_ACCESS_2_HOST_READ_BIT;
+    }
+    barriersBefore.push_back(barrier(dst->vkBuffer_,
+                                     r.dstOffset,
+                                     r.size,
+                                     readStages,
+                                     writeAccess,
+                                     VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT));
+    barriersAfter.push_back(
+        barrier(dst->vkBuffer_, r.dstOffset, r.size, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, dstStages, dstAccess));
+  }
+
+  const VkDependencyInfo depInfoBefore = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .bufferMemoryBarrierCount = (uint32_t)barriersBefore.size(),
+      .pBufferMemoryBarriers = barriersBefore.data(),
+  };
+  vkCmdPipelineBarrier2(wrapper_->cmdBuf_, &depInfoBefore);
+
+  for (uint32_t i = 0; i != numRegions; i++) {
+    lvk::VulkanBuffer* src = ctx_->buffersPool_.get(regions[i].srcBuffer);
+    lvk::VulkanBuffer* dst = ctx_->buffersPool_.get(regions[i].dstBuffer);
+    vkCmdCopyBuffer(wrapper_->cmdBuf_, src->vkBuffer_, dst->vkBuffer_, 1, &copies[i]);
+  }
+
+  const VkDependencyInfo depInfoAfter = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .bufferMemoryBarrierCount = (uint32_t)barriersAfter.size(),
+      .pBufferMemoryBarriers = barriersAfter.data(),
+  };
+  vkCmdPipelineBarrier2(wrapper_->cmdBuf_, &depInfoAfter);
+}
+
 void lvk::CommandBuffer::cmdDraw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t baseInstance) {
   LVK_PROFILER_FUNCTION();
   LVK_PROFILER_GPU_ZONE("cmdDraw()", ctx_, wrapper_->cmdBuf_, LVK_PROFILER_COLOR_CMD_DRAW);
@@ -3754,6 +3873,10 @@ void lvk::VulkanContext::wait(SubmitHandle handle) {
   immediate_->wait(handle);
 }
 
+bool lvk::VulkanContext::isReady(SubmitHandle handle) const {
+  return immediate_->isReady(handle);
+}
+
 lvk::Holder<lvk::BufferHandle> lvk::VulkanContext::createBuffer(const BufferDesc& requestedDesc, const char* debugName, Result* outResult) {
   BufferDesc desc = requestedDesc;
 
@@ -3787,7 +3910,9 @@ lvk::Holder<lvk::BufferHandle> lvk::VulkanContext::createBuffer(const BufferDesc
   }
 
   if (desc.usage & BufferUsageBits_Storage) {
-    usageFlags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    // storage buffers can be copied from and to with cmdCopyBuffer()
+    usageFlags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
   }
 
   if (desc.usage & BufferUsageBits_Indirect) {
@@ -5960,6 +6085,14 @@ uint32_t lvk::VulkanContext::getFramebufferMSAABitMask() const {
   return limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
 }
 
+uint32_t lvk::VulkanContext::getMaxStorageBufferRange() const {
+  return getVkPhysicalDeviceProperties().limits.maxStorageBufferRange;
+}
+
+bool lvk::VulkanContext::isMeshShaderSupported() const {
+  return hasMeshShader_;
+}
+
 double lvk::VulkanContext::getTimestampPeriodToMs() const {
   return double(getVkPhysicalDeviceProperties().limits.timestampPeriod) * 1e-6;
 }
@@ -6510,6 +6643,11 @@ lvk::Result lvk::VulkanContext::initContext(const HWDeviceDesc& desc) {
       .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
       .rayQuery = VK_TRUE,
   };
+  VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+      .taskShader = VK_TRUE,
+      .meshShader = VK_TRUE,
+  };
   VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features = {
       .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT,
       .indexTypeUint8 = VK_TRUE,
@@ -6551,6 +6689,7 @@ lvk::Result lvk::VulkanContext::initContext(const HWDeviceDesc& desc) {
                         &accelerationStructureFeatures);
   addOptionalExtension(VK_KHR_RAY_QUERY_EXTENSION_NAME, hasRayQuery_, &rayQueryFeatures);
   addOptionalExtension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, hasRayTracingPipeline_, &rayTracingFeatures);
+  addOptionalExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME, hasMeshShader_, &meshShaderFeatures);
 #if defined(VK_KHR_INDEX_TYPE_UINT8_EXTENSION_NAME)
   if (!addOptionalExtension(VK_KHR_INDEX_TYPE_UINT8_EXTENSION_NAME, has8BitIndices_, &indexTypeUint8Features))
 #endif // VK_KHR_INDEX_TYPE_UINT8_EXTENSION_NAME
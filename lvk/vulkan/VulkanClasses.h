@@ -366,6 +366,7 @@ class CommandBuffer final : public ICommandBuffer {
 
   void cmdFillBuffer(BufferHandle buffer, size_t bufferOffset, size_t size, uint32_t data) override;
   void cmdUpdateBuffer(BufferHandle buffer, size_t bufferOffset, size_t size, const void* data) override;
+  void cmdCopyBuffers(const BufferCopyRegion* regions, uint32_t numRegions) override;
 
   void cmdDraw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t baseInstance) override;
   void cmdDrawIndexed(uint32_t indexCount,
@@ -492,6 +493,7 @@ class VulkanContext final : public IContext {
 
   SubmitHandle submit(lvk::ICommandBuffer& commandBuffer, TextureHandle present) override;
   void wait(SubmitHandle handle) override;
+  bool isReady(SubmitHandle handle) const override;
 
   Holder<BufferHandle> createBuffer(const BufferDesc& desc, const char* debugName, Result* outResult) override;
   Holder<SamplerHandle> createSampler(const SamplerStateDesc& desc, Result* outResult) override;
@@ -542,6 +544,9 @@ class VulkanContext final : public IContext {
   void recreateSwapchain(int newWidth, int newHeight) override;
 
   uint32_t getFramebufferMSAABitMask() const override;
+  uint32_t getMaxStorageBufferRange() const override;
+
+  bool isMeshShaderSupported() const override;
 
   double getTimestampPeriodToMs() const override;
   bool getQueryPoolResults(QueryPoolHandle pool, uint32_t firstQuery, uint32_t queryCount, size_t dataSize, void* outData, size_t stride)
@@ -696,6 +701,7 @@ public:
   bool hasRayTracingPipeline_ = false;
   bool has8BitIndices_ = false;
   bool hasCalibratedTimestamps_ = false;
+  bool hasMeshShader_ = false;
 
   TextureHandle dummyTexture_;
 
@@ -0,0 +1,109 @@
+#include "shared/MappedFile.h"
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const char* fileName)
+{
+  HANDLE hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+  if (hFile == INVALID_HANDLE_VALUE) {
+    printf("Cannot open '%s' for mapping.\n", fileName);
+    return;
+  }
+
+  LARGE_INTEGER fileSize = {};
+
+  // empty files cannot be mapped
+  if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(hFile);
+    return;
+  }
+
+  HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  if (!hMapping) {
+    printf("Cannot create file mapping for '%s'.\n", fileName);
+    CloseHandle(hFile);
+    return;
+  }
+
+  const void* ptr = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+  if (!ptr) {
+    printf("Cannot map view of '%s'.\n", fileName);
+    CloseHandle(hMapping);
+    CloseHandle(hFile);
+    return;
+  }
+
+  hFile_    = hFile;
+  hMapping_ = hMapping;
+  data_     = static_cast<const uint8_t*>(ptr);
+  size_     = static_cast<size_t>(fileSize.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (hMapping_)
+    CloseHandle(hMapping_);
+  if (hFile_)
+    CloseHandle(hFile_);
+}
+
+#else
+
+MappedFile::MappedFile(const char* fileName)
+{
+  const int fd = open(fileName, O_RDONLY);
+
+  if (fd == -1) {
+    printf("Cannot open '%s' for mapping.\n", fileName);
+    return;
+  }
+
+  struct stat st = {};
+
+  // empty files cannot be mapped
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+
+  void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // the mapping keeps its own reference to the file
+  close(fd);
+
+  if (ptr == MAP_FAILED) {
+    printf("Cannot map '%s'.\n", fileName);
+    return;
+  }
+
+  // the cache is consumed front to back by the staging uploads
+  madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  data_ = static_cast<const uint8_t*>(ptr);
+  size_ = (size_t)st.st_size;
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_)
+    munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+#endif
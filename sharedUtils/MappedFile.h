@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only memory mapping of an entire file. The pages stay mapped as long as this object is alive;
+// they are backed by the file itself, so the OS can drop them at any time without touching the swap
+class MappedFile final
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const char* fileName);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool valid() const { return data_ != nullptr; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_         = 0;
+#if defined(_WIN32)
+  void* hFile_    = nullptr;
+  void* hMapping_ = nullptr;
+#endif
+};
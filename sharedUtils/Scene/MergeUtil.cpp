@@ -3,23 +3,25 @@
 
 #include <unordered_map>
 
-static uint32_t shiftMeshIndices(MeshData& meshData, const std::vector<uint32_t>& meshesToMerge)
+static uint64_t shiftMeshIndices(MeshData& meshData, const std::vector<uint32_t>& meshesToMerge)
 {
-  uint32_t minVtxOffset = std::numeric_limits<uint32_t>::max();
+  uint64_t minVtxOffset = std::numeric_limits<uint64_t>::max();
 
   for (uint32_t i : meshesToMerge)
     minVtxOffset = std::min(meshData.meshes[i].vertexOffset, minVtxOffset);
 
-  uint32_t mergeCount = 0u; // calculated by summing index counts in meshesToMerge
+  uint64_t mergeCount = 0u; // calculated by summing index counts in meshesToMerge
 
   // now shift all the indices in individual index blocks [use minVtxOffset]
   for (uint32_t i : meshesToMerge) {
     Mesh& m = meshData.meshes[i];
     // for how much should we shift the indices in mesh [m]
-    const uint32_t delta    = m.vertexOffset - minVtxOffset;
+    const uint64_t delta    = m.vertexOffset - minVtxOffset;
     const uint32_t idxCount = m.getLODIndicesCount(0);
+    // the merged mesh is addressed by 32-bit indices
+    LVK_ASSERT(delta <= std::numeric_limits<uint32_t>::max());
     for (uint32_t ii = 0u; ii < idxCount; ii++)
-      meshData.indexData[m.indexOffset + ii] += delta;
+      meshData.indexData[m.indexOffset + ii] += (uint32_t)delta;
 
     m.vertexOffset = minVtxOffset;
 
@@ -36,8 +38,8 @@ static void mergeIndexArray(MeshData& md, const std::vector<uint32_t>& meshesToM
 {
   std::vector<uint32_t> newIndices(md.indexData.size());
   // Two offsets in the new indices array (one begins at the start, the second one after all the copied indices)
-  uint32_t copyOffset  = 0;
-  uint32_t mergeOffset = shiftMeshIndices(md, meshesToMerge);
+  uint64_t copyOffset  = 0;
+  uint64_t mergeOffset = shiftMeshIndices(md, meshesToMerge);
 
   const size_t mergedMeshIndex = md.meshes.size() - meshesToMerge.size();
   uint32_t newIndex            = 0u;
@@ -52,7 +54,7 @@ static void mergeIndexArray(MeshData& md, const std::vector<uint32_t>& meshesToM
     // move all indices to the new array at mergeOffset
     const auto start          = md.indexData.begin() + mesh.indexOffset;
     mesh.indexOffset          = copyOffset;
-    uint32_t* const offsetPtr = shouldMerge ? &mergeOffset : &copyOffset;
+    uint64_t* const offsetPtr = shouldMerge ? &mergeOffset : &copyOffset;
     std::copy(start, start + idxCount, newIndices.begin() + *offsetPtr);
     *offsetPtr += idxCount;
   }
@@ -62,49 +64,82 @@ static void mergeIndexArray(MeshData& md, const std::vector<uint32_t>& meshesToM
   // all the merged indices are now in lastMesh
   Mesh lastMesh         = md.meshes[meshesToMerge[0]];
   lastMesh.indexOffset  = copyOffset;
-  lastMesh.lodOffset[0] = copyOffset;
-  lastMesh.lodOffset[1] = mergeOffset;
+  lastMesh.lodOffset[0] = 0;
+  lastMesh.lodOffset[1] = (uint32_t)(mergeOffset - copyOffset);
   lastMesh.lodCount     = 1;
   md.meshes.push_back(lastMesh);
 }
 
-void mergeNodesWithMaterial(Scene& scene, MeshData& meshData, const std::string& materialName)
+void mergeNodesWithMaterials(Scene& scene, MeshData& meshData, const std::vector<std::string>& materialNames)
 {
-  // Find material index
-  const int oldMaterial = (int)std::distance(
-      std::begin(scene.materialNames), std::find(std::begin(scene.materialNames), std::end(scene.materialNames), materialName));
+  // all the node removals and insertions go into a single scene edit
+  SceneEdit edit(scene);
+
+  struct MergedNode {
+    int node;
+    uint32_t mesh;
+    uint32_t material;
+  };
+  std::vector<MergedNode> mergedNodes;
+
+  for (const std::string& materialName : materialNames) {
+    // Find material index
+    const int oldMaterial = (int)std::distance(
+        std::begin(scene.materialNames), std::find(std::begin(scene.materialNames), std::end(scene.materialNames), materialName));
 
-  std::vector<uint32_t> toDelete;
+    std::vector<uint32_t> toDelete;
 
-  for (size_t i = 0u; i < scene.hierarchy.size(); i++)
-    if (scene.meshForNode.contains(i) && scene.materialForNode.contains(i) && (scene.materialForNode.at(i) == oldMaterial))
-      toDelete.push_back(i);
+    for (size_t i = 0u; i < scene.hierarchy.size(); i++)
+      if (scene.meshForNode.contains(i) && scene.materialForNode.contains(i) && (scene.materialForNode.at(i) == oldMaterial))
+        toDelete.push_back(i);
 
-  std::vector<uint32_t> meshesToMerge(toDelete.size());
+    if (toDelete.empty())
+      continue;
 
-  // Convert toDelete indices to mesh indices
-  std::transform(toDelete.begin(), toDelete.end(), meshesToMerge.begin(), [&scene](uint32_t i) { return scene.meshForNode.at(i); });
+    std::vector<uint32_t> meshesToMerge(toDelete.size());
 
-  // TODO: if merged mesh transforms are non-zero, then we should pre-transform individual mesh vertices in meshData using local transform
+    // Convert toDelete indices to mesh indices
+    std::transform(toDelete.begin(), toDelete.end(), meshesToMerge.begin(), [&scene](uint32_t i) { return scene.meshForNode.at(i); });
 
-  // old-to-new mesh indices
-  std::unordered_map<uint32_t, uint32_t> oldToNew;
+    // TODO: if merged mesh transforms are non-zero, then we should pre-transform individual mesh vertices in meshData using local transform
 
-  // now move all the meshesToMerge to the end of array
-  mergeIndexArray(meshData, meshesToMerge, oldToNew);
+    // old-to-new mesh indices
+    std::unordered_map<uint32_t, uint32_t> oldToNew;
 
-  // cutoff all but one of the merged meshes (insert the last saved mesh from meshesToMerge - they are all the same)
-  eraseSelected(meshData.meshes, meshesToMerge);
+    // now move all the meshesToMerge to the end of array
+    mergeIndexArray(meshData, meshesToMerge, oldToNew);
 
-  for (auto& n : scene.meshForNode)
-    n.second = oldToNew[n.second];
+    // cutoff all but one of the merged meshes (insert the last saved mesh from meshesToMerge - they are all the same)
+    eraseSelected(meshData.meshes, meshesToMerge);
+
+    for (auto& n : scene.meshForNode)
+      n.second = oldToNew[n.second];
+    for (MergedNode& n : mergedNodes)
+      n.mesh = oldToNew[n.mesh];
+
+    // reattach the node with merged meshes [identity transforms are assumed]
+    mergedNodes.push_back({ edit.addNode(0), (uint32_t)meshData.meshes.size() - 1, (uint32_t)oldMaterial });
+
+    for (uint32_t n : toDelete)
+      edit.removeNode((int)n);
+  }
 
-  // reattach the node with merged meshes [identity transforms are assumed]
-  int newNode                    = addNode(scene, 0, 1);
-  scene.meshForNode[newNode]     = (int)meshData.meshes.size() - 1;
-  scene.materialForNode[newNode] = (uint32_t)oldMaterial;
+  const std::vector<int> newIndices = applySceneEdit(scene, edit);
 
-  deleteSceneNodes(scene, toDelete);
+  if (newIndices.empty()) {
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  for (const MergedNode& n : mergedNodes) {
+    scene.meshForNode[newIndices[n.node]]     = n.mesh;
+    scene.materialForNode[newIndices[n.node]] = n.material;
+  }
+}
+
+void mergeNodesWithMaterial(Scene& scene, MeshData& meshData, const std::string& materialName)
+{
+  mergeNodesWithMaterials(scene, meshData, { materialName });
 }
 
 void mergeMaterialLists(
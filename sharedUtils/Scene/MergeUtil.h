@@ -4,6 +4,8 @@
 #include "shared/Scene/VtxData.h"
 
 void mergeNodesWithMaterial(Scene& scene, MeshData& meshData, const std::string& materialName);
+// the same for several materials, the scene hierarchy is compacted only once
+void mergeNodesWithMaterials(Scene& scene, MeshData& meshData, const std::vector<std::string>& materialNames);
 
 // Merge material lists from multiple scenes (follows the logic of merging in mergeScenes)
 void mergeMaterialLists(
@@ -0,0 +1,655 @@
+#include "shared/Scene/MeshCache.h"
+#include "shared/UtilsFile.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <filesystem>
+#include <stdio.h>
+#include <string.h>
+
+#include <meshoptimizer.h>
+
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+
+constexpr uint64_t kMeshCacheSectionAlignment = 16;
+
+// elements per encoded chunk: big enough to compress well, small enough to keep all the threads busy
+constexpr uint64_t kEncodedIndicesPerChunk  = 3 * 64 * 1024;
+constexpr uint64_t kEncodedVerticesPerChunk = 64 * 1024;
+
+uint64_t hashBytes64(const void* data, size_t size, uint64_t hash)
+{
+  constexpr uint64_t kPrime = 0x100000001b3ull;
+
+  const uint8_t* ptr = static_cast<const uint8_t*>(data);
+
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), ptr += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    hash = (hash ^ word) * kPrime;
+  }
+
+  for (; size; size--, ptr++)
+    hash = (hash ^ *ptr) * kPrime;
+
+  return hash;
+}
+
+static bool isMeshCacheHeaderValid(const MeshCacheHeader& header, int64_t actualFileSize)
+{
+  if (header.magicValue != kMeshCacheMagic || header.version != kMeshCacheVersion)
+    return false;
+
+  if (header.numSections > kMeshCacheMaxSections)
+    return false;
+
+  if (actualFileSize < 0 || header.fileSize != (uint64_t)actualFileSize)
+    return false;
+
+  for (uint32_t i = 0; i != header.numSections; i++) {
+    const MeshCacheSection& s = header.sections[i];
+    if (s.offset < sizeof(MeshCacheHeader) || s.offset % kMeshCacheSectionAlignment)
+      return false;
+    if (s.size > header.fileSize || s.offset > header.fileSize - s.size)
+      return false;
+  }
+
+  const MeshCacheSection* meshes    = header.findSection(MeshCacheSection_Meshes);
+  const MeshCacheSection* boxes     = header.findSection(MeshCacheSection_Boxes);
+  const MeshCacheSection* indices   = header.findSection(MeshCacheSection_Indices);
+  const MeshCacheSection* vertices  = header.findSection(MeshCacheSection_Vertices);
+  const MeshCacheSection* materials = header.findSection(MeshCacheSection_Materials);
+  const MeshCacheSection* scene     = header.findSection(MeshCacheSection_Scene);
+
+  const MeshCacheSection* indicesEncoded  = header.findSection(MeshCacheSection_IndicesEncoded);
+  const MeshCacheSection* verticesEncoded = header.findSection(MeshCacheSection_VerticesEncoded);
+
+  // each stream is stored either raw or encoded
+  if (!indices == !indicesEncoded || !vertices == !verticesEncoded)
+    return false;
+
+  if (!meshes || !boxes || !materials || !scene)
+    return false;
+
+  // the sizes of the array sections have to agree with each other
+  if (meshes->size % sizeof(Mesh) || boxes->size != (meshes->size / sizeof(Mesh)) * sizeof(BoundingBox))
+    return false;
+
+  if (indices && indices->size % sizeof(uint32_t))
+    return false;
+
+  const uint32_t vertexSize = header.streams.getVertexSize();
+
+  if (!vertexSize || (vertices && vertices->size % vertexSize))
+    return false;
+
+  if (const MeshCacheSection* meshlets = header.findSection(MeshCacheSection_Meshlets)) {
+    if (meshlets->size < sizeof(MeshCacheMeshlets))
+      return false;
+  }
+
+  // the content of encoded streams is checked while decoding
+  if ((indicesEncoded && indicesEncoded->size < sizeof(MeshCacheEncodedStream)) ||
+      (verticesEncoded && verticesEncoded->size < sizeof(MeshCacheEncodedStream)))
+    return false;
+
+  return true;
+}
+
+bool isMeshCacheValid(const char* fileName)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f)
+    return false;
+
+  SCOPE_EXIT
+  {
+    fclose(f);
+  };
+
+  MeshCacheHeader header;
+
+  if (fread(&header, 1, sizeof(header), f) != sizeof(header))
+    return false;
+
+  return isMeshCacheHeaderValid(header, getFileSize64(f));
+}
+
+static uint64_t hashFileRange(FILE* f, uint64_t offset, uint64_t size)
+{
+  // a multiple of 8 bytes, so hashing in pieces matches hashing everything at once
+  std::vector<uint8_t> buffer(1024 * 1024);
+
+  uint64_t hash = kHash64Seed;
+
+  if (fseek64(f, (int64_t)offset, SEEK_SET))
+    return ~hash;
+
+  while (size) {
+    const size_t chunk = (size_t)std::min<uint64_t>(size, buffer.size());
+    if (fread(buffer.data(), 1, chunk, f) != chunk)
+      return ~hash;
+    hash = hashBytes64(buffer.data(), chunk, hash);
+    size -= chunk;
+  }
+
+  return hash;
+}
+
+bool verifyMeshCacheHashes(const char* fileName)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f)
+    return false;
+
+  SCOPE_EXIT
+  {
+    fclose(f);
+  };
+
+  MeshCacheHeader header;
+
+  if (fread(&header, 1, sizeof(header), f) != sizeof(header))
+    return false;
+
+  if (!isMeshCacheHeaderValid(header, getFileSize64(f)))
+    return false;
+
+  for (uint32_t i = 0; i != header.numSections; i++) {
+    const MeshCacheSection& s = header.sections[i];
+    if (hashFileRange(f, s.offset, s.size) != s.hash) {
+      printf("Mesh cache '%s': section %u is corrupted.\n", fileName, s.type);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+MeshCacheSource getMeshCacheSource(const char* fileName)
+{
+  MeshCacheSource source = { .fileName = fileName };
+
+  std::error_code ec;
+
+  const uintmax_t size = std::filesystem::file_size(fileName, ec);
+
+  if (ec)
+    return source;
+
+  const std::filesystem::file_time_type mtime = std::filesystem::last_write_time(fileName, ec);
+
+  if (ec)
+    return source;
+
+  source.size  = (int64_t)size;
+  source.mtime = (int64_t)mtime.time_since_epoch().count();
+
+  return source;
+}
+
+bool loadMeshCacheManifest(const char* fileName, MeshCacheManifest& manifest)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f)
+    return false;
+
+  SCOPE_EXIT
+  {
+    fclose(f);
+  };
+
+  MeshCacheHeader header;
+
+  if (fread(&header, 1, sizeof(header), f) != sizeof(header) || !isMeshCacheHeaderValid(header, getFileSize64(f)))
+    return false;
+
+  const MeshCacheSection* section = header.findSection(MeshCacheSection_Manifest);
+
+  if (!section || fseek64(f, (int64_t)section->offset, SEEK_SET))
+    return false;
+
+  std::vector<uint8_t> data(section->size);
+
+  if (fread(data.data(), 1, data.size(), f) != data.size())
+    return false;
+
+  const uint8_t* ptr = data.data();
+  const uint8_t* end = data.data() + data.size();
+
+  auto read = [&ptr, end](void* dst, size_t size) {
+    if (size_t(end - ptr) < size)
+      return false;
+    memcpy(dst, ptr, size);
+    ptr += size;
+    return true;
+  };
+
+  MeshCacheManifestHeader hdr;
+
+  if (!read(&hdr, sizeof(hdr)))
+    return false;
+
+  manifest.paramsHash = hdr.paramsHash;
+  manifest.sources.clear();
+
+  for (uint32_t i = 0; i != hdr.numSources; i++) {
+    MeshCacheSource source;
+    uint32_t nameLength = 0;
+    if (!read(&source.size, sizeof(source.size)) || !read(&source.mtime, sizeof(source.mtime)) ||
+        !read(&nameLength, sizeof(nameLength)) || size_t(end - ptr) < nameLength)
+      return false;
+    source.fileName.assign(reinterpret_cast<const char*>(ptr), nameLength);
+    ptr += nameLength;
+    manifest.sources.push_back(std::move(source));
+  }
+
+  return true;
+}
+
+bool isMeshCacheUpToDate(const char* fileName, uint64_t paramsHash)
+{
+  MeshCacheManifest manifest;
+
+  if (!loadMeshCacheManifest(fileName, manifest))
+    return false;
+
+  if (manifest.paramsHash != paramsHash) {
+    printf("Mesh cache '%s' is stale: the build parameters changed.\n", fileName);
+    return false;
+  }
+
+  for (const MeshCacheSource& s : manifest.sources) {
+    const MeshCacheSource current = getMeshCacheSource(s.fileName.c_str());
+    if (current.size != s.size || current.mtime != s.mtime) {
+      printf("Mesh cache '%s' is stale: '%s' changed.\n", fileName, s.fileName.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// meshoptimizer codecs: the index codec needs whole triangles, the vertex codec needs 4-byte aligned vertices of up to 256 bytes
+static bool canEncodeIndices(const std::span<const uint32_t>& indices)
+{
+  return indices.size() % 3 == 0;
+}
+
+static bool canEncodeVertices(uint32_t vertexSize)
+{
+  return vertexSize % 4 == 0 && vertexSize <= 256;
+}
+
+// encode 'numElements' indices or vertices into independently decodable chunks (see MeshCacheEncodedStream)
+static std::vector<uint8_t> encodeStream(
+    const uint8_t* data, uint64_t numElements, uint32_t elementSize, bool isIndexStream, tf::Executor& executor)
+{
+  const uint64_t elementsPerChunk = isIndexStream ? kEncodedIndicesPerChunk : kEncodedVerticesPerChunk;
+
+  const MeshCacheEncodedStream stream = {
+    .decodedSize = numElements * elementSize,
+    .elementSize = elementSize,
+    .numChunks   = (uint32_t)((numElements + elementsPerChunk - 1) / elementsPerChunk),
+  };
+
+  std::vector<MeshCacheEncodedChunk> chunks(stream.numChunks);
+  std::vector<std::vector<uint8_t>> encodedChunks(stream.numChunks);
+
+  tf::Taskflow taskflow;
+
+  taskflow.for_each_index(0u, stream.numChunks, 1u, [&](uint32_t i) {
+    const uint64_t first = i * elementsPerChunk;
+    const uint64_t count = std::min(elementsPerChunk, numElements - first);
+
+    std::vector<uint8_t>& buffer = encodedChunks[i];
+
+    if (isIndexStream) {
+      const uint32_t* indices = reinterpret_cast<const uint32_t*>(data) + first;
+      const uint32_t maxIndex = count ? *std::max_element(indices, indices + count) : 0;
+      buffer.resize(meshopt_encodeIndexBufferBound(count, size_t(maxIndex) + 1));
+      buffer.resize(meshopt_encodeIndexBuffer(buffer.data(), buffer.size(), indices, count));
+    } else {
+      buffer.resize(meshopt_encodeVertexBufferBound(count, elementSize));
+      buffer.resize(meshopt_encodeVertexBuffer(buffer.data(), buffer.size(), data + first * elementSize, count, elementSize));
+    }
+
+    chunks[i] = {
+      .size         = buffer.size(),
+      .firstElement = first,
+      .numElements  = count,
+    };
+  });
+
+  executor.run(taskflow).wait();
+
+  std::vector<uint8_t> result(sizeof(stream) + sizeof(MeshCacheEncodedChunk) * stream.numChunks);
+
+  for (uint32_t i = 0; i != stream.numChunks; i++) {
+    chunks[i].offset = result.size();
+    mergeVectors(result, encodedChunks[i]);
+  }
+
+  memcpy(result.data(), &stream, sizeof(stream));
+  memcpy(result.data() + sizeof(stream), chunks.data(), sizeof(MeshCacheEncodedChunk) * chunks.size());
+
+  return result;
+}
+
+// decode an encoded section in parallel, returns false if the data is corrupted
+template <typename T>
+static bool decodeStream(const uint8_t* data, uint64_t size, bool isIndexStream, std::vector<T>& out, tf::Executor& executor)
+{
+  MeshCacheEncodedStream stream;
+
+  if (size < sizeof(stream))
+    return false;
+
+  memcpy(&stream, data, sizeof(stream));
+
+  if (!stream.elementSize || stream.decodedSize % stream.elementSize || stream.decodedSize % sizeof(T) ||
+      (size - sizeof(stream)) / sizeof(MeshCacheEncodedChunk) < stream.numChunks)
+    return false;
+
+  if (isIndexStream && stream.elementSize != sizeof(uint32_t))
+    return false;
+
+  std::vector<MeshCacheEncodedChunk> chunks(stream.numChunks);
+  memcpy(chunks.data(), data + sizeof(stream), sizeof(MeshCacheEncodedChunk) * stream.numChunks);
+
+  out.resize(stream.decodedSize / sizeof(T));
+
+  uint8_t* dst               = reinterpret_cast<uint8_t*>(out.data());
+  const uint64_t numElements = stream.decodedSize / stream.elementSize;
+  std::atomic<bool> corrupted = false;
+
+  tf::Taskflow taskflow;
+
+  taskflow.for_each_index(0u, stream.numChunks, 1u, [&](uint32_t i) {
+    const MeshCacheEncodedChunk& c = chunks[i];
+
+    if (c.offset > size || c.size > size - c.offset || c.firstElement > numElements || c.numElements > numElements - c.firstElement) {
+      corrupted = true;
+      return;
+    }
+
+    uint8_t* chunkDst = dst + c.firstElement * stream.elementSize;
+
+    const int result = isIndexStream
+                           ? meshopt_decodeIndexBuffer(chunkDst, c.numElements, stream.elementSize, data + c.offset, c.size)
+                           : meshopt_decodeVertexBuffer(chunkDst, c.numElements, stream.elementSize, data + c.offset, c.size);
+
+    if (result != 0)
+      corrupted = true;
+  });
+
+  executor.run(taskflow).wait();
+
+  return !corrupted;
+}
+
+void saveMeshCache(const char* fileName, const MeshData& m, const Scene& scene, bool encodeGeometry, const MeshCacheManifest* manifest)
+{
+  // opened for update: the sections are read back to compute their hashes
+  FILE* f = fopen(fileName, "w+b");
+
+  if (!f) {
+    printf("Error opening file '%s' for writing.\n", fileName);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  MeshCacheHeader header = { .streams = m.streams };
+
+  // reserve space for the header; it is rewritten once all the sections are in place
+  fwrite(&header, 1, sizeof(header), f);
+
+  auto writeSection = [f, &header](MeshCacheSectionType type, auto&& writer) {
+    const uint8_t zeros[kMeshCacheSectionAlignment] = {};
+    const uint64_t pos                              = (uint64_t)ftell64(f);
+    fwrite(zeros, 1, (kMeshCacheSectionAlignment - pos % kMeshCacheSectionAlignment) % kMeshCacheSectionAlignment, f);
+
+    LVK_ASSERT(header.numSections < kMeshCacheMaxSections);
+    MeshCacheSection& s = header.sections[header.numSections++];
+    s.type              = type;
+    s.offset            = (uint64_t)ftell64(f);
+    writer();
+    s.size = (uint64_t)ftell64(f) - s.offset;
+  };
+
+  const std::span<const uint32_t> indices = m.getIndexData();
+  const std::span<const uint8_t> vertices = m.getVertexData();
+
+  const uint32_t vertexSize = m.streams.getVertexSize();
+
+  const bool encodeIndices  = encodeGeometry && canEncodeIndices(indices);
+  const bool encodeVertices = encodeGeometry && canEncodeVertices(vertexSize);
+
+  tf::Executor executor;
+
+  writeSection(MeshCacheSection_Meshes, [&]() { fwrite(m.meshes.data(), sizeof(Mesh), m.meshes.size(), f); });
+  writeSection(MeshCacheSection_Boxes, [&]() { fwrite(m.boxes.data(), sizeof(BoundingBox), m.boxes.size(), f); });
+  if (encodeIndices) {
+    const std::vector<uint8_t> encoded =
+        encodeStream(reinterpret_cast<const uint8_t*>(indices.data()), indices.size(), sizeof(uint32_t), true, executor);
+    writeSection(MeshCacheSection_IndicesEncoded, [&]() { fwrite(encoded.data(), 1, encoded.size(), f); });
+  } else {
+    writeSection(MeshCacheSection_Indices, [&]() { fwrite(indices.data(), sizeof(uint32_t), indices.size(), f); });
+  }
+  if (encodeVertices) {
+    const std::vector<uint8_t> encoded = encodeStream(vertices.data(), vertices.size() / vertexSize, vertexSize, false, executor);
+    writeSection(MeshCacheSection_VerticesEncoded, [&]() { fwrite(encoded.data(), 1, encoded.size(), f); });
+  } else {
+    writeSection(MeshCacheSection_Vertices, [&]() { fwrite(vertices.data(), 1, vertices.size(), f); });
+  }
+  writeSection(MeshCacheSection_Materials, [&]() { saveMeshDataMaterials(f, m); });
+  writeSection(MeshCacheSection_Scene, [&]() { saveScene(f, scene); });
+  if (!m.meshlets.empty()) {
+    LVK_ASSERT(m.meshletRanges.size() == m.meshes.size());
+    const MeshCacheMeshlets meshlets = {
+      .numMeshes        = (uint32_t)m.meshletRanges.size(),
+      .numMeshlets      = (uint32_t)m.meshlets.size(),
+      .numVertices      = m.meshletVertices.size(),
+      .numTriangleBytes = m.meshletTriangles.size(),
+    };
+    writeSection(MeshCacheSection_Meshlets, [&]() {
+      fwrite(&meshlets, sizeof(meshlets), 1, f);
+      fwrite(m.meshletRanges.data(), sizeof(MeshletRange), m.meshletRanges.size(), f);
+      fwrite(m.meshlets.data(), sizeof(Meshlet), m.meshlets.size(), f);
+      fwrite(m.meshletVertices.data(), sizeof(uint32_t), m.meshletVertices.size(), f);
+      fwrite(m.meshletTriangles.data(), 1, m.meshletTriangles.size(), f);
+    });
+  }
+  if (manifest) {
+    writeSection(MeshCacheSection_Manifest, [&]() {
+      const MeshCacheManifestHeader hdr = {
+        .paramsHash = manifest->paramsHash,
+        .numSources = (uint32_t)manifest->sources.size(),
+      };
+      fwrite(&hdr, sizeof(hdr), 1, f);
+      for (const MeshCacheSource& s : manifest->sources) {
+        const uint32_t nameLength = (uint32_t)s.fileName.size();
+        fwrite(&s.size, sizeof(s.size), 1, f);
+        fwrite(&s.mtime, sizeof(s.mtime), 1, f);
+        fwrite(&nameLength, sizeof(nameLength), 1, f);
+        fwrite(s.fileName.data(), 1, nameLength, f);
+      }
+    });
+  }
+
+  header.fileSize = (uint64_t)ftell64(f);
+
+  fflush(f);
+
+  for (uint32_t i = 0; i != header.numSections; i++)
+    header.sections[i].hash = hashFileRange(f, header.sections[i].offset, header.sections[i].size);
+
+  fseek64(f, 0, SEEK_SET);
+  fwrite(&header, 1, sizeof(header), f);
+
+  fclose(f);
+}
+
+MeshCacheHeader loadMeshCache(const char* fileName, MeshData& out, Scene& scene, bool mapMeshData)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f) {
+    printf("Cannot open '%s'.\n", fileName);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  SCOPE_EXIT
+  {
+    fclose(f);
+  };
+
+  MeshCacheHeader header;
+
+  if (fread(&header, 1, sizeof(header), f) != sizeof(header) || !isMeshCacheHeaderValid(header, getFileSize64(f))) {
+    printf("Corrupted mesh cache '%s'.\n", fileName);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  const MeshCacheSection& meshes    = *header.findSection(MeshCacheSection_Meshes);
+  const MeshCacheSection& boxes     = *header.findSection(MeshCacheSection_Boxes);
+  const MeshCacheSection& materials = *header.findSection(MeshCacheSection_Materials);
+  const MeshCacheSection& sceneData = *header.findSection(MeshCacheSection_Scene);
+
+  // exactly one of each pair is present (see isMeshCacheHeaderValid())
+  const MeshCacheSection* indices         = header.findSection(MeshCacheSection_Indices);
+  const MeshCacheSection* vertices        = header.findSection(MeshCacheSection_Vertices);
+  const MeshCacheSection* indicesEncoded  = header.findSection(MeshCacheSection_IndicesEncoded);
+  const MeshCacheSection* verticesEncoded = header.findSection(MeshCacheSection_VerticesEncoded);
+
+  auto readSection = [f, fileName](const MeshCacheSection& s, void* dst) {
+    if (fseek64(f, (int64_t)s.offset, SEEK_SET) || fread(dst, 1, s.size, f) != s.size) {
+      printf("Unable to read section %u of '%s'.\n", s.type, fileName);
+      assert(false);
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  out.streams = header.streams;
+
+  out.meshes.resize(meshes.size / sizeof(Mesh));
+  readSection(meshes, out.meshes.data());
+
+  out.boxes.resize(boxes.size / sizeof(BoundingBox));
+  readSection(boxes, out.boxes.data());
+
+  std::shared_ptr<MappedFile> file;
+
+  if (mapMeshData) {
+    file = std::make_shared<MappedFile>(fileName);
+
+    if (!file->valid() || file->size() != header.fileSize) {
+      printf("Cannot map '%s'.\n", fileName);
+      assert(false);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  out.indexData.clear();
+  out.vertexData.clear();
+  out.releaseMappedData();
+
+  if (indicesEncoded || verticesEncoded) {
+    tf::Executor executor;
+
+    std::vector<uint8_t> encoded;
+
+    // encoded sections are read from the mapping when there is one, and decoded straight into MeshData
+    auto decodeSection = [&](const MeshCacheSection& s, bool isIndexStream, auto& dst) {
+      const uint8_t* data = file ? file->data() + s.offset : nullptr;
+      if (!data) {
+        encoded.resize(s.size);
+        readSection(s, encoded.data());
+        data = encoded.data();
+      }
+      if (!decodeStream(data, s.size, isIndexStream, dst, executor)) {
+        printf("Unable to decode section %u of '%s'.\n", s.type, fileName);
+        assert(false);
+        exit(EXIT_FAILURE);
+      }
+    };
+
+    if (indicesEncoded)
+      decodeSection(*indicesEncoded, true, out.indexData);
+    if (verticesEncoded)
+      decodeSection(*verticesEncoded, false, out.vertexData);
+  }
+
+  // raw streams stay mapped only if nothing had to be decoded, otherwise MeshData would mix mapped and decoded streams
+  if (file && indices && vertices) {
+    out.mappedIndexData =
+        std::span<const uint32_t>(reinterpret_cast<const uint32_t*>(file->data() + indices->offset), indices->size / sizeof(uint32_t));
+    out.mappedVertexData = std::span<const uint8_t>(file->data() + vertices->offset, vertices->size);
+    out.mappedFile       = std::move(file);
+  } else {
+    if (indices) {
+      out.indexData.resize(indices->size / sizeof(uint32_t));
+      readSection(*indices, out.indexData.data());
+    }
+    if (vertices) {
+      out.vertexData.resize(vertices->size);
+      readSection(*vertices, out.vertexData.data());
+    }
+  }
+
+  if (out.vertexData.size() % header.streams.getVertexSize()) {
+    printf("Corrupted vertex data in '%s'.\n", fileName);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  out.meshletRanges.clear();
+  out.meshlets.clear();
+  out.meshletVertices.clear();
+  out.meshletTriangles.clear();
+
+  if (const MeshCacheSection* meshlets = header.findSection(MeshCacheSection_Meshlets)) {
+    std::vector<uint8_t> data(meshlets->size);
+    readSection(*meshlets, data.data());
+
+    MeshCacheMeshlets hdr;
+    memcpy(&hdr, data.data(), sizeof(hdr));
+
+    const uint64_t expectedSize = sizeof(hdr) + sizeof(MeshletRange) * hdr.numMeshes + sizeof(Meshlet) * hdr.numMeshlets +
+                                  sizeof(uint32_t) * hdr.numVertices + hdr.numTriangleBytes;
+
+    if (hdr.numMeshes != out.meshes.size() || expectedSize != meshlets->size) {
+      printf("Corrupted meshlets in '%s'.\n", fileName);
+      assert(false);
+      exit(EXIT_FAILURE);
+    }
+
+    const uint8_t* ptr = data.data() + sizeof(hdr);
+
+    auto readArray = [&ptr](auto& dst, uint64_t count) {
+      dst.resize(count);
+      memcpy(dst.data(), ptr, count * sizeof(dst[0]));
+      ptr += count * sizeof(dst[0]);
+    };
+
+    readArray(out.meshletRanges, hdr.numMeshes);
+    readArray(out.meshlets, hdr.numMeshlets);
+    readArray(out.meshletVertices, hdr.numVertices);
+    readArray(out.meshletTriangles, hdr.numTriangleBytes);
+  }
+
+  fseek64(f, (int64_t)materials.offset, SEEK_SET);
+  loadMeshDataMaterials(f, out);
+
+  fseek64(f, (int64_t)sceneData.offset, SEEK_SET);
+  loadScene(f, scene, (int64_t)(sceneData.offset + sceneData.size));
+
+  return header;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "shared/Scene/Scene.h"
+#include "shared/Scene/VtxData.h"
+
+// A single-file container for everything loadBistro() used to write into separate .meshes/.materials/.scene files.
+// The file starts with a fixed-size header holding a section table; each section is 16-byte aligned and
+// carries a 64-bit content hash. Checking the header against the file size is enough to reject stale or truncated
+// caches without touching the payload. Hashes are verified only on request (see verifyMeshCacheHashes()).
+
+constexpr uint32_t kMeshCacheMagic       = 0x4843534D; // 'MSCH'
+constexpr uint32_t kMeshCacheVersion     = 5; // 2: 64-bit index/vertex offsets in Mesh, 3: encoded streams, 4: meshlets, 5: affine transforms
+constexpr uint32_t kMeshCacheMaxSections = 16;
+
+enum MeshCacheSectionType : uint32_t {
+  MeshCacheSection_Meshes    = 0, // Mesh[]
+  MeshCacheSection_Boxes     = 1, // BoundingBox[], one per mesh
+  MeshCacheSection_Indices   = 2, // uint32_t[]
+  MeshCacheSection_Vertices  = 3, // interleaved vertices as described by MeshCacheHeader::streams
+  MeshCacheSection_Materials = 4, // same layout as a .materials file
+  MeshCacheSection_Scene     = 5, // same layout as a .scene file
+  // optional replacements for MeshCacheSection_Indices/Vertices, see MeshCacheEncodedStream
+  MeshCacheSection_IndicesEncoded  = 6, // meshoptimizer index codec
+  MeshCacheSection_VerticesEncoded = 7, // meshoptimizer vertex codec
+  // optional, see MeshCacheMeshlets
+  MeshCacheSection_Meshlets  = 8,
+  // optional, see MeshCacheManifest
+  MeshCacheSection_Manifest  = 9,
+  MeshCacheSection_Invalid   = 0xFFFFFFFF,
+};
+
+struct MeshCacheSection {
+  uint32_t type   = MeshCacheSection_Invalid;
+  uint32_t flags  = 0;
+  uint64_t offset = 0; // from the beginning of the file
+  uint64_t size   = 0;
+  uint64_t hash   = 0; // hashBytes64() of the payload
+};
+
+struct MeshCacheHeader {
+  uint32_t magicValue  = kMeshCacheMagic;
+  uint32_t version     = kMeshCacheVersion;
+  uint32_t numSections = 0;
+  uint32_t reserved    = 0;
+  // total size of the file, used to detect truncated caches
+  uint64_t fileSize = 0;
+  lvk::VertexInput streams = {};
+  MeshCacheSection sections[kMeshCacheMaxSections] = {};
+
+  const MeshCacheSection* findSection(uint32_t type) const
+  {
+    for (uint32_t i = 0; i != numSections; i++)
+      if (sections[i].type == type)
+        return &sections[i];
+    return nullptr;
+  }
+};
+
+// Encoded sections are split into chunks which can be decoded independently of each other:
+//   | MeshCacheEncodedStream | MeshCacheEncodedChunk[numChunks] | encoded chunks |
+struct MeshCacheEncodedStream {
+  uint64_t decodedSize = 0; // in bytes
+  uint32_t elementSize = 0; // size of one index or vertex in bytes
+  uint32_t numChunks   = 0;
+};
+
+struct MeshCacheEncodedChunk {
+  uint64_t offset       = 0; // from the beginning of the section
+  uint64_t size         = 0; // encoded size in bytes
+  uint64_t firstElement = 0;
+  uint64_t numElements  = 0;
+};
+
+// The meshlet section stores all the meshlet arrays of MeshData back to back:
+//   | MeshCacheMeshlets | MeshletRange[numMeshes] | Meshlet[numMeshlets] | uint32_t[numVertices] | uint8_t[numTriangleBytes] |
+struct MeshCacheMeshlets {
+  uint32_t numMeshes        = 0; // has to match the number of meshes in MeshCacheSection_Meshes
+  uint32_t numMeshlets      = 0;
+  uint64_t numVertices      = 0;
+  uint64_t numTriangleBytes = 0;
+};
+
+// What a cache was built from: the source files with their sizes and modification times, and a fingerprint of the
+// build parameters. The manifest section stores
+//   | MeshCacheManifestHeader | numSources x { int64_t size | int64_t mtime | uint32_t nameLength | char name[nameLength] } |
+struct MeshCacheSource {
+  std::string fileName;
+  int64_t size  = -1; // -1 if the file does not exist
+  int64_t mtime = 0;  // ticks of std::filesystem::file_time_type
+};
+
+struct MeshCacheManifest {
+  uint64_t paramsHash = 0;
+  std::vector<MeshCacheSource> sources;
+};
+
+struct MeshCacheManifestHeader {
+  uint64_t paramsHash = 0;
+  uint32_t numSources = 0;
+  uint32_t reserved   = 0;
+};
+
+// 64-bit FNV-1a over 8-byte words; feeding the data in pieces gives the same result as long as all pieces except the last one are
+// multiples of 8 bytes
+constexpr uint64_t kHash64Seed = 0xcbf29ce484222325ull;
+uint64_t hashBytes64(const void* data, size_t size, uint64_t hash = kHash64Seed);
+
+// O(header): checks the magic value, version, section table and the file size, never reads the payload
+bool isMeshCacheValid(const char* fileName);
+// reads the entire payload and compares the content hashes
+bool verifyMeshCacheHashes(const char* fileName);
+
+// the current size and modification time of a file
+MeshCacheSource getMeshCacheSource(const char* fileName);
+// reads only the header and the manifest section; false if the cache is invalid or has no manifest
+bool loadMeshCacheManifest(const char* fileName, MeshCacheManifest& manifest);
+// isMeshCacheValid() plus a manifest matching paramsHash and the current state of every source file
+bool isMeshCacheUpToDate(const char* fileName, uint64_t paramsHash);
+
+// encodeGeometry: store indices and vertices using the meshoptimizer codecs (smaller files, decoded in parallel on load)
+void saveMeshCache(
+    const char* fileName, const MeshData& m, const Scene& scene, bool encodeGeometry = false, const MeshCacheManifest* manifest = nullptr);
+// mapMeshData: index and vertex data stay in a read-only mapping of the file (see loadMeshDataMapped()).
+// Encoded streams are always decoded into MeshData::indexData/vertexData
+MeshCacheHeader loadMeshCache(const char* fileName, MeshData& out, Scene& scene, bool mapMeshData = false);
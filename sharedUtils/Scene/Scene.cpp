@@ -1,16 +1,25 @@
 ﻿#include "shared/Scene/Scene.h"
 #include "shared/Utils.h"
+#include "shared/UtilsFile.h"
 
 #include <algorithm>
 #include <numeric>
 
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_TRANSFORMS_SSE 1
+#endif
+
 int addNode(Scene& scene, int parent, int level)
 {
   const int node = (int)scene.hierarchy.size();
   {
     // TODO: resize aux arrays (local/global etc.)
-    scene.localTransform.push_back(glm::mat4(1.0f));
-    scene.globalTransform.push_back(glm::mat4(1.0f));
+    scene.localTransform.push_back(AffineTransform());
+    scene.globalTransform.push_back(AffineTransform());
   }
   scene.hierarchy.push_back({ .parent = parent, .lastSibling = -1 });
   if (parent > -1) {
@@ -36,19 +45,60 @@ int addNode(Scene& scene, int parent, int level)
   return node;
 }
 
+static void markSubtreeAsChanged(Scene& scene, int node, std::vector<int>& stack)
+{
+  stack.push_back(node);
+
+  while (!stack.empty()) {
+    const int n = stack.back();
+    stack.pop_back();
+
+    // queued nodes always have their entire subtree queued
+    if (scene.changedEpoch[n] == scene.currentChangedEpoch)
+      continue;
+
+    scene.changedEpoch[n] = scene.currentChangedEpoch;
+    scene.changedAtThisFrame[scene.hierarchy[n].level].push_back(n);
+
+    for (int s = scene.hierarchy[n].firstChild; s != -1; s = scene.hierarchy[s].nextSibling)
+      stack.push_back(s);
+  }
+}
+
 void markAsChanged(Scene& scene, int node)
 {
-  const int level = scene.hierarchy[node].level;
-  scene.changedAtThisFrame[level].push_back(node);
+  markAsChanged(scene, std::span<const int>(&node, 1));
+}
+
+void markAsChanged(Scene& scene, std::span<const int> nodes)
+{
+  // nodes added after the last call start with an old epoch
+  if (scene.changedEpoch.size() < scene.hierarchy.size())
+    scene.changedEpoch.resize(scene.hierarchy.size(), 0);
 
-  // TODO: use non-recursive iteration with aux stack
-  for (int s = scene.hierarchy[node].firstChild; s != -1; s = scene.hierarchy[s].nextSibling) {
-    markAsChanged(scene, s);
+  std::vector<int> stack;
+  for (int node : nodes)
+    markSubtreeAsChanged(scene, node, stack);
+}
+
+void clearChangedNodes(Scene& scene)
+{
+  for (std::vector<int>& nodes : scene.changedAtThisFrame)
+    nodes.clear();
+
+  if (++scene.currentChangedEpoch == 0) {
+    std::fill(scene.changedEpoch.begin(), scene.changedEpoch.end(), 0);
+    scene.currentChangedEpoch = 1;
   }
 }
 
 int findNodeByName(const Scene& scene, const std::string& name)
 {
+  if (scene.hasNameIndex) {
+    const auto it = scene.nodesForName.find(name);
+    return it != scene.nodesForName.end() ? it->second.front() : -1;
+  }
+
   // Extremely simple linear search without any hierarchy reference
   // To support DFS/BFS searches separate traversal routines are needed
 
@@ -63,6 +113,101 @@ int findNodeByName(const Scene& scene, const std::string& name)
   return -1;
 }
 
+std::vector<int> findNodesByName(const Scene& scene, std::span<const std::string_view> names)
+{
+  std::vector<int> nodes(names.size(), -1);
+
+  if (scene.hasNameIndex) {
+    for (size_t i = 0; i != names.size(); i++) {
+      const auto it = scene.nodesForName.find(names[i]);
+      if (it != scene.nodesForName.end())
+        nodes[i] = it->second.front();
+    }
+    return nodes;
+  }
+
+  // name -> positions in 'names'
+  std::unordered_map<std::string_view, std::vector<size_t>> pending;
+  for (size_t i = 0; i != names.size(); i++)
+    pending[names[i]].push_back(i);
+
+  for (size_t i = 0; i < scene.localTransform.size() && !pending.empty(); i++) {
+    if (!scene.nameForNode.contains(i))
+      continue;
+    const auto it = pending.find(scene.nodeNames[scene.nameForNode.at(i)]);
+    if (it == pending.end())
+      continue;
+    for (size_t n : it->second)
+      nodes[n] = (int)i;
+    pending.erase(it);
+  }
+
+  return nodes;
+}
+
+std::vector<int> findNodesByNamePrefix(const Scene& scene, std::string_view prefix)
+{
+  std::vector<int> nodes;
+
+  if (scene.hasNameIndex) {
+    for (auto it = scene.nodesForName.lower_bound(prefix); it != scene.nodesForName.end() && it->first.starts_with(prefix); it++)
+      nodes.insert(nodes.end(), it->second.begin(), it->second.end());
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+  }
+
+  for (size_t i = 0; i < scene.localTransform.size(); i++)
+    if (scene.nameForNode.contains(i) && scene.nodeNames[scene.nameForNode.at(i)].starts_with(prefix))
+      nodes.push_back((int)i);
+
+  return nodes;
+}
+
+static void addToNameIndex(Scene& scene, const std::string& name, int node)
+{
+  std::vector<int>& nodes = scene.nodesForName[name];
+  nodes.insert(std::lower_bound(nodes.begin(), nodes.end(), node), node);
+}
+
+static void removeFromNameIndex(Scene& scene, const std::string& name, int node)
+{
+  const auto it = scene.nodesForName.find(name);
+  if (it == scene.nodesForName.end())
+    return;
+  std::vector<int>& nodes = it->second;
+  const auto n            = std::lower_bound(nodes.begin(), nodes.end(), node);
+  if (n != nodes.end() && *n == node)
+    nodes.erase(n);
+  if (nodes.empty())
+    scene.nodesForName.erase(it);
+}
+
+void buildNodeNameIndex(Scene& scene)
+{
+  scene.nodesForName.clear();
+
+  for (const auto& p : scene.nameForNode)
+    scene.nodesForName[scene.nodeNames[p.second]].push_back((int)p.first);
+
+  for (auto& p : scene.nodesForName)
+    std::sort(p.second.begin(), p.second.end());
+
+  scene.hasNameIndex = true;
+}
+
+void setNodeName(Scene& scene, int node, const std::string& name)
+{
+  if (scene.hasNameIndex) {
+    if (scene.nameForNode.contains(node))
+      removeFromNameIndex(scene, scene.nodeNames[scene.nameForNode.at(node)], node);
+    addToNameIndex(scene, name, node);
+  }
+
+  uint32_t stringID = (uint32_t)scene.nodeNames.size();
+  scene.nodeNames.push_back(name);
+  scene.nameForNode[node] = stringID;
+}
+
 bool mat4IsIdentity(const glm::mat4& m);
 void fprintfMat4(FILE* f, const glm::mat4& m);
 
@@ -71,10 +216,9 @@ bool recalculateGlobalTransforms(Scene& scene)
 {
   bool wasUpdated = false;
 
-  if (!scene.changedAtThisFrame[0].empty()) {
-    const int c              = scene.changedAtThisFrame[0][0];
+  // a scene can have several roots, e.g. after reparentNode(node, -1)
+  for (int c : scene.changedAtThisFrame[0]) {
     scene.globalTransform[c] = scene.localTransform[c];
-    scene.changedAtThisFrame[0].clear();
     wasUpdated = true;
   }
 
@@ -84,13 +228,93 @@ bool recalculateGlobalTransforms(Scene& scene)
       scene.globalTransform[c] = scene.globalTransform[p] * scene.localTransform[c];
     }
     wasUpdated |= !scene.changedAtThisFrame[i].empty();
-    scene.changedAtThisFrame[i].clear();
   }
 
+  clearChangedNodes(scene);
+
+  return wasUpdated;
+}
+
+#if defined(SCENE_TRANSFORMS_SSE)
+// out = a * b: every row of the result is a linear combination of the rows of 'b' plus the translation of 'a'
+static inline void multiplyAffineSSE(const AffineTransform& a, const AffineTransform& b, AffineTransform& out)
+{
+  const float* pa = &a.rows[0].x;
+  const float* pb = &b.rows[0].x;
+  float* po       = &out.rows[0].x;
+
+  const __m128 b0 = _mm_loadu_ps(pb + 0);
+  const __m128 b1 = _mm_loadu_ps(pb + 4);
+  const __m128 b2 = _mm_loadu_ps(pb + 8);
+  const __m128 b3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f); // the implicit last row (0, 0, 0, 1)
+
+  for (int i = 0; i != 3; i++) {
+    const __m128 x = _mm_mul_ps(b0, _mm_set1_ps(pa[i * 4 + 0]));
+    const __m128 y = _mm_mul_ps(b1, _mm_set1_ps(pa[i * 4 + 1]));
+    const __m128 z = _mm_mul_ps(b2, _mm_set1_ps(pa[i * 4 + 2]));
+    const __m128 w = _mm_mul_ps(b3, _mm_set1_ps(pa[i * 4 + 3]));
+    _mm_storeu_ps(po + i * 4, _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w)));
+  }
+}
+#endif
+
+template <bool kSIMD> static void updateGlobalTransforms(Scene& scene, const int* nodes, size_t numNodes)
+{
+  for (size_t i = 0; i != numNodes; i++) {
+    const int c = nodes[i];
+    const int p = scene.hierarchy[c].parent;
+#if defined(SCENE_TRANSFORMS_SSE)
+    if constexpr (kSIMD) {
+      multiplyAffineSSE(scene.globalTransform[p], scene.localTransform[c], scene.globalTransform[c]);
+      continue;
+    }
+#endif
+    scene.globalTransform[c] = scene.globalTransform[p] * scene.localTransform[c];
+  }
+}
+
+// smaller levels are not worth waking up the worker threads
+static constexpr size_t kNodesPerTransformTask = 1024;
+
+bool recalculateGlobalTransformsParallel(Scene& scene, tf::Executor& executor, bool useSIMD)
+{
+  bool wasUpdated = false;
+
+  // a scene can have several roots, e.g. after reparentNode(node, -1)
+  for (int c : scene.changedAtThisFrame[0]) {
+    scene.globalTransform[c] = scene.localTransform[c];
+    wasUpdated = true;
+  }
+
+  auto update = useSIMD ? &updateGlobalTransforms<true> : &updateGlobalTransforms<false>;
+
+  tf::Taskflow taskflow;
+
+  // the parents of a level are all in the levels above, so only the levels have to be processed in order
+  for (int i = 1; i < MAX_NODE_LEVEL; i++) {
+    const std::vector<int>& nodes = scene.changedAtThisFrame[i];
+
+    if (nodes.size() <= kNodesPerTransformTask) {
+      update(scene, nodes.data(), nodes.size());
+    } else {
+      const size_t numTasks = (nodes.size() + kNodesPerTransformTask - 1) / kNodesPerTransformTask;
+      taskflow.clear();
+      taskflow.for_each_index(size_t(0), numTasks, size_t(1), [&scene, &nodes, update](size_t t) {
+        const size_t first = t * kNodesPerTransformTask;
+        update(scene, nodes.data() + first, std::min(kNodesPerTransformTask, nodes.size() - first));
+      });
+      executor.run(taskflow).wait();
+    }
+
+    wasUpdated |= !nodes.empty();
+  }
+
+  clearChangedNodes(scene);
+
   return wasUpdated;
 }
 
-void loadMap(FILE* f, std::unordered_map<uint32_t, uint32_t>& map)
+void loadMap(FILE* f, NodeComponentMap& map)
 {
   std::vector<uint32_t> ms;
 
@@ -100,20 +324,24 @@ void loadMap(FILE* f, std::unordered_map<uint32_t, uint32_t>& map)
   ms.resize(sz);
   fread(ms.data(), sizeof(uint32_t), sz, f);
 
+  map.clear();
+  map.reserve(sz / 2);
   for (size_t i = 0; i < (sz / 2); i++)
     map[ms[i * 2 + 0]] = ms[i * 2 + 1];
 }
 
-void loadScene(const char* fileName, Scene& scene)
+void loadScene(FILE* f, Scene& scene, int64_t endOffset)
 {
-  FILE* f = fopen(fileName, "rb");
-
-  if (!f) {
-    printf("Cannot open scene file '%s'. Please run SceneConverter from Chapter7 and/or MergeMeshes from Chapter 9", fileName);
-    return;
+  uint32_t magic = 0;
+  uint32_t sz    = 0;
+  fread(&magic, sizeof(magic), 1, f);
+
+  if (magic != kSceneMagic) {
+    printf("Unsupported scene file format. Please delete the cached scene files and run the demo again\n");
+    assert(false);
+    exit(EXIT_FAILURE);
   }
 
-  uint32_t sz = 0;
   fread(&sz, sizeof(sz), 1, f);
 
   scene.hierarchy.resize(sz);
@@ -121,27 +349,43 @@ void loadScene(const char* fileName, Scene& scene)
   scene.localTransform.resize(sz);
   // TODO: check > -1
   // TODO: recalculate changedAtThisLevel() - find max depth of a node [or save scene.maxLevel]
-  fread(scene.localTransform.data(), sizeof(glm::mat4), sz, f);
-  fread(scene.globalTransform.data(), sizeof(glm::mat4), sz, f);
+  fread(scene.localTransform.data(), sizeof(AffineTransform), sz, f);
+  fread(scene.globalTransform.data(), sizeof(AffineTransform), sz, f);
   fread(scene.hierarchy.data(), sizeof(Hierarchy), sz, f);
 
   // Mesh for node [index to some list of buffers]
   loadMap(f, scene.materialForNode);
   loadMap(f, scene.meshForNode);
 
-  if (!feof(f)) {
+  // the names block is optional
+  if (ftell64(f) < endOffset) {
     loadMap(f, scene.nameForNode);
     loadStringList(f, scene.nodeNames);
     loadStringList(f, scene.materialNames);
   }
 
-  fclose(f);
+  if (scene.hasNameIndex)
+    buildNodeNameIndex(scene);
 
   markAsChanged(scene, 0);
   recalculateGlobalTransforms(scene);
 }
 
-void saveMap(FILE* f, const std::unordered_map<uint32_t, uint32_t>& map)
+void loadScene(const char* fileName, Scene& scene)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f) {
+    printf("Cannot open scene file '%s'. Please run SceneConverter from Chapter7 and/or MergeMeshes from Chapter 9", fileName);
+    return;
+  }
+
+  loadScene(f, scene, getFileSize64(f));
+
+  fclose(f);
+}
+
+void saveMap(FILE* f, const NodeComponentMap& map)
 {
   std::vector<uint32_t> ms;
   ms.reserve(map.size() * 2);
@@ -154,15 +398,15 @@ void saveMap(FILE* f, const std::unordered_map<uint32_t, uint32_t>& map)
   fwrite(ms.data(), sizeof(uint32_t), ms.size(), f);
 }
 
-void saveScene(const char* fileName, const Scene& scene)
+void saveScene(FILE* f, const Scene& scene)
 {
-  FILE* f = fopen(fileName, "wb");
-
-  const uint32_t sz = (uint32_t)scene.hierarchy.size();
+  const uint32_t magic = kSceneMagic;
+  const uint32_t sz    = (uint32_t)scene.hierarchy.size();
+  fwrite(&magic, sizeof(magic), 1, f);
   fwrite(&sz, sizeof(sz), 1, f);
 
-  fwrite(scene.localTransform.data(), sizeof(glm::mat4), sz, f);
-  fwrite(scene.globalTransform.data(), sizeof(glm::mat4), sz, f);
+  fwrite(scene.localTransform.data(), sizeof(AffineTransform), sz, f);
+  fwrite(scene.globalTransform.data(), sizeof(AffineTransform), sz, f);
   fwrite(scene.hierarchy.data(), sizeof(Hierarchy), sz, f);
 
   // Mesh for node [index to some list of buffers]
@@ -174,6 +418,14 @@ void saveScene(const char* fileName, const Scene& scene)
     saveStringList(f, scene.nodeNames);
     saveStringList(f, scene.materialNames);
   }
+}
+
+void saveScene(const char* fileName, const Scene& scene)
+{
+  FILE* f = fopen(fileName, "wb");
+
+  saveScene(f, scene);
+
   fclose(f);
 }
 
@@ -258,7 +510,7 @@ void shiftNodes(Scene& scene, int startOffset, int nodeCount, int shiftAmount)
     shiftNode(scene.hierarchy[i + startOffset]);
 }
 
-using ItemMap = std::unordered_map<uint32_t, uint32_t>;
+using ItemMap = NodeComponentMap;
 
 // Add the items from otherMap shifting indices and values along the way
 void mergeMaps(ItemMap& m, const ItemMap& otherMap, int indexOffset, int itemOffset)
@@ -291,8 +543,13 @@ void mergeScenes(
   scene.nameForNode[0] = 0;
   scene.nodeNames      = { "NewRoot" };
 
-  scene.localTransform.push_back(glm::mat4(1.f));
-  scene.globalTransform.push_back(glm::mat4(1.f));
+  if (scene.hasNameIndex) {
+    scene.nodesForName.clear();
+    addToNameIndex(scene, scene.nodeNames[0], 0);
+  }
+
+  scene.localTransform.push_back(AffineTransform());
+  scene.globalTransform.push_back(AffineTransform());
 
   if (scenes.empty())
     return;
@@ -325,6 +582,10 @@ void mergeScenes(
     mergeMaps(scene.materialForNode, s->materialForNode, offs, mergeMaterials ? materialOfs : 0);
     mergeMaps(scene.nameForNode, s->nameForNode, offs, nameOffs);
 
+    if (scene.hasNameIndex)
+      for (const auto& p : s->nameForNode)
+        addToNameIndex(scene, s->nodeNames[p.second], (int)p.first + offs);
+
     offs += nodeCount;
 
     materialOfs += (int)s->materialNames.size();
@@ -351,7 +612,7 @@ void mergeScenes(
 
     // transform old root nodes, if the transforms are given
     if (!rootTransforms.empty())
-      scene.localTransform[offs] = rootTransforms[idx] * scene.localTransform[offs];
+      scene.localTransform[offs] = AffineTransform(rootTransforms[idx]) * scene.localTransform[offs];
 
     offs += nodeCount;
     idx++;
@@ -388,93 +649,373 @@ void dumpSceneToDot(const char* fileName, const Scene& scene, int* visited)
   fclose(f);
 }
 
-// A rather long algorithm (and the auxiliary routines) to delete a number of scene nodes from the hierarchy
-
-// Add an index to a sorted index array
-static void addUniqueIdx(std::vector<uint32_t>& v, uint32_t index)
+void shiftMapIndices(NodeComponentMap& items, const std::vector<int>& newIndices)
 {
-  if (!std::binary_search(v.begin(), v.end(), index))
-    v.push_back(index);
+  NodeComponentMap newItems;
+  newItems.reserve(items.size());
+  for (const auto& m : items) {
+    int newIndex = newIndices[m.first];
+    if (newIndex != -1)
+      newItems[newIndex] = m.second;
+  }
+  items = std::move(newItems);
 }
 
-// Recurse down from a node and collect all nodes which are already marked for deletion
-static void collectNodesToDelete(const Scene& scene, int node, std::vector<uint32_t>& nodes)
+// The surviving nodes do not change their relative order, so the node lists stay sorted
+static void shiftNameIndex(Scene& scene, const std::vector<int>& newIndices)
 {
-  for (int n = scene.hierarchy[node].firstChild; n != -1; n = scene.hierarchy[n].nextSibling) {
-    addUniqueIdx(nodes, n);
-    collectNodesToDelete(scene, n, nodes);
+  for (auto it = scene.nodesForName.begin(); it != scene.nodesForName.end();) {
+    std::vector<int>& nodes = it->second;
+    for (int& n : nodes)
+      n = newIndices[n];
+    nodes.erase(std::remove(nodes.begin(), nodes.end(), -1), nodes.end());
+    it = nodes.empty() ? scene.nodesForName.erase(it) : std::next(it);
   }
 }
 
-int findLastNonDeletedItem(const Scene& scene, const std::vector<int>& newIndices, int node)
+// A few linear passes over the old and the new nodes:
+//   1) the parents after the edit
+//   2) new child lists: the children which stay keep their order, the reparented and the added nodes are appended
+//   3) a breadth-first walk from the roots propagates the removals to the subtrees and recomputes the levels
+//   4) the surviving nodes are compacted in their index order and all the links are remapped
+//   5) components, transforms and the changed-node lists are remapped
+// The scene is modified only in 4) and 5), after the edit has been validated
+std::vector<int> applySceneEdit(Scene& scene, const SceneEdit& edit)
 {
-  // we have to be more subtle:
-  //   if the (newIndices[firstChild_] == -1), we should follow the link and extract the last non-removed item
-  //   ..
-  if (node == -1)
-    return -1;
+  const int numOldNodes = (int)scene.hierarchy.size();
+  const int numNodes    = numOldNodes + (int)edit.newNodeParents.size();
+
+  if (edit.firstNewNode != numOldNodes) {
+    printf("applySceneEdit(): the edit was created for a scene with %d nodes, this one has %d\n", edit.firstNewNode, numOldNodes);
+    return {};
+  }
+
+  auto isValidNode = [numNodes](int n) { return n >= 0 && n < numNodes; };
+  for (int p : edit.newNodeParents)
+    if (p != -1 && !isValidNode(p)) {
+      printf("applySceneEdit(): invalid parent %d of an added node\n", p);
+      return {};
+    }
+  for (int n : edit.removedNodes)
+    if (!isValidNode(n)) {
+      printf("applySceneEdit(): invalid removed node %d\n", n);
+      return {};
+    }
+  for (const auto& [node, newParent] : edit.reparentedNodes)
+    if (node >= numOldNodes || !isValidNode(node) || (newParent != -1 && !isValidNode(newParent))) {
+      printf("applySceneEdit(): invalid reparenting of node %d to %d\n", node, newParent);
+      return {};
+    }
+
+  // 1)
+  std::vector<int> parent(numNodes);
+  for (int i = 0; i != numOldNodes; i++)
+    parent[i] = scene.hierarchy[i].parent;
+  for (size_t i = 0; i != edit.newNodeParents.size(); i++)
+    parent[numOldNodes + i] = edit.newNodeParents[i];
+
+  std::vector<uint8_t> moved(numNodes, 0);
+  for (const auto& [node, newParent] : edit.reparentedNodes) {
+    parent[node] = newParent;
+    moved[node]  = 1;
+  }
+
+  // 2)
+  std::vector<int> firstChild(numNodes, -1);
+  std::vector<int> lastChild(numNodes, -1);
+  std::vector<int> nextSibling(numNodes, -1);
+  int firstRoot = -1;
+  int lastRoot  = -1;
+
+  auto append = [&](int node) {
+    const int p = parent[node];
+    int& first  = p >= 0 ? firstChild[p] : firstRoot;
+    int& last   = p >= 0 ? lastChild[p] : lastRoot;
+    if (first == -1)
+      first = node;
+    else
+      nextSibling[last] = node;
+    last = node;
+  };
+
+  for (int i = 0; i != numOldNodes; i++) {
+    if (parent[i] == -1 && !moved[i])
+      append(i);
+    for (int c = scene.hierarchy[i].firstChild; c != -1; c = scene.hierarchy[c].nextSibling)
+      if (!moved[c])
+        append(c);
+  }
+  for (const auto& [node, newParent] : edit.reparentedNodes) {
+    if (moved[node] == 1)
+      append(node);
+    moved[node] = 2;
+  }
+  for (int i = numOldNodes; i != numNodes; i++)
+    append(i);
+
+  // 3)
+  std::vector<uint8_t> removed(numNodes, 0);
+  for (int n : edit.removedNodes)
+    removed[n] = 1;
+
+  std::vector<int> level(numNodes, 0);
+  std::vector<int> queue;
+  queue.reserve(numNodes);
+  for (int r = firstRoot; r != -1; r = nextSibling[r])
+    queue.push_back(r);
+  for (size_t i = 0; i != queue.size(); i++) {
+    const int n = queue[i];
+    for (int c = firstChild[n]; c != -1; c = nextSibling[c]) {
+      removed[c] |= removed[n];
+      level[c] = level[n] + 1;
+      // changedAtThisFrame[] has MAX_NODE_LEVEL levels
+      if (level[c] >= MAX_NODE_LEVEL && !removed[c]) {
+        printf("applySceneEdit(): node %d would be at level %d, the maximum is %d\n", c, level[c], MAX_NODE_LEVEL - 1);
+        return {};
+      }
+      queue.push_back(c);
+    }
+  }
+
+  // a node reparented into its own subtree forms a cycle which cannot be reached from the roots
+  if (queue.size() != numNodes) {
+    printf("applySceneEdit(): the edit creates a cycle, %d nodes cannot be reached from the roots\n", numNodes - (int)queue.size());
+    return {};
+  }
+
+  // 4)
+  std::vector<int> newIndices(numNodes, -1);
+  int numNewNodes = 0;
+  for (int i = 0; i != numNodes; i++)
+    if (!removed[i])
+      newIndices[i] = numNewNodes++;
+
+  auto firstSurviving = [&removed, &nextSibling](int n) {
+    while (n != -1 && removed[n])
+      n = nextSibling[n];
+    return n;
+  };
+
+  std::vector<Hierarchy> hierarchy(numNewNodes);
+  std::vector<AffineTransform> localTransform(numNewNodes);
+  std::vector<AffineTransform> globalTransform(numNewNodes);
+
+  for (int i = 0; i != numNodes; i++) {
+    if (removed[i])
+      continue;
+    const int n     = newIndices[i];
+    const int child = firstSurviving(firstChild[i]);
+    const int next  = firstSurviving(nextSibling[i]);
+    hierarchy[n]    = {
+      .parent      = parent[i] >= 0 ? newIndices[parent[i]] : -1,
+      .firstChild  = child >= 0 ? newIndices[child] : -1,
+      .nextSibling = next >= 0 ? newIndices[next] : -1,
+      .lastSibling = -1,
+      .level       = level[i],
+    };
+    localTransform[n] = i < numOldNodes ? scene.localTransform[i] : edit.newNodeTransforms[i - numOldNodes];
+    if (i < numOldNodes)
+      globalTransform[n] = scene.globalTransform[i];
+  }
+
+  // as in addNode(), the first child caches the last one
+  for (Hierarchy& h : hierarchy) {
+    if (h.firstChild == -1)
+      continue;
+    int last = h.firstChild;
+    while (hierarchy[last].nextSibling != -1)
+      last = hierarchy[last].nextSibling;
+    hierarchy[h.firstChild].lastSibling = last;
+  }
 
-  return (newIndices[node] == -1) ? findLastNonDeletedItem(scene, newIndices, scene.hierarchy[node].nextSibling) : newIndices[node];
+  // 5)
+  std::vector<int> changedNodes;
+  for (const std::vector<int>& nodes : scene.changedAtThisFrame)
+    for (int n : nodes)
+      if (newIndices[n] != -1)
+        changedNodes.push_back(newIndices[n]);
+  for (const auto& [node, newParent] : edit.reparentedNodes)
+    if (newIndices[node] != -1)
+      changedNodes.push_back(newIndices[node]);
+  for (int i = numOldNodes; i != numNodes; i++)
+    if (newIndices[i] != -1)
+      changedNodes.push_back(newIndices[i]);
+
+  scene.hierarchy       = std::move(hierarchy);
+  scene.localTransform  = std::move(localTransform);
+  scene.globalTransform = std::move(globalTransform);
+
+  shiftMapIndices(scene.meshForNode, newIndices);
+  shiftMapIndices(scene.materialForNode, newIndices);
+  shiftMapIndices(scene.nameForNode, newIndices);
+
+  if (scene.hasNameIndex)
+    shiftNameIndex(scene, newIndices);
+
+  clearChangedNodes(scene);
+  scene.changedEpoch.assign(numNewNodes, 0);
+  markAsChanged(scene, changedNodes);
+
+  // scene node names and material names lists are not modified, unused items stay in them
+  return newIndices;
 }
 
-void shiftMapIndices(std::unordered_map<uint32_t, uint32_t>& items, const std::vector<int>& newIndices)
+void deleteSceneNodes(Scene& scene, const std::vector<uint32_t>& nodesToDelete)
 {
-  std::unordered_map<uint32_t, uint32_t> newItems;
-  for (const auto& m : items) {
-    int newIndex = newIndices[m.first];
-    if (newIndex != -1)
-      newItems[newIndex] = m.second;
+  SceneEdit edit(scene);
+
+  for (uint32_t n : nodesToDelete)
+    edit.removeNode((int)n);
+
+  if (applySceneEdit(scene, edit).empty() && !scene.hierarchy.empty()) {
+    assert(false);
+    exit(EXIT_FAILURE);
   }
-  items = newItems;
 }
 
-// Approximately an O ( N * Log(N) * Log(M)) algorithm (N = scene.size, M = nodesToDelete.size) to delete a collection of nodes from scene
-// graph
-void deleteSceneNodes(Scene& scene, const std::vector<uint32_t>& nodesToDelete)
+// the component maps are rebuilt in the new node order
+static void permuteMap(NodeComponentMap& items, std::span<const int> order)
+{
+  NodeComponentMap newItems;
+  newItems.reserve(items.size());
+  for (size_t i = 0; i != order.size(); i++)
+    if (items.contains(order[i]))
+      newItems[(uint32_t)i] = items.at(order[i]);
+  items = std::move(newItems);
+}
+
+void permuteSceneNodes(Scene& scene, std::span<const int> order)
 {
-  // 0) Add all the nodes down below in the hierarchy
-  auto indicesToDelete = nodesToDelete;
-  for (uint32_t i : indicesToDelete)
-    collectNodesToDelete(scene, i, indicesToDelete);
-
-  // aux array with node indices to keep track of the moved ones [moved = [](node) { return (node != nodes[node]); ]
-  std::vector<int> nodes(scene.hierarchy.size());
-  std::iota(nodes.begin(), nodes.end(), 0);
-
-  // 1.a) Move all the indicesToDelete to the end of 'nodes' array (and cut them off, a variation of swap'n'pop for multiple elements)
-  const size_t oldSize = nodes.size();
-  eraseSelected(nodes, indicesToDelete);
-
-  // 1.b) Make a newIndices[oldIndex] mapping table
-  std::vector<int> newIndices(oldSize, -1);
-  for (int i = 0; i < nodes.size(); i++)
-    newIndices[nodes[i]] = i;
-
-  // 2) Replace all non-null parent/firstChild/nextSibling pointers in all the nodes by new positions
-  auto nodeMover = [&scene, &newIndices](Hierarchy& h) {
-    return Hierarchy{
-      .parent      = (h.parent != -1) ? newIndices[h.parent] : -1,
-      .firstChild  = findLastNonDeletedItem(scene, newIndices, h.firstChild),
-      .nextSibling = findLastNonDeletedItem(scene, newIndices, h.nextSibling),
-      .lastSibling = findLastNonDeletedItem(scene, newIndices, h.lastSibling),
+  const int numNodes = (int)scene.hierarchy.size();
+
+  assert(order.size() == numNodes);
+
+  std::vector<int> newIndices(numNodes, -1);
+  for (int i = 0; i != numNodes; i++)
+    newIndices[order[i]] = i;
+
+  auto remap = [&newIndices](int n) { return n >= 0 ? newIndices[n] : -1; };
+
+  std::vector<Hierarchy> hierarchy(numNodes);
+  std::vector<AffineTransform> localTransform(numNodes);
+  std::vector<AffineTransform> globalTransform(numNodes);
+
+  for (int i = 0; i != numNodes; i++) {
+    const Hierarchy& h = scene.hierarchy[order[i]];
+    hierarchy[i]       = {
+      .parent      = remap(h.parent),
+      .firstChild  = remap(h.firstChild),
+      .nextSibling = remap(h.nextSibling),
+      .lastSibling = remap(h.lastSibling),
+      .level       = h.level,
     };
+    localTransform[i]  = scene.localTransform[order[i]];
+    globalTransform[i] = scene.globalTransform[order[i]];
+  }
+
+  std::vector<int> changedNodes;
+  for (const std::vector<int>& nodes : scene.changedAtThisFrame)
+    for (int n : nodes)
+      changedNodes.push_back(newIndices[n]);
+
+  scene.hierarchy       = std::move(hierarchy);
+  scene.localTransform  = std::move(localTransform);
+  scene.globalTransform = std::move(globalTransform);
+
+  permuteMap(scene.meshForNode, order);
+  permuteMap(scene.materialForNode, order);
+  permuteMap(scene.nameForNode, order);
+
+  if (scene.hasNameIndex)
+    buildNodeNameIndex(scene);
+
+  clearChangedNodes(scene);
+  scene.changedEpoch.assign(numNodes, 0);
+  markAsChanged(scene, changedNodes);
+}
+
+// 10 bits per axis interleaved into a 30-bit Morton code
+static uint32_t expandBits10(uint32_t v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+std::vector<int> reorderSceneNodes(Scene& scene, std::span<const vec3> positions)
+{
+  const int numNodes = (int)scene.hierarchy.size();
+
+  assert(positions.empty() || positions.size() == numNodes);
+
+  auto getPosition = [&scene, &positions](int n) {
+    const AffineTransform& t = scene.globalTransform[n];
+    return positions.empty() ? vec3(t.rows[0].w, t.rows[1].w, t.rows[2].w) : positions[n];
   };
-  std::transform(scene.hierarchy.begin(), scene.hierarchy.end(), scene.hierarchy.begin(), nodeMover);
 
-  // 3) Finally throw away the hierarchy items
-  eraseSelected(scene.hierarchy, indicesToDelete);
+  vec3 minP(std::numeric_limits<float>::max());
+  vec3 maxP(std::numeric_limits<float>::lowest());
+  for (int i = 0; i != numNodes; i++) {
+    minP = glm::min(minP, getPosition(i));
+    maxP = glm::max(maxP, getPosition(i));
+  }
+  const vec3 size = glm::max(maxP - minP, vec3(1e-6f));
 
-  // 4) As in mergeScenes() routine we also have to adjust all the "components" (i.e., meshes, materials, names and transformations)
+  auto quantize = [](float v, float minV, float size) { return (uint32_t)std::clamp((v - minV) / size * 1023.0f, 0.0f, 1023.0f); };
 
-  // 4a) Transformations are stored in arrays, so we just erase the items as we did with the scene.hierarchy_
-  eraseSelected(scene.localTransform, indicesToDelete);
-  eraseSelected(scene.globalTransform, indicesToDelete);
+  std::vector<uint32_t> morton(numNodes);
+  for (int i = 0; i != numNodes; i++) {
+    const vec3 p = getPosition(i);
+    morton[i]    = (expandBits10(quantize(p.x, minP.x, size.x)) << 2) | (expandBits10(quantize(p.y, minP.y, size.y)) << 1) |
+                expandBits10(quantize(p.z, minP.z, size.z));
+  }
 
-  // 4b) All the maps should change the key values with the newIndices[] array
-  shiftMapIndices(scene.meshForNode, newIndices);
-  shiftMapIndices(scene.materialForNode, newIndices);
-  shiftMapIndices(scene.nameForNode, newIndices);
+  auto byMorton = [&morton](int a, int b) { return morton[a] != morton[b] ? morton[a] < morton[b] : a < b; };
+
+  // the queue of the breadth-first walk is the new order
+  std::vector<int> order;
+  order.reserve(numNodes);
+
+  for (int i = 0; i != numNodes; i++)
+    if (scene.hierarchy[i].parent == -1)
+      order.push_back(i);
+  std::sort(order.begin(), order.end(), byMorton);
+
+  for (size_t i = 0; i != order.size(); i++) {
+    const size_t firstChild = order.size();
+    for (int c = scene.hierarchy[order[i]].firstChild; c != -1; c = scene.hierarchy[c].nextSibling)
+      order.push_back(c);
+    std::sort(order.begin() + firstChild, order.end(), byMorton);
+  }
+
+  assert(order.size() == numNodes);
+
+  permuteSceneNodes(scene, order);
+
+  // the sibling lists follow the new order, so walking the hierarchy (e.g. markAsChanged()) visits the nodes in index order
+  std::vector<int> lastChild(numNodes, -1);
+  int lastRoot = -1;
+  for (Hierarchy& h : scene.hierarchy)
+    h.firstChild = h.nextSibling = h.lastSibling = -1;
+  for (int i = 0; i != numNodes; i++) {
+    const int p = scene.hierarchy[i].parent;
+    int& last   = p >= 0 ? lastChild[p] : lastRoot;
+    if (last != -1)
+      scene.hierarchy[last].nextSibling = i;
+    else if (p >= 0)
+      scene.hierarchy[p].firstChild = i;
+    last = i;
+  }
+  // as in addNode(), the first child caches the last one
+  for (int i = 0; i != numNodes; i++)
+    if (scene.hierarchy[i].firstChild != -1)
+      scene.hierarchy[scene.hierarchy[i].firstChild].lastSibling = lastChild[i];
+
+  std::vector<int> newIndices(numNodes);
+  for (int i = 0; i != numNodes; i++)
+    newIndices[order[i]] = i;
 
-  // 5) scene node names list is not modified, but in principle it can be (remove all non-used items and adjust the nameForNode_ map)
-  // 6) Material names list is not modified also, but if some materials fell out of use
+  return newIndices;
 }
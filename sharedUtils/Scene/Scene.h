@@ -1,14 +1,27 @@
 ﻿#pragma once
 
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "shared/UtilsMath.h"
+
 using glm::mat4;
 
+namespace tf {
+class Executor;
+}
+
 // we do not define std::vector<Node*> Children - this is already present in the aiNode from assimp
 
 constexpr const int MAX_NODE_LEVEL = 16;
@@ -26,42 +39,120 @@ struct Hierarchy {
   int level = 0;
 };
 
+// Node -> value component storage (a sparse set). The (node, value) pairs are packed in insertion order, so iterating is a linear
+// walk with the same order on every run, and lookups go through a node-indexed table. Keys must not be modified while iterating
+class NodeComponentMap
+{
+public:
+  using value_type     = std::pair<uint32_t, uint32_t>;
+  using iterator       = std::vector<value_type>::iterator;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  static constexpr uint32_t kInvalid = 0xFFFFFFFF;
+
+  bool contains(uint32_t node) const { return node < sparse_.size() && sparse_[node] != kInvalid; }
+  uint32_t at(uint32_t node) const
+  {
+    assert(contains(node));
+    return dense_[sparse_[node]].second;
+  }
+  // inserts 0 if the node has no value yet
+  uint32_t& operator[](uint32_t node)
+  {
+    if (node >= sparse_.size())
+      sparse_.resize(node + 1, kInvalid);
+    if (sparse_[node] == kInvalid) {
+      sparse_[node] = (uint32_t)dense_.size();
+      dense_.push_back({ node, 0 });
+    }
+    return dense_[sparse_[node]].second;
+  }
+  const_iterator find(uint32_t node) const { return contains(node) ? dense_.begin() + sparse_[node] : dense_.end(); }
+  iterator find(uint32_t node) { return contains(node) ? dense_.begin() + sparse_[node] : dense_.end(); }
+  // moves the last pair into the hole
+  void erase(uint32_t node)
+  {
+    if (!contains(node))
+      return;
+    const uint32_t idx = sparse_[node];
+    dense_[idx]                = dense_.back();
+    sparse_[dense_[idx].first] = idx;
+    sparse_[node]              = kInvalid;
+    dense_.pop_back();
+  }
+  void reserve(size_t size) { dense_.reserve(size); }
+  void clear()
+  {
+    dense_.clear();
+    sparse_.clear();
+  }
+  size_t size() const { return dense_.size(); }
+  bool empty() const { return dense_.empty(); }
+
+  iterator begin() { return dense_.begin(); }
+  iterator end() { return dense_.end(); }
+  const_iterator begin() const { return dense_.begin(); }
+  const_iterator end() const { return dense_.end(); }
+
+private:
+  std::vector<value_type> dense_;
+  std::vector<uint32_t> sparse_; // indexed by node, an index into dense_ or kInvalid
+};
+
 /* This scene is converted into a descriptorSet(s) in MultiRenderer class 
    This structure is also used as a storage type in SceneExporter tool
  */
 struct Scene {
   // local transformations for each node and global transforms
   // + an array of 'dirty/changed' local transforms
-  std::vector<mat4> localTransform;  // indexed by node
-  std::vector<mat4> globalTransform; // indexed by node
+  std::vector<AffineTransform> localTransform;  // indexed by node
+  std::vector<AffineTransform> globalTransform; // indexed by node
 
   // list of nodes that need their global transforms recalculated
   std::vector<int> changedAtThisFrame[MAX_NODE_LEVEL];
+  // a node is in changedAtThisFrame[] if changedEpoch[node] == currentChangedEpoch; the epoch advances in clearChangedNodes()
+  std::vector<uint32_t> changedEpoch; // indexed by node, grows on demand
+  uint32_t currentChangedEpoch = 1;
 
   // Hierarchy component
   std::vector<Hierarchy> hierarchy;
 
   // Mesh component: which Mesh belongs to which node (Node -> Mesh)
-  std::unordered_map<uint32_t, uint32_t> meshForNode;
+  NodeComponentMap meshForNode;
 
   // Material component: which material belongs to which node (Node -> Material)
-  std::unordered_map<uint32_t, uint32_t> materialForNode;
+  NodeComponentMap materialForNode;
 
   // Node name component: which name is assigned to the node (Node -> Name)
-  std::unordered_map<uint32_t, uint32_t> nameForNode;
+  NodeComponentMap nameForNode;
 
   // List of scene node names
   std::vector<std::string> nodeNames;
 
+  // Optional name -> nodes index (in ascending order, names are not unique), see buildNodeNameIndex(). Kept up to date by
+  // setNodeName(), mergeScenes() and deleteSceneNodes(); the names are sorted, so a prefix query is a range of the map
+  bool hasNameIndex = false;
+  std::map<std::string, std::vector<int>, std::less<>> nodesForName;
+
   // Debug list of material names
   std::vector<std::string> materialNames;
 };
 
 int addNode(Scene& scene, int parent, int level);
 
+// queues the node and its subtree for recalculateGlobalTransforms(), every node at most once until clearChangedNodes()
 void markAsChanged(Scene& scene, int node);
+void markAsChanged(Scene& scene, std::span<const int> nodes);
+// empties changedAtThisFrame[] and starts a new epoch, called by the consumers of the lists
+void clearChangedNodes(Scene& scene);
 
+// the node with the smallest index if several nodes share the name, -1 if there is none
 int findNodeByName(const Scene& scene, const std::string& name);
+// the same for a batch of names: a lookup per name with the name index, otherwise a single pass over the nodes
+std::vector<int> findNodesByName(const Scene& scene, std::span<const std::string_view> names);
+// all the nodes whose names start with 'prefix', in ascending order
+std::vector<int> findNodesByNamePrefix(const Scene& scene, std::string_view prefix);
+void buildNodeNameIndex(Scene& scene);
 
 inline std::string getNodeName(const Scene& scene, int node)
 {
@@ -69,19 +160,24 @@ inline std::string getNodeName(const Scene& scene, int node)
   return (strID > -1) ? scene.nodeNames[strID] : std::string();
 }
 
-inline void setNodeName(Scene& scene, int node, const std::string& name)
-{
-  uint32_t stringID = (uint32_t)scene.nodeNames.size();
-  scene.nodeNames.push_back(name);
-  scene.nameForNode[node] = stringID;
-}
+void setNodeName(Scene& scene, int node, const std::string& name);
 
 int getNodeLevel(const Scene& scene, int n);
 
 bool recalculateGlobalTransforms(Scene& scene);
+// Same result as recalculateGlobalTransforms(): the levels are processed in order, the nodes of one level in parallel.
+// useSIMD selects an SSE affine multiplication kernel where available
+bool recalculateGlobalTransformsParallel(Scene& scene, tf::Executor& executor, bool useSIMD = true);
+
+// .scene files start with kSceneMagic followed by the node count; the transforms are stored as AffineTransform
+constexpr uint32_t kSceneMagic = 0x334E4353; // 'SCN3'
 
 void loadScene(const char* fileName, Scene& scene);
 void saveScene(const char* fileName, const Scene& scene);
+// read/write a scene at the current file position (used to embed scenes into other files)
+// the optional names block is read only if it starts before 'endOffset'
+void loadScene(FILE* f, Scene& scene, int64_t endOffset);
+void saveScene(FILE* f, const Scene& scene);
 
 void dumpTransforms(const char* fileName, const Scene& scene);
 void printChangedNodes(const Scene& scene);
@@ -91,5 +187,46 @@ void dumpSceneToDot(const char* fileName, const Scene& scene, int* visited = nul
 void mergeScenes(Scene& scene, const std::vector<Scene*>& scenes, const std::vector<glm::mat4>& rootTransforms, const std::vector<uint32_t>& meshCounts,
 		bool mergeMeshes = true, bool mergeMaterials = true);
 
-// Delete a collection of nodes from a scenegraph
+// A batch of structural changes applied at once by applySceneEdit() in O(number of nodes). Node indices refer to the scene
+// before the edit; the added nodes are numbered after the existing ones in the order of addNode() and can be used as parents
+struct SceneEdit {
+  explicit SceneEdit(const Scene& scene)
+  : firstNewNode((int)scene.hierarchy.size())
+  {
+  }
+
+  int addNode(int parent, const mat4& localTransform = mat4(1.0f))
+  {
+    newNodeParents.push_back(parent);
+    newNodeTransforms.push_back(localTransform);
+    return firstNewNode + (int)newNodeParents.size() - 1;
+  }
+  // removes the entire subtree
+  void removeNode(int node) { removedNodes.push_back(node); }
+  // the node is appended to the children of newParent (-1 makes it a root), the last call for a node wins
+  void reparentNode(int node, int newParent) { reparentedNodes.push_back({ node, newParent }); }
+
+  int firstNewNode = 0;
+  std::vector<int> newNodeParents;
+  std::vector<AffineTransform> newNodeTransforms;
+  std::vector<int> removedNodes;
+  std::vector<std::pair<int, int>> reparentedNodes; // (node, new parent)
+};
+
+// Returns the old-to-new node index table (-1 for the removed nodes), covering the added nodes as well. The surviving nodes
+// keep their relative order; levels, sibling links and lastSibling are rebuilt, and the moved and added subtrees are marked as changed.
+// An edit with invalid node indices, a cycle (a node reparented into its own subtree) or a surviving node at MAX_NODE_LEVEL or
+// deeper is rejected: the scene is left untouched and an empty table is returned
+std::vector<int> applySceneEdit(Scene& scene, const SceneEdit& edit);
+
+// Delete a collection of nodes (with their subtrees) from a scenegraph
 void deleteSceneNodes(Scene& scene, const std::vector<uint32_t>& nodesToDelete);
+
+// Renumbers the nodes: order[newIndex] = oldIndex. Links, transforms and components are remapped, the component maps are
+// iterated in the new node order afterwards (VKMesh11 creates its draw commands in this order)
+void permuteSceneNodes(Scene& scene, std::span<const int> order);
+
+// Breadth-first order: every level is contiguous, the children of a node are contiguous and follow the order of their parents,
+// siblings are sorted along a Morton curve over 'positions' (indexed by node; the translations of the global transforms if empty).
+// The sibling lists are rebuilt in the new order. Returns the old-to-new node index table
+std::vector<int> reorderSceneNodes(Scene& scene, std::span<const vec3> positions = {});
@@ -1,9 +1,18 @@
 #include "shared/Scene/VtxData.h"
+#include "shared/Scene/Scene.h"
+#include "shared/UtilsFile.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 
+#include <glm/gtc/packing.hpp>
+#include <meshoptimizer.h>
+
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+
 bool isMeshDataValid(const char* fileName)
 {
   FILE* f = fopen(fileName, "rb");
@@ -21,19 +30,15 @@ bool isMeshDataValid(const char* fileName)
   if (fread(&header, 1, sizeof(header), f) != sizeof(header))
     return false;
 
-  if (fseek(f, sizeof(Mesh) * header.meshCount, SEEK_CUR))
-    return false;
-
-  if (fseek(f, sizeof(BoundingBox) * header.meshCount, SEEK_CUR))
+  if (header.magicValue != MeshFileHeader().magicValue)
     return false;
 
-  if (fseek(f, header.indexDataSize, SEEK_CUR))
-    return false;
-
-  if (fseek(f, header.vertexDataSize, SEEK_CUR))
-    return false;
+  // seeking past the end of a file always succeeds, so compare the expected size with the actual one instead
+  const int64_t expectedSize = int64_t(sizeof(header)) + sizeof(lvk::VertexInput) +
+                               int64_t(header.meshCount) * (sizeof(Mesh) + sizeof(BoundingBox)) + header.indexDataSize +
+                               header.vertexDataSize;
 
-  return true;
+  return getFileSize64(f) == expectedSize;
 }
 
 bool isMeshHierarchyValid(const char* fileName)
@@ -48,7 +53,20 @@ bool isMeshHierarchyValid(const char* fileName)
     fclose(f);
   };
 
-  return true;
+  uint32_t magic    = 0;
+  uint32_t numNodes = 0;
+
+  if (fread(&magic, 1, sizeof(magic), f) != sizeof(magic) || magic != kSceneMagic)
+    return false;
+
+  if (fread(&numNodes, 1, sizeof(numNodes), f) != sizeof(numNodes))
+    return false;
+
+  // transforms and hierarchy, followed by at least two (possibly empty) component maps
+  const int64_t minSize = int64_t(sizeof(magic) + sizeof(numNodes)) + int64_t(numNodes) * (2 * sizeof(AffineTransform) + sizeof(Hierarchy)) +
+                          2 * sizeof(uint32_t);
+
+  return getFileSize64(f) >= minSize;
 }
 
 bool isMeshMaterialsValid(const char* fileName)
@@ -138,16 +156,92 @@ MeshFileHeader loadMeshData(const char* meshFile, MeshData& out)
   return header;
 }
 
-void loadMeshDataMaterials(const char* fileName, MeshData& out)
+MeshFileHeader loadMeshDataMapped(const char* meshFile, MeshData& out)
 {
-  FILE* f = fopen(fileName, "rb");
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(meshFile);
 
-  if (!f) {
-    printf("Cannot open '%s'.\n", fileName);
+  if (!file->valid()) {
+    printf("Cannot map '%s'.\n", meshFile);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t offset = 0;
+
+  // returns a pointer to the next 'size' bytes of the mapped file
+  auto take = [&file, &offset](size_t size) -> const uint8_t* {
+    if (size > file->size() - offset)
+      return nullptr;
+    const uint8_t* ptr = file->data() + offset;
+    offset += size;
+    return ptr;
+  };
+
+  MeshFileHeader header;
+
+  const uint8_t* ptr = take(sizeof(header));
+  if (!ptr) {
+    printf("Unable to read mesh file header.\n");
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(&header, ptr, sizeof(header));
+
+  ptr = take(sizeof(out.streams));
+  if (!ptr) {
+    printf("Unable to read vertex streams description.\n");
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(&out.streams, ptr, sizeof(out.streams));
+
+  // mesh descriptors and bounding boxes are small and get modified later, so copy them
+  ptr = take(sizeof(Mesh) * header.meshCount);
+  if (!ptr) {
+    printf("Could not read mesh descriptors.\n");
     assert(false);
     exit(EXIT_FAILURE);
   }
+  out.meshes.resize(header.meshCount);
+  memcpy(out.meshes.data(), ptr, sizeof(Mesh) * header.meshCount);
+
+  ptr = take(sizeof(BoundingBox) * header.meshCount);
+  if (!ptr) {
+    printf("Could not read bounding boxes.\n");
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+  out.boxes.resize(header.meshCount);
+  memcpy(out.boxes.data(), ptr, sizeof(BoundingBox) * header.meshCount);
 
+  const uint8_t* indices = take(header.indexDataSize);
+  if (!indices) {
+    printf("Unable to read index data.\n");
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  const uint8_t* vertices = take(header.vertexDataSize);
+  if (!vertices) {
+    printf("Unable to read vertex data.\n");
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  // the mapping is page-aligned and all the preceding blocks are multiples of 4 bytes
+  LVK_ASSERT(reinterpret_cast<uintptr_t>(indices) % alignof(uint32_t) == 0);
+
+  out.indexData.clear();
+  out.vertexData.clear();
+  out.mappedIndexData  = std::span<const uint32_t>(reinterpret_cast<const uint32_t*>(indices), header.indexDataSize / sizeof(uint32_t));
+  out.mappedVertexData = std::span<const uint8_t>(vertices, header.vertexDataSize);
+  out.mappedFile       = std::move(file);
+
+  return header;
+}
+
+void loadMeshDataMaterials(FILE* f, MeshData& out)
+{
   uint64_t numMaterials  = 0;
   uint64_t materialsSize = 0;
 
@@ -163,7 +257,7 @@ void loadMeshDataMaterials(const char* fileName, MeshData& out)
   }
 
   if (numMaterials * sizeof(Material) != materialsSize) {
-    printf("Corrupted material file '%s'.\n", fileName);
+    printf("Corrupted material data.\n");
     assert(false);
     exit(EXIT_FAILURE);
   }
@@ -176,6 +270,19 @@ void loadMeshDataMaterials(const char* fileName, MeshData& out)
   }
 
   loadStringList(f, out.textureFiles);
+}
+
+void loadMeshDataMaterials(const char* fileName, MeshData& out)
+{
+  FILE* f = fopen(fileName, "rb");
+
+  if (!f) {
+    printf("Cannot open '%s'.\n", fileName);
+    assert(false);
+    exit(EXIT_FAILURE);
+  }
+
+  loadMeshDataMaterials(f, out);
 
   fclose(f);
 }
@@ -192,8 +299,8 @@ void saveMeshData(const char* fileName, const MeshData& m)
 
   const MeshFileHeader header = {
     .meshCount      = (uint32_t)m.meshes.size(),
-    .indexDataSize  = (uint32_t)(m.indexData.size() * sizeof(uint32_t)),
-    .vertexDataSize = (uint32_t)(m.vertexData.size()),
+    .indexDataSize  = m.indexData.size() * sizeof(uint32_t),
+    .vertexDataSize = m.vertexData.size(),
   };
 
   fwrite(&header, 1, sizeof(header), f);
@@ -206,6 +313,18 @@ void saveMeshData(const char* fileName, const MeshData& m)
   fclose(f);
 }
 
+void saveMeshDataMaterials(FILE* f, const MeshData& m)
+{
+  const uint64_t numMaterials  = m.materials.size();
+  const uint64_t materialsSize = m.materials.size() * sizeof(Material);
+
+  fwrite(&numMaterials, 1, sizeof(numMaterials), f);
+  fwrite(&materialsSize, 1, sizeof(materialsSize), f);
+  fwrite(m.materials.data(), sizeof(Material), numMaterials, f);
+
+  saveStringList(f, m.textureFiles);
+}
+
 void saveMeshDataMaterials(const char* fileName, const MeshData& m)
 {
   FILE* f = fopen(fileName, "wb");
@@ -216,14 +335,7 @@ void saveMeshDataMaterials(const char* fileName, const MeshData& m)
     exit(EXIT_FAILURE);
   }
 
-  const uint64_t numMaterials  = m.materials.size();
-  const uint64_t materialsSize = m.materials.size() * sizeof(Material);
-
-  fwrite(&numMaterials, 1, sizeof(numMaterials), f);
-  fwrite(&materialsSize, 1, sizeof(materialsSize), f);
-  fwrite(m.materials.data(), sizeof(Material), numMaterials, f);
-
-  saveStringList(f, m.textureFiles);
+  saveMeshDataMaterials(f, m);
 
   fclose(f);
 }
@@ -268,8 +380,8 @@ void loadBoundingBoxes(const char* fileName, std::vector<BoundingBox>& boxes)
 // combine a collection of meshes into a single MeshData container
 MeshFileHeader mergeMeshData(MeshData& m, const std::vector<MeshData*> md)
 {
-  uint32_t numTotalVertices = 0;
-  uint32_t numTotalIndices  = 0;
+  uint64_t numTotalVertices = 0;
+  uint64_t numTotalIndices  = 0;
 
   if (!md.empty()) {
     m.streams = md[0]->streams;
@@ -289,28 +401,24 @@ MeshFileHeader mergeMeshData(MeshData& m, const std::vector<MeshData*> md)
 
     for (size_t j = 0; j != i->meshes.size(); j++) {
       // m.vertexCount, m.lodCount and m.streamCount do not change
-      // m.vertexOffset also does not change, because vertex offsets are local (i.e., baked into the indices)
+      // individual indices are not shifted: 32-bit indices cannot address more than 2^32 vertices,
+      // so the 64-bit vertex offset of each mesh is shifted instead
       m.meshes[offset + j].indexOffset += numTotalIndices;
+      m.meshes[offset + j].vertexOffset += numTotalVertices;
       m.meshes[offset + j].materialID += mtlOffset;
     }
 
-    // shift individual indices
-    for (size_t j = 0; j != i->indexData.size(); j++) {
-      m.indexData[numTotalIndices + j] += numTotalVertices;
-    }
-
     offset += (uint32_t)i->meshes.size();
     mtlOffset += (uint32_t)i->materials.size();
 
-    numTotalIndices += (uint32_t)i->indexData.size();
-    numTotalVertices += (uint32_t)i->vertexData.size() / vertexSize;
+    numTotalIndices += i->indexData.size();
+    numTotalVertices += i->vertexData.size() / vertexSize;
   }
 
   return MeshFileHeader{
-    .magicValue     = 0x12345678,
-    .meshCount      = (uint32_t)offset,
-    .indexDataSize  = static_cast<uint32_t>(numTotalIndices * sizeof(uint32_t)),
-    .vertexDataSize = static_cast<uint32_t>(m.vertexData.size()),
+    .meshCount      = offset,
+    .indexDataSize  = numTotalIndices * sizeof(uint32_t),
+    .vertexDataSize = m.vertexData.size(),
   };
 }
 
@@ -320,23 +428,440 @@ void recalculateBoundingBoxes(MeshData& m)
 
   const uint32_t stride = m.streams.getVertexSize();
 
-  m.boxes.clear();
-  m.boxes.reserve(m.meshes.size());
+  const std::span<const uint32_t> indexData = m.getIndexData();
+  const std::span<const uint8_t> vertexData = m.getVertexData();
 
-  for (const Mesh& mesh : m.meshes) {
+  m.boxes.resize(m.meshes.size());
+
+  // the meshes are independent, one task per mesh
+  tf::Executor executor;
+  tf::Taskflow taskflow;
+
+  taskflow.for_each_index(size_t(0), m.meshes.size(), size_t(1), [&](size_t meshId) {
+    const Mesh& mesh          = m.meshes[meshId];
     const uint32_t numIndices = mesh.getLODIndicesCount(0);
 
     glm::vec3 vmin(std::numeric_limits<float>::max());
     glm::vec3 vmax(std::numeric_limits<float>::lowest());
 
     for (uint32_t i = 0; i != numIndices; i++) {
-      const uint32_t vtxOffset = m.indexData[mesh.indexOffset + i] + mesh.vertexOffset;
-      const float* vf          = (const float*)&m.vertexData[vtxOffset * stride];
+      const uint64_t vtxOffset = indexData[mesh.indexOffset + i] + mesh.vertexOffset;
+      const float* vf          = (const float*)&vertexData[vtxOffset * stride];
 
       vmin = glm::min(vmin, vec3(vf[0], vf[1], vf[2]));
       vmax = glm::max(vmax, vec3(vf[0], vf[1], vf[2]));
     }
 
-    m.boxes.emplace_back(vmin, vmax);
+    m.boxes[meshId] = BoundingBox(vmin, vmax);
+  });
+
+  executor.run(taskflow).wait();
+}
+
+// meshlets reference the index and vertex order, so any pass changing it invalidates them
+static void clearMeshlets(MeshData& m)
+{
+  m.meshletRanges.clear();
+  m.meshlets.clear();
+  m.meshletVertices.clear();
+  m.meshletTriangles.clear();
+}
+
+uint32_t generateLODs(MeshData& m, uint32_t maxLODs)
+{
+  LVK_ASSERT(m.streams.attributes[0].format == lvk::VertexFormat::Float3);
+
+  // meshes below this size are not worth the extra draw-time bookkeeping
+  const size_t kMinLODIndices = 3 * 64;
+  // the simplifier made no real progress towards the target
+  const double kMinReduction = 0.9;
+
+  maxLODs = std::min(maxLODs, kMaxLODs);
+
+  const uint32_t stride = m.streams.getVertexSize();
+
+  const std::span<const uint32_t> indexData = m.getIndexData();
+  const std::span<const uint8_t> vertexData = m.getVertexData();
+
+  const uint64_t numVertices = vertexData.size() / stride;
+
+  std::vector<uint32_t> newIndexData;
+  newIndexData.reserve(indexData.size() * 2);
+
+  uint32_t numMeshesWithLODs = 0;
+  uint32_t numSloppy         = 0;
+  uint32_t numRejected       = 0;
+
+  for (uint32_t meshId = 0; meshId != m.meshes.size(); meshId++) {
+    Mesh& mesh = m.meshes[meshId];
+
+    const uint64_t newIndexOffset = newIndexData.size();
+
+    // meshes which already have LODs are copied as they are
+    newIndexData.insert(
+        newIndexData.end(), indexData.begin() + mesh.indexOffset, indexData.begin() + mesh.indexOffset + mesh.lodOffset[mesh.lodCount]);
+    mesh.indexOffset = newIndexOffset;
+
+    if (mesh.lodCount != 1 || mesh.getLODIndicesCount(0) < 2 * kMinLODIndices)
+      continue;
+
+    const std::span<const uint32_t> lod0(newIndexData.data() + newIndexOffset, mesh.getLODIndicesCount(0));
+
+    // merged meshes do not keep vertexCount up to date
+    const uint32_t vertexCount = *std::max_element(lod0.begin(), lod0.end()) + 1;
+
+    bool valid = mesh.vertexOffset + vertexCount <= numVertices;
+
+    for (uint32_t i = 0; valid && i != vertexCount; i++) {
+      const float* v = reinterpret_cast<const float*>(&vertexData[(mesh.vertexOffset + i) * stride]);
+      valid          = std::isfinite(v[0]) && std::isfinite(v[1]) && std::isfinite(v[2]);
+    }
+
+    if (!valid) {
+      numRejected++;
+      continue;
+    }
+
+    const float* positions = reinterpret_cast<const float*>(&vertexData[mesh.vertexOffset * stride]);
+
+    std::vector<uint32_t> lod(lod0.begin(), lod0.end());
+    std::vector<uint32_t> next(lod.size());
+
+    bool sloppy = false;
+
+    while (mesh.lodCount < maxLODs) {
+      const size_t target = lod.size() / 6 * 3;
+
+      if (target < kMinLODIndices)
+        break;
+
+      size_t numIndices = meshopt_simplify(next.data(), lod.data(), lod.size(), positions, vertexCount, stride, target, 0.02f, 0, nullptr);
+
+      // topological simplification gets stuck on meshes made of many disconnected pieces (foliage cards, decals)
+      if (numIndices > lod.size() * kMinReduction) {
+        numIndices = meshopt_simplifySloppy(next.data(), lod.data(), lod.size(), positions, vertexCount, stride, target, 0.05f, nullptr);
+        sloppy     = true;
+      }
+
+      if (!numIndices || numIndices > lod.size() * kMinReduction)
+        break;
+
+      newIndexData.insert(newIndexData.end(), next.begin(), next.begin() + numIndices);
+
+      LVK_ASSERT(newIndexData.size() - newIndexOffset <= std::numeric_limits<uint32_t>::max());
+
+      mesh.lodOffset[mesh.lodCount + 1] = (uint32_t)(newIndexData.size() - newIndexOffset);
+      mesh.lodCount++;
+
+      lod.assign(next.begin(), next.begin() + numIndices);
+    }
+
+    if (mesh.lodCount > 1) {
+      numMeshesWithLODs++;
+      numSloppy += sloppy ? 1 : 0;
+    }
+  }
+
+  printf(
+      "Generated LODs for %u of %u meshes (%u with sloppy simplification, %u rejected), indices: %llu -> %llu\n", numMeshesWithLODs,
+      (uint32_t)m.meshes.size(), numSloppy, numRejected, (unsigned long long)indexData.size(), (unsigned long long)newIndexData.size());
+
+  clearMeshlets(m);
+
+  m.indexData = std::move(newIndexData);
+  // the indices are owned by MeshData now, the vertices are copied as well so that the data does not outlive the mapping
+  if (m.mappedFile) {
+    m.vertexData.assign(vertexData.begin(), vertexData.end());
+    m.releaseMappedData();
+  }
+
+  return numMeshesWithLODs;
+}
+
+void optimizeMeshes(MeshData& m, bool optimizeOverdraw)
+{
+  LVK_ASSERT(!optimizeOverdraw || m.streams.attributes[0].format == lvk::VertexFormat::Float3);
+
+  // typical post-transform cache size used by meshoptimizer's analyzers
+  const uint32_t kCacheSize = 16;
+  // allow up to 5% worse vertex cache efficiency in exchange for less overdraw
+  const float kOverdrawThreshold = 1.05f;
+
+  const uint32_t stride = m.streams.getVertexSize();
+
+  const std::span<const uint32_t> indexData = m.getIndexData();
+  const std::span<const uint8_t> vertexData = m.getVertexData();
+
+  std::vector<uint32_t> newIndexData(indexData.begin(), indexData.end());
+  std::vector<uint8_t> newVertexData;
+  newVertexData.reserve(vertexData.size());
+
+  const uint64_t numVerticesBefore = vertexData.size() / stride;
+
+  uint64_t numTriangles      = 0;
+  uint64_t numVertices       = 0;
+  uint64_t transformedBefore = 0;
+  uint64_t transformedAfter  = 0;
+
+  std::vector<uint32_t> remap;
+
+  for (Mesh& mesh : m.meshes) {
+    uint32_t* indices       = newIndexData.data() + mesh.indexOffset;
+    const uint32_t numLOD0  = mesh.getLODIndicesCount(0);
+    const uint32_t numTotal = mesh.lodOffset[mesh.lodCount];
+
+    const uint64_t newVertexOffset = newVertexData.size() / stride;
+
+    if (!numTotal) {
+      mesh.vertexOffset = newVertexOffset;
+      mesh.vertexCount  = 0;
+      continue;
+    }
+
+    // merged meshes do not keep vertexCount up to date
+    const uint32_t vertexCount = *std::max_element(indices, indices + numTotal) + 1;
+
+    if (mesh.vertexOffset + vertexCount > numVerticesBefore) {
+      printf("optimizeMeshes(): mesh references vertices beyond the end of the vertex data\n");
+      assert(false);
+      exit(EXIT_FAILURE);
+    }
+
+    const uint8_t* vertices = vertexData.data() + mesh.vertexOffset * stride;
+
+    transformedBefore += meshopt_analyzeVertexCache(indices, numLOD0, vertexCount, kCacheSize, 0, 0).vertices_transformed;
+
+    for (uint32_t lod = 0; lod != mesh.lodCount; lod++) {
+      uint32_t* lodIndices = indices + mesh.lodOffset[lod];
+      meshopt_optimizeVertexCache(lodIndices, lodIndices, mesh.getLODIndicesCount(lod), vertexCount);
+    }
+
+    if (optimizeOverdraw) {
+      meshopt_optimizeOverdraw(
+          indices, indices, numLOD0, reinterpret_cast<const float*>(vertices), vertexCount, stride, kOverdrawThreshold);
+    }
+
+    // LOD 0 comes first in the index data, so its order defines the vertex order
+    remap.resize(vertexCount);
+    const uint32_t numUnique = (uint32_t)meshopt_optimizeVertexFetchRemap(remap.data(), indices, numTotal, vertexCount);
+
+    meshopt_remapIndexBuffer(indices, indices, numTotal, remap.data());
+
+    newVertexData.resize(newVertexData.size() + (size_t)numUnique * stride);
+    meshopt_remapVertexBuffer(newVertexData.data() + newVertexOffset * stride, vertices, vertexCount, stride, remap.data());
+
+    mesh.vertexOffset = newVertexOffset;
+    mesh.vertexCount  = numUnique;
+
+    transformedAfter += meshopt_analyzeVertexCache(indices, numLOD0, numUnique, kCacheSize, 0, 0).vertices_transformed;
+    numTriangles += numLOD0 / 3;
+    numVertices += numUnique;
   }
+
+  const double triangles = (double)std::max(numTriangles, uint64_t(1));
+  const double vertices  = (double)std::max(numVertices, uint64_t(1));
+
+  printf(
+      "Optimized %u meshes: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, vertices %llu -> %llu\n", (uint32_t)m.meshes.size(),
+      transformedBefore / triangles, transformedAfter / triangles, transformedBefore / vertices, transformedAfter / vertices,
+      (unsigned long long)numVerticesBefore, (unsigned long long)numVertices);
+
+  clearMeshlets(m);
+
+  m.indexData  = std::move(newIndexData);
+  m.vertexData = std::move(newVertexData);
+  m.releaseMappedData();
+}
+
+void buildMeshlets(MeshData& m)
+{
+  LVK_ASSERT(m.streams.attributes[0].format == lvk::VertexFormat::Float3);
+
+  // prefer meshlets with coherent normals, which makes cone culling more effective
+  const float kConeWeight = 0.25f;
+
+  clearMeshlets(m);
+
+  const uint32_t stride = m.streams.getVertexSize();
+
+  const std::span<const uint32_t> indexData = m.getIndexData();
+  const std::span<const uint8_t> vertexData = m.getVertexData();
+
+  m.meshletRanges.reserve(m.meshes.size());
+
+  std::vector<meshopt_Meshlet> meshlets;
+
+  uint64_t numTriangles = 0;
+
+  for (const Mesh& mesh : m.meshes) {
+    const uint32_t* indices   = indexData.data() + mesh.indexOffset;
+    const uint32_t numIndices = mesh.getLODIndicesCount(0);
+
+    m.meshletRanges.push_back({ .firstMeshlet = (uint32_t)m.meshlets.size() });
+
+    if (!numIndices)
+      continue;
+
+    numTriangles += numIndices / 3;
+
+    const uint32_t vertexCount = *std::max_element(indices, indices + numIndices) + 1;
+    const float* positions     = reinterpret_cast<const float*>(vertexData.data() + mesh.vertexOffset * stride);
+
+    const size_t maxMeshlets = meshopt_buildMeshletsBound(numIndices, kMaxMeshletVertices, kMaxMeshletTriangles);
+
+    meshlets.resize(maxMeshlets);
+
+    const size_t vertexOffset   = m.meshletVertices.size();
+    const size_t triangleOffset = m.meshletTriangles.size();
+
+    m.meshletVertices.resize(vertexOffset + maxMeshlets * kMaxMeshletVertices);
+    m.meshletTriangles.resize(triangleOffset + maxMeshlets * kMaxMeshletTriangles * 3);
+
+    const size_t numMeshlets = meshopt_buildMeshlets(
+        meshlets.data(), m.meshletVertices.data() + vertexOffset, m.meshletTriangles.data() + triangleOffset, indices, numIndices,
+        positions, vertexCount, stride, kMaxMeshletVertices, kMaxMeshletTriangles, kConeWeight);
+
+    // trim the output to the last meshlet
+    const meshopt_Meshlet& last = meshlets[numMeshlets - 1];
+    m.meshletVertices.resize(vertexOffset + last.vertex_offset + last.vertex_count);
+    m.meshletTriangles.resize(triangleOffset + last.triangle_offset + last.triangle_count * 3);
+
+    for (size_t i = 0; i != numMeshlets; i++) {
+      const meshopt_Meshlet& ml = meshlets[i];
+
+      const meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+          m.meshletVertices.data() + vertexOffset + ml.vertex_offset, m.meshletTriangles.data() + triangleOffset + ml.triangle_offset,
+          ml.triangle_count, positions, vertexCount, stride);
+
+      LVK_ASSERT(vertexOffset + ml.vertex_offset <= std::numeric_limits<uint32_t>::max());
+      LVK_ASSERT(triangleOffset + ml.triangle_offset <= std::numeric_limits<uint32_t>::max());
+
+      m.meshlets.push_back({
+          .vertexOffset   = (uint32_t)(vertexOffset + ml.vertex_offset),
+          .triangleOffset = (uint32_t)(triangleOffset + ml.triangle_offset),
+          .vertexCount    = ml.vertex_count,
+          .triangleCount  = ml.triangle_count,
+          .center         = { bounds.center[0], bounds.center[1], bounds.center[2] },
+          .radius         = bounds.radius,
+          .coneAxis       = { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2] },
+          .coneCutoff     = bounds.cone_cutoff,
+      });
+    }
+
+    m.meshletRanges.back().numMeshlets = (uint32_t)numMeshlets;
+  }
+
+  // the GPU reads the triangles as 32-bit words
+  m.meshletTriangles.resize((m.meshletTriangles.size() + 3) & ~size_t(3));
+
+  printf(
+      "Built %u meshlets: %.2f vertices and %.2f triangles per meshlet on average\n", (uint32_t)m.meshlets.size(),
+      double(m.meshletVertices.size()) / std::max(m.meshlets.size(), size_t(1)),
+      double(numTriangles) / std::max(m.meshlets.size(), size_t(1)));
+}
+
+static lvk::VertexInput getQuantizedVertexInput()
+{
+  return {
+    .attributes    = { { .location = 0, .format = lvk::VertexFormat::UShort4Norm, .offset = 0 },
+                       { .location = 1, .format = lvk::VertexFormat::HalfFloat2, .offset = sizeof(uint16_t) * 4 },
+                       { .location = 2, .format = lvk::VertexFormat::Short2Norm, .offset = sizeof(uint16_t) * 6 } },
+    .inputBindings = { { .stride = sizeof(uint16_t) * 8 } },
+  };
+}
+
+bool isVertexFormatQuantized(const lvk::VertexInput& streams)
+{
+  return streams == getQuantizedVertexInput();
+}
+
+// octahedral mapping of a unit vector onto [-1..1]^2
+static glm::vec2 encodeOctahedral(const glm::vec3& v)
+{
+  const float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+
+  if (l1 == 0.0f)
+    return glm::vec2(0.0f);
+
+  const glm::vec3 n = v / l1;
+
+  if (n.z >= 0.0f)
+    return glm::vec2(n.x, n.y);
+
+  return glm::vec2((1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+bool quantizeVertices(MeshData& m)
+{
+  const lvk::VertexInput::VertexAttribute* attr = m.streams.attributes;
+
+  if (attr[0].format != lvk::VertexFormat::Float3 || attr[0].offset != 0 || attr[1].format != lvk::VertexFormat::Float2 ||
+      attr[1].offset != 12 || attr[2].format != lvk::VertexFormat::Float3 || attr[2].offset != 20 ||
+      m.streams.getVertexSize() != 32) {
+    printf("quantizeVertices(): unsupported vertex format\n");
+    return false;
+  }
+
+  LVK_ASSERT(m.boxes.size() == m.meshes.size());
+
+  const std::span<const uint32_t> indexData = m.getIndexData();
+  const std::span<const uint8_t> vertexData = m.getVertexData();
+
+  const size_t numVertices = vertexData.size() / 32;
+
+  // every vertex is quantized relative to the bounding box of the mesh that references it
+  constexpr uint32_t kNoOwner = ~0u;
+
+  std::vector<uint32_t> owner(numVertices, kNoOwner);
+
+  for (uint32_t meshId = 0; meshId != m.meshes.size(); meshId++) {
+    const Mesh& mesh = m.meshes[meshId];
+    for (uint64_t i = mesh.indexOffset; i != mesh.indexOffset + mesh.lodOffset[mesh.lodCount]; i++) {
+      const uint64_t v = indexData[i] + mesh.vertexOffset;
+      if (owner[v] != kNoOwner && owner[v] != meshId) {
+        const BoundingBox& a = m.boxes[owner[v]];
+        const BoundingBox& b = m.boxes[meshId];
+        if (a.min_ != b.min_ || a.max_ != b.max_) {
+          printf("quantizeVertices(): vertex %llu is shared by meshes %u and %u\n", (unsigned long long)v, owner[v], meshId);
+          return false;
+        }
+      }
+      owner[v] = meshId;
+    }
+  }
+
+  std::vector<uint8_t> quantized(numVertices * 16);
+
+  for (size_t v = 0; v != numVertices; v++) {
+    const float* src = reinterpret_cast<const float*>(vertexData.data() + v * 32);
+    uint8_t* dst     = quantized.data() + v * 16;
+
+    const glm::vec3 pos(src[0], src[1], src[2]);
+    const glm::vec2 uv(src[3], src[4]);
+    const glm::vec3 normal(src[5], src[6], src[7]);
+
+    // unreferenced vertices are never fetched
+    const BoundingBox box  = owner[v] != kNoOwner ? m.boxes[owner[v]] : BoundingBox(pos, pos);
+    const glm::vec3 extent = box.max_ - box.min_;
+    const glm::vec3 unorm  = glm::clamp((pos - box.min_) / glm::max(extent, glm::vec3(1e-30f)), 0.0f, 1.0f);
+
+    const uint16_t qpos[4] = {
+      (uint16_t)(unorm.x * 65535.0f + 0.5f),
+      (uint16_t)(unorm.y * 65535.0f + 0.5f),
+      (uint16_t)(unorm.z * 65535.0f + 0.5f),
+      0,
+    };
+    const uint32_t quv     = glm::packHalf2x16(uv);
+    const uint32_t qnormal = glm::packSnorm2x16(encodeOctahedral(normal));
+
+    memcpy(dst + 0, qpos, sizeof(qpos));
+    memcpy(dst + 8, &quv, sizeof(quv));
+    memcpy(dst + 12, &qnormal, sizeof(qnormal));
+  }
+
+  m.streams    = getQuantizedVertexInput();
+  m.vertexData = std::move(quantized);
+  m.releaseMappedData();
+
+  return true;
 }
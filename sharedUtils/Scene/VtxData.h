@@ -1,28 +1,38 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <span>
 
 #include <glm/glm.hpp>
 
+#include "shared/MappedFile.h"
 #include "shared/Utils.h"
 #include "shared/UtilsMath.h"
 
 constexpr const uint32_t kMaxLODs = 7;
 
-// All offsets are relative to the beginning of the data block (excluding headers with a Mesh list)
+// All offsets are relative to the beginning of the data block (excluding headers with a Mesh list).
+// Index and vertex offsets are 64-bit, so merged scenes are not limited to 4 GB of vertex data or 2^32 indices
 struct Mesh final {
   // Number of LODs in this mesh. Strictly less than MAX_LODS, last LOD offset is used as a marker only
   uint32_t lodCount = 1;
 
-  // The total count of all previous vertices in this mesh file
-  uint32_t indexOffset = 0;
+  uint32_t padding0 = 0;
+
+  // The total count of all previous indices in this mesh file
+  uint64_t indexOffset = 0;
 
-  uint32_t vertexOffset = 0;
+  // Added to every index of this mesh to get the vertex number in the mesh file
+  uint64_t vertexOffset = 0;
 
   // Vertex count (for all LODs)
   uint32_t vertexCount = 0;
 
-  // Offsets to LOD indices data. The last offset is used as a marker to calculate the size
+  // Offsets to LOD indices data, relative to indexOffset. The last offset is used as a marker to calculate the size.
+  // A single mesh never needs more than 2^32 indices, so these stay 32-bit
   uint32_t lodOffset[kMaxLODs + 1] = { 0 };
 
   uint32_t materialID = 0;
@@ -32,18 +42,44 @@ struct Mesh final {
   // Any additional information, such as mesh name, can be added here...
 };
 
+static_assert(sizeof(Mesh) == 64);
+
+// meshlet limits recommended for mesh shaders; the triangle count keeps the primitive indices within 512 bytes
+constexpr const uint32_t kMaxMeshletVertices  = 64;
+constexpr const uint32_t kMaxMeshletTriangles = 124;
+
+// A cluster of up to kMaxMeshletTriangles triangles of LOD 0 (see buildMeshlets()), same layout on the GPU
+struct Meshlet final {
+  uint32_t vertexOffset   = 0; // into MeshData::meshletVertices
+  uint32_t triangleOffset = 0; // into MeshData::meshletTriangles, in bytes
+  uint32_t vertexCount    = 0;
+  uint32_t triangleCount  = 0;
+  // bounding sphere and normal cone in the mesh space (meshopt_computeMeshletBounds())
+  float center[3]   = {};
+  float radius      = 0.0f;
+  float coneAxis[3] = {};
+  float coneCutoff  = 1.0f;
+};
+
+static_assert(sizeof(Meshlet) == 48);
+
+struct MeshletRange final {
+  uint32_t firstMeshlet = 0;
+  uint32_t numMeshlets  = 0;
+};
+
 struct MeshFileHeader {
-  // Unique 64-bit value to check integrity of the file
-  uint32_t magicValue = 0x12345678;
+  // Unique value to check integrity of the file (changed together with the layout of Mesh and MeshFileHeader)
+  uint32_t magicValue = 0x12345679;
 
   // Number of mesh descriptors following this header
   uint32_t meshCount = 0;
 
   // How much space index data takes in bytes
-  uint32_t indexDataSize = 0;
+  uint64_t indexDataSize = 0;
 
   // How much space vertex data takes in bytes
-  uint32_t vertexDataSize = 0;
+  uint64_t vertexDataSize = 0;
 
   // According to your needs, you may add additional metadata fields...
 };
@@ -77,12 +113,36 @@ struct MeshData {
   std::vector<BoundingBox> boxes;
   std::vector<Material> materials;
   std::vector<std::string> textureFiles;
+
+  // optional meshlets of LOD 0, meshletRanges has one entry per mesh when present
+  std::vector<MeshletRange> meshletRanges;
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> meshletVertices; // relative to Mesh::vertexOffset
+  std::vector<uint8_t> meshletTriangles; // 3 indices into the meshlet's vertices per triangle
+
+  // Read-only views into a memory-mapped mesh file (see loadMeshDataMapped()).
+  // When the file is mapped, indexData and vertexData stay empty and these views are used instead
+  std::shared_ptr<MappedFile> mappedFile;
+  std::span<const uint32_t> mappedIndexData;
+  std::span<const uint8_t> mappedVertexData;
+
+  std::span<const uint32_t> getIndexData() const { return mappedFile ? mappedIndexData : std::span<const uint32_t>(indexData); }
+  std::span<const uint8_t> getVertexData() const { return mappedFile ? mappedVertexData : std::span<const uint8_t>(vertexData); }
+
+  // drop the mapping once the geometry has been uploaded to the GPU
+  void releaseMappedData()
+  {
+    mappedIndexData  = {};
+    mappedVertexData = {};
+    mappedFile.reset();
+  }
+
   MeshFileHeader getMeshFileHeader() const
   {
     return {
       .meshCount      = (uint32_t)meshes.size(),
-      .indexDataSize  = (uint32_t)(indexData.size() * sizeof(uint32_t)),
-      .vertexDataSize = (uint32_t)vertexData.size(),
+      .indexDataSize  = getIndexData().size() * sizeof(uint32_t),
+      .vertexDataSize = getVertexData().size(),
     };
   }
 };
@@ -93,12 +153,40 @@ bool isMeshDataValid(const char* fileName);
 bool isMeshMaterialsValid(const char* fileName);
 bool isMeshHierarchyValid(const char* fileName);
 MeshFileHeader loadMeshData(const char* meshFile, MeshData& out);
+// same as loadMeshData() but index and vertex data are not copied: MeshData gets views into a read-only mapping of the file
+MeshFileHeader loadMeshDataMapped(const char* meshFile, MeshData& out);
 void loadMeshDataMaterials(const char* meshFile, MeshData& out);
 void saveMeshData(const char* fileName, const MeshData& m);
 void saveMeshDataMaterials(const char* fileName, const MeshData& m);
+// read/write materials at the current file position (used to embed them into other files)
+void loadMeshDataMaterials(FILE* f, MeshData& out);
+void saveMeshDataMaterials(FILE* f, const MeshData& m);
 
 void recalculateBoundingBoxes(MeshData& m);
 
+// Appends up to maxLODs-1 simplified LODs to every single-LOD mesh, each one targeting half the triangles of the previous one.
+// Meshes which cannot be simplified (or have out-of-range indices or non-finite positions) keep only LOD 0.
+// Expects Float3 positions. Returns the number of meshes which got LODs
+uint32_t generateLODs(MeshData& m, uint32_t maxLODs = kMaxLODs);
+
+// Reorders the indices of every LOD for the post-transform vertex cache (and LOD 0 for overdraw, which needs Float3 positions),
+// then gives every mesh its own vertex range in first-use order. Vertices shared by several meshes (merged meshes can overlap
+// others) are duplicated and unreferenced ones are dropped, so the result is valid for any index layout. Deterministic
+void optimizeMeshes(MeshData& m, bool optimizeOverdraw = true);
+
+// Splits LOD 0 of every mesh into meshlets with bounding spheres and normal cones. Needs Float3 positions and has to run
+// after anything which reorders vertices or indices (optimizeMeshes(), generateLODs()); quantization keeps meshlets valid
+void buildMeshlets(MeshData& m);
+
+// Quantized vertex format, 16 bytes per vertex instead of 32:
+//   location 0: UShort4Norm position, relative to the bounding box of its mesh (MeshData::boxes)
+//   location 1: HalfFloat2 texture coordinates
+//   location 2: Short2Norm octahedral normal
+// Expects the Float3 position, Float2 UV, Float3 normal layout and up-to-date bounding boxes. Returns false and leaves
+// the data untouched if a vertex is shared by meshes with different bounding boxes
+bool quantizeVertices(MeshData& m);
+bool isVertexFormatQuantized(const lvk::VertexInput& streams);
+
 // combine a list of meshes to a single mesh container
 MeshFileHeader mergeMeshData(MeshData& m, const std::vector<MeshData*> md);
 
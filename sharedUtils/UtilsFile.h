@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// 64-bit file positioning: large caches do not fit into 'long' on Windows
+
+inline int fseek64(FILE* f, int64_t offset, int origin)
+{
+#if defined(_WIN32)
+  return _fseeki64(f, offset, origin);
+#else
+  return fseeko(f, (off_t)offset, origin);
+#endif
+}
+
+inline int64_t ftell64(FILE* f)
+{
+#if defined(_WIN32)
+  return _ftelli64(f);
+#else
+  return (int64_t)ftello(f);
+#endif
+}
+
+// returns -1 if the size cannot be determined; the current position is preserved
+inline int64_t getFileSize64(FILE* f)
+{
+  const int64_t pos = ftell64(f);
+
+  if (pos < 0 || fseek64(f, 0, SEEK_END))
+    return -1;
+
+  const int64_t size = ftell64(f);
+
+  fseek64(f, pos, SEEK_SET);
+
+  return size;
+}
@@ -25,6 +25,45 @@ inline vec2 clampLength(const vec2& v, float maxLength)
   return (l > maxLength) ? normalize(v) * maxLength : v;
 }
 
+// An affine transform stored as the first three rows of a 4x4 matrix, the last row is always (0, 0, 0, 1).
+// 48 bytes instead of 64; the GPU buffers read it as a GLSL mat3x4 (see transform.sp). Converts implicitly to and from mat4
+struct AffineTransform {
+  vec4 rows[3] = { vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0) };
+
+  AffineTransform() = default;
+  AffineTransform(const mat4& m)
+  : rows{ vec4(m[0][0], m[1][0], m[2][0], m[3][0]), vec4(m[0][1], m[1][1], m[2][1], m[3][1]), vec4(m[0][2], m[1][2], m[2][2], m[3][2]) }
+  {
+  }
+  operator mat4() const { return glm::transpose(mat4(rows[0], rows[1], rows[2], vec4(0, 0, 0, 1))); }
+  vec3 transformPoint(const vec3& p) const
+  {
+    const vec4 v(p, 1.0f);
+    return vec3(glm::dot(rows[0], v), glm::dot(rows[1], v), glm::dot(rows[2], v));
+  }
+  // the cofactor matrix, i.e. transpose(inverse(M)) * |det(M)|: normals come out in the right direction and are renormalized anyway
+  glm::mat3 getNormalMatrix() const
+  {
+    const vec3 c0 = vec3(rows[0].x, rows[1].x, rows[2].x);
+    const vec3 c1 = vec3(rows[0].y, rows[1].y, rows[2].y);
+    const vec3 c2 = vec3(rows[0].z, rows[1].z, rows[2].z);
+    const float s = glm::dot(c0, glm::cross(c1, c2)) < 0.0f ? -1.0f : 1.0f;
+    return glm::mat3(s * glm::cross(c1, c2), s * glm::cross(c2, c0), s * glm::cross(c0, c1));
+  }
+  bool operator==(const AffineTransform& t) const { return rows[0] == t.rows[0] && rows[1] == t.rows[1] && rows[2] == t.rows[2]; }
+};
+
+static_assert(sizeof(AffineTransform) == 12 * sizeof(float));
+
+// a * b, the implicit last row (0, 0, 0, 1) is never multiplied
+inline AffineTransform operator*(const AffineTransform& a, const AffineTransform& b)
+{
+  AffineTransform r;
+  for (int i = 0; i != 3; i++)
+    r.rows[i] = a.rows[i].x * b.rows[0] + a.rows[i].y * b.rows[1] + a.rows[i].z * b.rows[2] + vec4(0, 0, 0, a.rows[i].w);
+  return r;
+}
+
 struct BoundingBox {
   vec3 min_;
   vec3 max_;
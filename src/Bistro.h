@@ -1,11 +1,18 @@
 ﻿#pragma once
 
 #include "shared/Scene/MergeUtil.h"
+#include "shared/Scene/MeshCache.h"
 #include "shared/Scene/Scene.h"
 #include "shared/Scene/VtxData.h"
+#include "shared/UtilsFile.h"
 
 #include "Chapter08/SceneUtils.h"
 
+#include <chrono>
+#include <string>
+
+#include <taskflow/taskflow.hpp>
+
 #if !defined(fileNameCachedMeshes) || !defined(fileNameCachedMaterials) || !defined(fileNameCachedHierarchy)
 // by default, share the precached Bistro with Chapter08/03_LargeScene
 #define fileNameCachedMeshes ".cache/ch08_bistro.meshes"
@@ -13,69 +20,271 @@
 #define fileNameCachedHierarchy ".cache/ch08_bistro.scene"
 #endif
 
-void loadBistro(MeshData& meshData, Scene& scene) {
-  if (!isMeshDataValid(fileNameCachedMeshes) || !isMeshHierarchyValid(fileNameCachedHierarchy) ||
-      !isMeshMaterialsValid(fileNameCachedMaterials)) {
-    printf("No cached mesh data found. Precaching...\n\n");
+// define fileNameCachedContainer to keep meshes, materials and the scene in one versioned and checksummed file (see MeshCache.h)
+// define compressCachedContainer to store its index/vertex streams encoded with the meshoptimizer codecs
+// define quantizeCachedVertices to store 16-byte quantized vertices instead of 32-byte float ones (see quantizeVertices()).
+// The cached scene nodes are renumbered in breadth-first order (see reorderSceneNodes()).
+// The benchmarks of the loaded Bistro are in BistroBenchmarks.h.
+// The container records its sources and parameters (see MeshCacheManifest) and is rebuilt when they change; the separate
+// files are only checked for integrity, delete them to rebuild
+
+constexpr float kBistroScale = 0.01f;
+
+// the two halves of the Bistro are imported and pre-merged independently of each other
+struct BistroPart {
+  const char* name    = nullptr;
+  const char* objFile = nullptr;
+  const char* mtlFile = nullptr;
+  std::vector<std::string> mergedMaterials; // the nodes with each of these materials are merged into one mesh
+};
+
+static const BistroPart kBistroExterior = {
+  .name            = "exterior",
+  .objFile         = "deps/src/bistro/Exterior/exterior.obj",
+  .mtlFile         = "deps/src/bistro/Exterior/exterior.mtl",
+  .mergedMaterials = { "Foliage_Linde_Tree_Large_Orange_Leaves", "Foliage_Linde_Tree_Large_Green_Leaves",
+                      "Foliage_Linde_Tree_Large_Trunk" },
+};
+
+static const BistroPart kBistroInterior = {
+  .name    = "interior",
+  .objFile = "deps/src/bistro/Interior/interior.obj",
+  .mtlFile = "deps/src/bistro/Interior/interior.mtl",
+};
+
+// fingerprints of everything that affects the cached data besides the source files
+uint64_t getBistroPartParamsHash(const BistroPart& part) {
+  std::string params = std::string(part.objFile) + "|cache v" + std::to_string(kMeshCacheVersion);
+#if defined(DEMO_TEXTURE_MAX_SIZE)
+  params += "|textures " + std::to_string(DEMO_TEXTURE_MAX_SIZE);
+#endif
+  for (const std::string& m : part.mergedMaterials)
+    params += "|merge " + m;
+  return hashBytes64(params.data(), params.size());
+}
+
+uint64_t getBistroParamsHash() {
+  std::string params = "scale " + std::to_string(kBistroScale) + "|lods " + std::to_string(kMaxLODs) + "|meshlets " +
+                       std::to_string(kMaxMeshletVertices) + "/" + std::to_string(kMaxMeshletTriangles);
+#if defined(quantizeCachedVertices)
+  params += "|quantized";
+#endif
+#if defined(compressCachedContainer)
+  params += "|encoded";
+#endif
+  params += "|breadth-first nodes";
+  const uint64_t hashes[] = { getBistroPartParamsHash(kBistroExterior), getBistroPartParamsHash(kBistroInterior) };
+  return hashBytes64(hashes, sizeof(hashes), hashBytes64(params.data(), params.size()));
+}
+
+#if defined(fileNameCachedContainer)
+// the intermediate cache of one half of the Bistro, after importing and merging
+std::string getBistroPartCacheFileName(const BistroPart& part) {
+  return std::string(fileNameCachedContainer) + "." + part.name;
+}
+
+bool isBistroCacheValid() {
+  return isMeshCacheUpToDate(fileNameCachedContainer, getBistroParamsHash());
+}
+#else
+bool isBistroCacheValid() {
+  return isMeshDataValid(fileNameCachedMeshes) && isMeshHierarchyValid(fileNameCachedHierarchy) &&
+         isMeshMaterialsValid(fileNameCachedMaterials);
+}
+#endif
+
+// mapMeshData: keep the index/vertex data in a read-only mapping of the cache instead of copying it into MeshData
+void loadBistro(MeshData& meshData, Scene& scene, bool mapMeshData = false) {
+  if (!isBistroCacheValid()) {
+    printf("No up-to-date cached mesh data found. Precaching...\n\n");
+
+    const auto precacheStart = std::chrono::steady_clock::now();
+
+    // wraps a precaching stage to print its wall-clock time; stages running in parallel print in the order they finish
+    auto timed = [precacheStart](const char* name, auto&& stage) {
+      const auto start = std::chrono::steady_clock::now();
+      stage();
+      const auto end = std::chrono::steady_clock::now();
+      printf(
+          "[Precache] %-32s %9.1f ms (done at %.1f s)\n", name, std::chrono::duration<double, std::milli>(end - start).count(),
+          std::chrono::duration<double>(end - precacheStart).count());
+    };
 
     MeshData meshData_Exterior;
     MeshData meshData_Interior;
     Scene ourScene_Exterior;
     Scene ourScene_Interior;
+    // sources of each half, including its intermediate cache; together they are the sources of the final cache
+    MeshCacheManifest manifest_Exterior;
+    MeshCacheManifest manifest_Interior;
 
-    // don't generate LODs because meshoptimizer fails on the Bistro mesh
-    loadMeshFile("deps/src/bistro/Exterior/exterior.obj", meshData_Exterior, ourScene_Exterior, false);
-    loadMeshFile("deps/src/bistro/Interior/interior.obj", meshData_Interior, ourScene_Interior, false);
-
-    // merge some meshes
-    printf("[Unmerged] scene items: %u\n", (uint32_t)ourScene_Exterior.hierarchy.size());
-    mergeNodesWithMaterial(ourScene_Exterior, meshData_Exterior, "Foliage_Linde_Tree_Large_Orange_Leaves");
-    printf("[Merged orange leaves] scene items: %u\n", (uint32_t)ourScene_Exterior.hierarchy.size());
-    mergeNodesWithMaterial(ourScene_Exterior, meshData_Exterior, "Foliage_Linde_Tree_Large_Green_Leaves");
-    printf("[Merged green leaves]  scene items: %u\n", (uint32_t)ourScene_Exterior.hierarchy.size());
-    mergeNodesWithMaterial(ourScene_Exterior, meshData_Exterior, "Foliage_Linde_Tree_Large_Trunk");
-    printf("[Merged trunk]  scene items: %u\n", (uint32_t)ourScene_Exterior.hierarchy.size());
-
-    // merge everything into one big scene
     MeshData meshData;
     Scene ourScene;
 
-    mergeScenes(
-        ourScene,
-        {
-            &ourScene_Exterior,
-            &ourScene_Interior,
-        },
-        {},
-        {
-            static_cast<uint32_t>(meshData_Exterior.meshes.size()),
-            static_cast<uint32_t>(meshData_Interior.meshes.size()),
+    // imports one half and merges its nodes, or loads the result from its intermediate cache if none of its inputs changed.
+    // The texture conversion is a part of loadMeshFile(), so a missing or modified converted texture redoes the import
+    auto preparePart = [&timed](const BistroPart& part, MeshData& md, Scene& s, MeshCacheManifest& manifest) {
+      const std::string name = part.name;
+#if defined(fileNameCachedContainer)
+      const std::string cacheFile = getBistroPartCacheFileName(part);
+      const uint64_t paramsHash   = getBistroPartParamsHash(part);
+
+      if (isMeshCacheUpToDate(cacheFile.c_str(), paramsHash)) {
+        timed(("Load cached " + name).c_str(), [&]() {
+          loadMeshCache(cacheFile.c_str(), md, s);
+          loadMeshCacheManifest(cacheFile.c_str(), manifest);
+        });
+        manifest.sources.push_back(getMeshCacheSource(cacheFile.c_str()));
+        return;
+      }
+#endif
+
+      // don't generate LODs here because meshoptimizer fails on some of the Bistro meshes, see generateLODs() below
+      timed(("Import " + name).c_str(), [&]() { loadMeshFile(part.objFile, md, s, false); });
+
+      // the merges of one part all rewrite the same scene and mesh data, so they are sequential
+      if (!part.mergedMaterials.empty()) {
+        timed(("Merge " + name).c_str(), [&]() {
+          const uint32_t numUnmerged = (uint32_t)s.hierarchy.size();
+          mergeNodesWithMaterials(s, md, part.mergedMaterials);
+          printf("[Merged %s] scene items: %u -> %u\n", part.name, numUnmerged, (uint32_t)s.hierarchy.size());
         });
-    mergeMeshData(meshData, { &meshData_Exterior, &meshData_Interior });
-    mergeMaterialLists(
-        {
-            &meshData_Exterior.materials,
-            &meshData_Interior.materials,
-        },
-        {
-            &meshData_Exterior.textureFiles,
-            &meshData_Interior.textureFiles,
-        },
-        meshData.materials, meshData.textureFiles);
-
-    ourScene.localTransform[0] = glm::scale(vec3(0.01f)); // scale the Bistro
-    markAsChanged(ourScene, 0);
-
-	 // calculating the bounding boxes of each mesh, useful for camera culling
-    recalculateBoundingBoxes(meshData);
-
-    saveMeshData(fileNameCachedMeshes, meshData);
-    saveMeshDataMaterials(fileNameCachedMaterials, meshData);
-    saveScene(fileNameCachedHierarchy, ourScene);
+      }
+
+#if defined(fileNameCachedContainer)
+      manifest = { .paramsHash = paramsHash };
+      manifest.sources.push_back(getMeshCacheSource(part.objFile));
+      manifest.sources.push_back(getMeshCacheSource(part.mtlFile));
+      for (const std::string& file : md.textureFiles)
+        manifest.sources.push_back(getMeshCacheSource(file.c_str()));
+
+      timed(("Save " + name).c_str(), [&]() { saveMeshCache(cacheFile.c_str(), md, s, false, &manifest); });
+      manifest.sources.push_back(getMeshCacheSource(cacheFile.c_str()));
+#endif
+    };
+
+    // The two halves are prepared in parallel. The three final merges write disjoint outputs and run in parallel as well
+    tf::Executor executor;
+    tf::Taskflow taskflow;
+
+    tf::Task prepareExterior = taskflow.emplace([&]() {
+      preparePart(kBistroExterior, meshData_Exterior, ourScene_Exterior, manifest_Exterior);
+    });
+    tf::Task prepareInterior = taskflow.emplace([&]() {
+      preparePart(kBistroInterior, meshData_Interior, ourScene_Interior, manifest_Interior);
+    });
+
+    // merge everything into one big scene
+    tf::Task mergeAllScenes = taskflow.emplace([&]() {
+      timed("Merge scenes", [&]() {
+        mergeScenes(
+            ourScene,
+            {
+                &ourScene_Exterior,
+                &ourScene_Interior,
+            },
+            {},
+            {
+                static_cast<uint32_t>(meshData_Exterior.meshes.size()),
+                static_cast<uint32_t>(meshData_Interior.meshes.size()),
+            });
+        ourScene.localTransform[0] = glm::scale(vec3(kBistroScale)); // scale the Bistro
+        markAsChanged(ourScene, 0);
+      });
+    });
+    // the two parts are only read here and by the task below; this one writes the geometry, meshes and boxes of meshData and
+    // the task below writes its materials and texture files, so the outputs are disjoint and the tasks run in parallel
+    tf::Task mergeAllMeshData = taskflow.emplace([&]() {
+      timed("Merge mesh data", [&]() { mergeMeshData(meshData, { &meshData_Exterior, &meshData_Interior }); });
+    });
+    tf::Task mergeAllMaterials = taskflow.emplace([&]() {
+      timed("Merge materials", [&]() {
+        mergeMaterialLists(
+            {
+                &meshData_Exterior.materials,
+                &meshData_Interior.materials,
+            },
+            {
+                &meshData_Exterior.textureFiles,
+                &meshData_Interior.textureFiles,
+            },
+            meshData.materials, meshData.textureFiles);
+      });
+    });
+
+    mergeAllScenes.succeed(prepareExterior, prepareInterior);
+    mergeAllMeshData.succeed(prepareExterior, prepareInterior);
+    mergeAllMaterials.succeed(prepareExterior, prepareInterior);
+
+    executor.run(taskflow).wait();
+
+    // LODs are built after merging so that the merged foliage gets them as well; meshes which cannot be simplified keep LOD 0
+    timed("Generate LODs", [&]() { generateLODs(meshData); });
+
+    // vertex cache, overdraw and vertex fetch ordering; runs after merging so the merged meshes get consistent vertex ranges
+    timed("Optimize meshes", [&]() { optimizeMeshes(meshData, true); });
+
+	 // calculating the bounding boxes of each mesh, useful for camera culling (in parallel over the meshes)
+    timed("Bounding boxes", [&]() { recalculateBoundingBoxes(meshData); });
+
+    // breadth-first node order with spatially sorted siblings: the transform updates and the per-draw transform fetches walk
+    // memory mostly forward. The draw commands are created in the node order, so they follow as well
+    timed("Reorder nodes", [&]() {
+      recalculateGlobalTransforms(ourScene);
+      std::vector<vec3> centers(ourScene.hierarchy.size());
+      for (size_t i = 0; i != centers.size(); i++)
+        centers[i] = ourScene.globalTransform[i].transformPoint(vec3(0.0f));
+      for (const auto& [node, mesh] : ourScene.meshForNode)
+        centers[node] = meshData.boxes[mesh].getTransformed(ourScene.globalTransform[node]).getCenter();
+      reorderSceneNodes(ourScene, centers);
+    });
+
+    // meshlets for the mesh shader path; they index the final vertex order, so this runs after all the reordering above
+    timed("Build meshlets", [&]() { buildMeshlets(meshData); });
+
+#if defined(quantizeCachedVertices)
+    // positions are stored relative to the bounding boxes, so this has to be the last step touching the geometry
+    timed("Quantize vertices", [&]() {
+      if (!quantizeVertices(meshData))
+        printf("Cannot quantize the vertices, keeping the float vertex format\n");
+    });
+#endif
+
+#if defined(fileNameCachedContainer)
+    MeshCacheManifest manifest = { .paramsHash = getBistroParamsHash(), .sources = manifest_Exterior.sources };
+    mergeVectors(manifest.sources, manifest_Interior.sources);
+#endif
+
+    timed("Save", [&]() {
+#if defined(fileNameCachedContainer) && defined(compressCachedContainer)
+      saveMeshCache(fileNameCachedContainer, meshData, ourScene, true, &manifest);
+#elif defined(fileNameCachedContainer)
+      saveMeshCache(fileNameCachedContainer, meshData, ourScene, false, &manifest);
+#else
+      saveMeshData(fileNameCachedMeshes, meshData);
+      saveMeshDataMaterials(fileNameCachedMaterials, meshData);
+      saveScene(fileNameCachedHierarchy, ourScene);
+#endif
+    });
+
+    printf(
+        "[Precache] total %.1f s\n",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - precacheStart).count());
   }
 
-  const MeshFileHeader header = loadMeshData(fileNameCachedMeshes, meshData);
+  const auto loadStart = std::chrono::steady_clock::now();
+#if defined(fileNameCachedContainer)
+  loadMeshCache(fileNameCachedContainer, meshData, scene, mapMeshData);
+  const MeshFileHeader header = meshData.getMeshFileHeader();
+#else
+  const MeshFileHeader header = mapMeshData ? loadMeshDataMapped(fileNameCachedMeshes, meshData) : loadMeshData(fileNameCachedMeshes, meshData);
   loadMeshDataMaterials(fileNameCachedMaterials, meshData);
-
   loadScene(fileNameCachedHierarchy, scene);
+#endif
+  const auto loadEnd = std::chrono::steady_clock::now();
+
+  printf(
+      "Loaded mesh data (%s): %u meshes, %.1f MB of geometry in %.2f ms\n", mapMeshData ? "mapped" : "copied", header.meshCount,
+      (double(header.indexDataSize) + double(header.vertexDataSize)) / (1024.0 * 1024.0),
+      std::chrono::duration<double, std::milli>(loadEnd - loadStart).count());
 }
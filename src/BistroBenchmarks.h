@@ -0,0 +1,914 @@
+#pragma once
+
+#include "shared/Scene/MeshCache.h"
+#include "shared/Scene/Scene.h"
+#include "shared/Scene/VtxData.h"
+#include "shared/UtilsFile.h"
+
+#include "Chapter11/VKFrustumCuller11.h"
+#include "Chapter11/VKOcclusionRasterizer11.h"
+#include "Chapter11/VKSceneTransforms11.h"
+
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <span>
+
+#include <taskflow/taskflow.hpp>
+
+// Self-checks and benchmarks of the scene and culling code. main() runs the self-checks before loadBistro(), they need
+// neither the Bistro nor a window, the GPU self-checks once the Vulkan context exists, and the benchmarks after loadBistro().
+// Each of them is enabled with a define before including this file:
+//   runSelfTests                - correctness checks on synthetic data, the first failed check stops the application
+//   benchmarkCachedContainer    - the raw and the meshoptimizer-encoded containers (needs fileNameCachedContainer)
+//   benchmarkSceneTransforms    - recalculateGlobalTransforms(), serial against level-parallel
+//   benchmarkSceneComponents    - NodeComponentMap against std::unordered_map
+//   benchmarkSceneNodeOrder     - the breadth-first node order against a shuffled one (see reorderSceneNodes())
+//   benchmarkFrustumCulling     - VKFrustumCuller11 against isBoxInFrustum() on the Bistro boxes
+//   benchmarkOcclusionCulling   - VKOcclusionRasterizer11 with the automatically selected Bistro occluders
+
+// min and average wall-clock time of the calls of run(i), i = 0..numIterations-1; setup(i) runs before each call, untimed
+struct BenchmarkTime {
+  double minMs = std::numeric_limits<double>::max();
+  double avgMs = 0.0;
+};
+
+template <typename Setup, typename Run> BenchmarkTime measureTime(uint32_t numIterations, Setup&& setup, Run&& run) {
+  BenchmarkTime time;
+  for (uint32_t i = 0; i != numIterations; i++) {
+    setup(i);
+    const auto start = std::chrono::steady_clock::now();
+    run(i);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    time.minMs      = std::min(time.minMs, ms);
+    time.avgMs += ms / numIterations;
+  }
+  return time;
+}
+
+template <typename Run> BenchmarkTime measureTime(uint32_t numIterations, Run&& run) {
+  return measureTime(numIterations, [](uint32_t) {}, run);
+}
+
+// stops the application at the first failed check, so a broken test cannot scroll by unnoticed
+void checkTest(bool condition, const char* test, const char* check) {
+  if (condition)
+    return;
+
+  printf("%s: FAILED %s\n", test, check);
+  assert(false);
+  exit(EXIT_FAILURE);
+}
+
+// world-space boxes of all the mesh nodes, in the order of scene.meshForNode
+std::vector<BoundingBox> getMeshNodeBoxes(const MeshData& meshData, const Scene& scene) {
+  std::vector<BoundingBox> boxes;
+  boxes.reserve(scene.meshForNode.size());
+  for (const auto& p : scene.meshForNode)
+    boxes.push_back(meshData.boxes[p.second].getTransformed(scene.globalTransform[p.first]));
+  return boxes;
+}
+
+// view-projection matrices of a ring of cameras inside the bounds of 'boxes', looking outward
+std::vector<mat4> getBenchmarkViews(std::span<const BoundingBox> boxes, uint32_t numViews) {
+  BoundingBox bounds = boxes.empty() ? BoundingBox() : boxes.front();
+  for (const BoundingBox& b : boxes) {
+    bounds.combinePoint(b.min_);
+    bounds.combinePoint(b.max_);
+  }
+  const vec3 center  = 0.5f * (bounds.min_ + bounds.max_);
+  const float radius = 0.5f * glm::length(bounds.max_ - bounds.min_);
+
+  std::vector<mat4> views(numViews);
+  for (uint32_t v = 0; v != numViews; v++) {
+    const float angle = 2.0f * Math::PI * float(v) / float(numViews);
+    const vec3 eye    = center + vec3(radius * 0.25f * cosf(angle), 0.0f, radius * 0.25f * sinf(angle));
+    const mat4 proj   = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius);
+    const mat4 view   = glm::lookAt(eye, eye + vec3(cosf(angle), 0.0f, sinf(angle)), vec3(0.0f, 1.0f, 0.0f));
+    views[v]          = proj * view;
+  }
+  return views;
+}
+
+// a synthetic hierarchy of numNodes nodes, every node has up to 'fanout' children, breadth-first order
+Scene createSyntheticScene(uint32_t numNodes, uint32_t fanout = 8) {
+  Scene scene;
+  uint32_t seed = 12345;
+  auto random   = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / float(1u << 24);
+  };
+  for (uint32_t i = 0; i != numNodes; i++) {
+    const int parent = i ? int((i - 1) / fanout) : -1;
+    const int level  = parent >= 0 ? scene.hierarchy[parent].level + 1 : 0;
+    if (level >= MAX_NODE_LEVEL)
+      break;
+    const int node = addNode(scene, parent, level);
+    scene.localTransform[node] = glm::translate(mat4(1.0f), vec3(random(), random(), random())) *
+                                 glm::rotate(mat4(1.0f), random(), glm::normalize(vec3(random(), random(), random()) + vec3(0.01f)));
+  }
+  return scene;
+}
+
+#if defined(runSelfTests)
+// how many times every node is queued in changedAtThisFrame[], checking the levels on the way
+std::vector<uint32_t> getChangedNodeCounts(const Scene& scene) {
+  std::vector<uint32_t> counts(scene.hierarchy.size(), 0);
+  for (int level = 0; level != MAX_NODE_LEVEL; level++)
+    for (int n : scene.changedAtThisFrame[level]) {
+      checkTest(scene.hierarchy[n].level == level, "markAsChanged()", "a node is queued at its own level");
+      counts[n]++;
+    }
+  return counts;
+}
+
+// 1 for the nodes in the subtrees of 'roots', 0 for the rest; the parents precede their children in createSyntheticScene()
+std::vector<uint32_t> getSubtreeNodes(const Scene& scene, std::initializer_list<int> roots) {
+  std::vector<uint32_t> inSubtree(scene.hierarchy.size(), 0);
+  for (int r : roots)
+    inSubtree[r] = 1;
+  for (size_t n = 0; n != scene.hierarchy.size(); n++)
+    if (scene.hierarchy[n].parent >= 0 && inSubtree[scene.hierarchy[n].parent])
+      inSubtree[n] = 1;
+  return inSubtree;
+}
+
+void testMarkAsChanged() {
+  Scene scene = createSyntheticScene(500, 3);
+
+  const int child      = scene.hierarchy[0].firstChild;
+  const int grandchild = scene.hierarchy[child].firstChild;
+  const int sibling    = scene.hierarchy[child].nextSibling;
+
+  // an ancestor and its descendant in one frame, in both orders: every node is queued once
+  markAsChanged(scene, grandchild);
+  markAsChanged(scene, 0);
+  markAsChanged(scene, child);
+  checkTest(getChangedNodeCounts(scene) == getSubtreeNodes(scene, { 0 }), "markAsChanged()", "an ancestor after its descendant");
+  clearChangedNodes(scene);
+
+  markAsChanged(scene, child);
+  markAsChanged(scene, grandchild);
+  checkTest(getChangedNodeCounts(scene) == getSubtreeNodes(scene, { child }), "markAsChanged()", "a descendant after its ancestor");
+  clearChangedNodes(scene);
+
+  // the bulk overload: overlapping and disjoint subtrees, duplicates
+  const int nodes[] = { grandchild, sibling, child, grandchild };
+  markAsChanged(scene, nodes);
+  checkTest(
+      getChangedNodeCounts(scene) == getSubtreeNodes(scene, { child, sibling }), "markAsChanged()", "overlapping subtrees in one span");
+  clearChangedNodes(scene);
+  checkTest(getChangedNodeCounts(scene) == std::vector<uint32_t>(scene.hierarchy.size(), 0), "clearChangedNodes()", "empty lists");
+
+  // the epoch wraps around: the nodes queued in the epochs 1 and UINT32_MAX must not look queued after the wrap
+  scene.currentChangedEpoch = 1;
+  markAsChanged(scene, sibling);
+  clearChangedNodes(scene);
+  scene.currentChangedEpoch = std::numeric_limits<uint32_t>::max();
+  markAsChanged(scene, child);
+  clearChangedNodes(scene);
+  checkTest(scene.currentChangedEpoch == 1, "clearChangedNodes()", "the epoch restarts at 1");
+  markAsChanged(scene, nodes);
+  checkTest(
+      getChangedNodeCounts(scene) == getSubtreeNodes(scene, { child, sibling }), "clearChangedNodes()", "nodes queued after the wrap");
+  clearChangedNodes(scene);
+
+  // nodes added after the last call
+  const int added = addNode(scene, grandchild, scene.hierarchy[grandchild].level + 1);
+  markAsChanged(scene, grandchild);
+  checkTest(getChangedNodeCounts(scene)[added] == 1, "markAsChanged()", "a node added after the last call");
+  clearChangedNodes(scene);
+
+  printf("markAsChanged(): passed\n");
+}
+
+// deleteSceneNodes() as it was before SceneEdit, the reference for the removals. The selection is sorted here, the old
+// eraseSelected() needed it for its binary search; levels and lastSibling were not maintained and are not compared
+void deleteSceneNodesReference(Scene& scene, const std::vector<uint32_t>& nodesToDelete) {
+  std::vector<uint8_t> deleted(scene.hierarchy.size(), 0);
+  std::vector<int> stack(nodesToDelete.begin(), nodesToDelete.end());
+  while (!stack.empty()) {
+    const int n = stack.back();
+    stack.pop_back();
+    deleted[n] = 1;
+    for (int c = scene.hierarchy[n].firstChild; c != -1; c = scene.hierarchy[c].nextSibling)
+      stack.push_back(c);
+  }
+
+  std::vector<int> newIndices(scene.hierarchy.size(), -1);
+  int numNodes = 0;
+  for (size_t i = 0; i != scene.hierarchy.size(); i++)
+    if (!deleted[i])
+      newIndices[i] = numNodes++;
+
+  auto findLastNonDeletedItem = [&scene, &newIndices](int node) {
+    while (node != -1 && newIndices[node] == -1)
+      node = scene.hierarchy[node].nextSibling;
+    return node != -1 ? newIndices[node] : -1;
+  };
+
+  Scene result = scene;
+  result.hierarchy.clear();
+  result.localTransform.clear();
+  result.globalTransform.clear();
+  for (size_t i = 0; i != scene.hierarchy.size(); i++) {
+    if (deleted[i])
+      continue;
+    const Hierarchy& h = scene.hierarchy[i];
+    result.hierarchy.push_back({
+        .parent      = h.parent != -1 ? newIndices[h.parent] : -1,
+        .firstChild  = findLastNonDeletedItem(h.firstChild),
+        .nextSibling = findLastNonDeletedItem(h.nextSibling),
+    });
+    result.localTransform.push_back(scene.localTransform[i]);
+    result.globalTransform.push_back(scene.globalTransform[i]);
+  }
+  auto shiftMapIndices = [&newIndices](NodeComponentMap& items) {
+    NodeComponentMap newItems;
+    for (const auto& m : items)
+      if (newIndices[m.first] != -1)
+        newItems[newIndices[m.first]] = m.second;
+    items = std::move(newItems);
+  };
+  shiftMapIndices(result.meshForNode);
+  shiftMapIndices(result.materialForNode);
+  shiftMapIndices(result.nameForNode);
+
+  scene = std::move(result);
+}
+
+// the links agree with the parents, every node is reachable once, the levels follow the parents and the first child caches
+// the last one, as addNode() does
+void checkHierarchy(const Scene& scene, const char* test) {
+  const int numNodes = (int)scene.hierarchy.size();
+
+  std::vector<int> numChildren(numNodes, 0);
+  for (const Hierarchy& h : scene.hierarchy)
+    if (h.parent != -1)
+      numChildren[h.parent]++;
+
+  for (int n = 0; n != numNodes; n++) {
+    const Hierarchy& h = scene.hierarchy[n];
+    checkTest(h.parent >= -1 && h.parent < numNodes, test, "parent index");
+    checkTest(h.level == (h.parent != -1 ? scene.hierarchy[h.parent].level + 1 : 0), test, "level");
+    checkTest(h.level < MAX_NODE_LEVEL, test, "level < MAX_NODE_LEVEL");
+
+    int last = -1;
+    int num  = 0;
+    for (int c = h.firstChild; c != -1 && num <= numNodes; c = scene.hierarchy[c].nextSibling, num++) {
+      checkTest(scene.hierarchy[c].parent == n, test, "the siblings share the parent");
+      last = c;
+    }
+    checkTest(num == numChildren[n], test, "the sibling list holds all the children");
+    if (h.firstChild != -1)
+      checkTest(scene.hierarchy[h.firstChild].lastSibling == last, test, "lastSibling of the first child");
+  }
+}
+
+// global transforms recomputed from scratch, the parents precede their children
+void checkGlobalTransforms(const Scene& scene, const char* test) {
+  std::vector<int> order;
+  for (int n = 0; n != (int)scene.hierarchy.size(); n++)
+    if (scene.hierarchy[n].parent == -1)
+      order.push_back(n);
+  for (size_t i = 0; i != order.size(); i++)
+    for (int c = scene.hierarchy[order[i]].firstChild; c != -1; c = scene.hierarchy[c].nextSibling)
+      order.push_back(c);
+  checkTest(order.size() == scene.hierarchy.size(), test, "every node is reachable from a root");
+
+  std::vector<AffineTransform> global(scene.hierarchy.size());
+  for (int n : order) {
+    const int p = scene.hierarchy[n].parent;
+    global[n]   = p != -1 ? global[p] * scene.localTransform[n] : scene.localTransform[n];
+  }
+  for (size_t n = 0; n != global.size(); n++)
+    for (int r = 0; r != 3; r++)
+      checkTest(glm::length(global[n].rows[r] - scene.globalTransform[n].rows[r]) < 1e-3f, test, "global transforms");
+}
+
+// a random hierarchy with random transforms and components; the parents precede their children
+Scene createRandomScene(std::mt19937& rng, uint32_t numNodes) {
+  Scene scene;
+  std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+  for (uint32_t i = 0; i != numNodes; i++) {
+    int parent = i ? int(rng() % i) : -1;
+    while (parent != -1 && scene.hierarchy[parent].level + 1 >= MAX_NODE_LEVEL)
+      parent = scene.hierarchy[parent].parent;
+    const int node             = addNode(scene, parent, parent != -1 ? scene.hierarchy[parent].level + 1 : 0);
+    scene.localTransform[node] = glm::translate(mat4(1.0f), vec3(offset(rng), offset(rng), offset(rng)));
+    if (rng() % 2)
+      scene.meshForNode[node] = rng() % 100;
+    if (rng() % 3 == 0)
+      scene.materialForNode[node] = rng() % 10;
+    if (rng() % 4 == 0) {
+      scene.nameForNode[node] = (uint32_t)scene.nodeNames.size();
+      scene.nodeNames.push_back("node" + std::to_string(node));
+    }
+  }
+  markAsChanged(scene, 0);
+  recalculateGlobalTransforms(scene);
+  return scene;
+}
+
+bool isSameNodeMap(const NodeComponentMap& a, const NodeComponentMap& b) {
+  if (a.size() != b.size())
+    return false;
+  for (const auto& p : a)
+    if (!b.contains(p.first) || b.at(p.first) != p.second)
+      return false;
+  return true;
+}
+
+void testSceneEdit() {
+  std::mt19937 rng(12345);
+
+  // removals, overlapping subtrees and duplicates included: the same nodes, links and components as the old deleteSceneNodes()
+  for (uint32_t iteration = 0; iteration != 100; iteration++) {
+    const Scene scene = createRandomScene(rng, 1 + rng() % 300);
+
+    std::vector<uint32_t> nodesToDelete(rng() % 10);
+    for (uint32_t& n : nodesToDelete)
+      n = 1 + rng() % std::max<uint32_t>((uint32_t)scene.hierarchy.size() - 1, 1);
+    std::erase_if(nodesToDelete, [&scene](uint32_t n) { return n >= scene.hierarchy.size(); });
+
+    Scene reference = scene;
+    deleteSceneNodesReference(reference, nodesToDelete);
+    Scene edited = scene;
+    deleteSceneNodes(edited, nodesToDelete);
+
+    checkTest(edited.hierarchy.size() == reference.hierarchy.size(), "deleteSceneNodes()", "the surviving nodes");
+    for (size_t n = 0; n != edited.hierarchy.size(); n++) {
+      const Hierarchy& h = edited.hierarchy[n];
+      const Hierarchy& r = reference.hierarchy[n];
+      checkTest(h.parent == r.parent && h.firstChild == r.firstChild && h.nextSibling == r.nextSibling, "deleteSceneNodes()", "links");
+      checkTest(edited.localTransform[n] == reference.localTransform[n], "deleteSceneNodes()", "local transforms");
+      checkTest(edited.globalTransform[n] == reference.globalTransform[n], "deleteSceneNodes()", "global transforms");
+    }
+    checkTest(isSameNodeMap(edited.meshForNode, reference.meshForNode), "deleteSceneNodes()", "meshForNode");
+    checkTest(isSameNodeMap(edited.materialForNode, reference.materialForNode), "deleteSceneNodes()", "materialForNode");
+    checkTest(isSameNodeMap(edited.nameForNode, reference.nameForNode), "deleteSceneNodes()", "nameForNode");
+    checkHierarchy(edited, "deleteSceneNodes()");
+  }
+
+  // mixed edits: reparenting (new roots included), additions under old and new nodes, removals
+  for (uint32_t iteration = 0; iteration != 100; iteration++) {
+    Scene scene = createRandomScene(rng, 2 + rng() % 300);
+
+    const int numNodes = (int)scene.hierarchy.size();
+
+    SceneEdit edit(scene);
+    for (uint32_t i = rng() % 5; i != 0; i--) {
+      const int node = 1 + int(rng() % (numNodes - 1));
+      // the new parent is outside of the subtree of the node
+      int newParent = rng() % 4 ? int(rng() % numNodes) : -1;
+      for (int p = newParent; p != -1; p = scene.hierarchy[p].parent)
+        if (p == node)
+          newParent = -1;
+      edit.reparentNode(node, newParent);
+    }
+    for (uint32_t i = rng() % 5; i != 0; i--)
+      edit.addNode(int(rng() % (numNodes + edit.newNodeParents.size())), glm::translate(mat4(1.0f), vec3(1.0f)));
+    for (uint32_t i = rng() % 3; i != 0; i--)
+      edit.removeNode(1 + int(rng() % (numNodes - 1)));
+
+    const Scene before               = scene;
+    const std::vector<int> newIndices = applySceneEdit(scene, edit);
+    if (newIndices.empty()) {
+      // only an edit that would nest the hierarchy too deeply can be rejected here
+      checkTest(scene.hierarchy.size() == before.hierarchy.size(), "applySceneEdit()", "a rejected edit leaves the scene untouched");
+      continue;
+    }
+    checkTest(newIndices.size() == numNodes + edit.newNodeParents.size(), "applySceneEdit()", "the index table");
+    checkHierarchy(scene, "applySceneEdit()");
+
+    // the moved and added subtrees are marked as changed
+    recalculateGlobalTransforms(scene);
+    checkGlobalTransforms(scene, "applySceneEdit()");
+  }
+
+  // rejected edits: a cycle and a too deep hierarchy
+  {
+    Scene chain;
+    for (int level = 0; level != MAX_NODE_LEVEL; level++)
+      addNode(chain, level - 1, level);
+    markAsChanged(chain, 0);
+    recalculateGlobalTransforms(chain);
+
+    const Scene before = chain;
+
+    SceneEdit cycle(chain);
+    cycle.reparentNode(1, 3);
+    checkTest(applySceneEdit(chain, cycle).empty(), "applySceneEdit()", "a node reparented into its own subtree");
+
+    SceneEdit tooDeep(chain);
+    tooDeep.addNode(MAX_NODE_LEVEL - 1);
+    checkTest(applySceneEdit(chain, tooDeep).empty(), "applySceneEdit()", "a node at MAX_NODE_LEVEL");
+
+    SceneEdit invalid(chain);
+    invalid.removeNode(MAX_NODE_LEVEL);
+    checkTest(applySceneEdit(chain, invalid).empty(), "applySceneEdit()", "an invalid node index");
+
+    checkTest(chain.hierarchy.size() == before.hierarchy.size(), "applySceneEdit()", "a rejected edit leaves the scene untouched");
+    for (size_t n = 0; n != chain.hierarchy.size(); n++)
+      checkTest(
+          chain.hierarchy[n].parent == before.hierarchy[n].parent && chain.hierarchy[n].level == before.hierarchy[n].level,
+          "applySceneEdit()", "a rejected edit leaves the scene untouched");
+
+    // moving the deepest node to a new root is fine, and the new root gets its global transform
+    SceneEdit newRoot(chain);
+    newRoot.reparentNode(MAX_NODE_LEVEL - 1, -1);
+    chain.localTransform[MAX_NODE_LEVEL - 1] = glm::translate(mat4(1.0f), vec3(5.0f));
+    checkTest(!applySceneEdit(chain, newRoot).empty(), "applySceneEdit()", "a new root");
+    checkHierarchy(chain, "applySceneEdit()");
+    recalculateGlobalTransforms(chain);
+    checkGlobalTransforms(chain, "applySceneEdit()");
+  }
+
+  printf("applySceneEdit(): passed\n");
+}
+
+// layouts with known answers: the camera at the origin looks down -Z at walls 10 units away
+void testOcclusionRasterizer() {
+  auto wall = [](std::vector<vec3>& v, float x0, float x1) {
+    const vec3 a = vec3(x0, -5.0f, -10.0f), b = vec3(x1, -5.0f, -10.0f), c = vec3(x1, 5.0f, -10.0f), d = vec3(x0, 5.0f, -10.0f);
+    v.insert(v.end(), { a, b, c, a, c, d });
+  };
+
+  struct Layout {
+    const char* name;
+    std::vector<vec3> occluders;
+    BoundingBox box;
+    bool occluded;
+  };
+
+  std::vector<vec3> oneWall, twoWalls, twoWallsWithGap;
+  wall(oneWall, -10.0f, 10.0f);
+  wall(twoWalls, -10.0f, 0.0f);
+  wall(twoWalls, 0.0f, 10.0f);
+  wall(twoWallsWithGap, -10.0f, -1.0f);
+  wall(twoWallsWithGap, 1.0f, 10.0f);
+
+  const Layout layouts[] = {
+    { "behind the wall", oneWall, BoundingBox(vec3(-1, -1, -20), vec3(1, 1, -18)), true },
+    { "far behind the wall, off-center", oneWall, BoundingBox(vec3(-15, -2, -25), vec3(-12, 2, -22)), true },
+    { "in front of the wall", oneWall, BoundingBox(vec3(-1, -1, -8), vec3(1, 1, -6)), false },
+    { "intersecting the wall", oneWall, BoundingBox(vec3(-1, -1, -11), vec3(1, 1, -9)), false },
+    { "above the wall", oneWall, BoundingBox(vec3(-1, 17, -30), vec3(1, 19, -28)), false },
+    { "partially behind the wall", oneWall, BoundingBox(vec3(18, -1, -21), vec3(26, 1, -20)), false },
+    { "behind the camera", oneWall, BoundingBox(vec3(-1, -1, 5), vec3(1, 1, 7)), false },
+    { "around the camera", oneWall, BoundingBox(vec3(-1, -1, -1), vec3(1, 1, 1)), false },
+    { "behind two adjacent walls", twoWalls, BoundingBox(vec3(-2, -1, -20), vec3(2, 1, -18)), true },
+    { "behind a gap between walls", twoWallsWithGap, BoundingBox(vec3(-0.5f, -1, -20), vec3(0.5f, 1, -18)), false },
+    { "no occluders", {}, BoundingBox(vec3(-1, -1, -20), vec3(1, 1, -18)), false },
+  };
+
+  const mat4 proj = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+  const mat4 view = glm::lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+
+  VKOcclusionRasterizer11 rasterizer(256, 128);
+
+  uint32_t numFailed = 0;
+
+  for (const Layout& l : layouts) {
+    rasterizer.setOccluders(l.occluders);
+    rasterizer.render(proj * view);
+    if (rasterizer.isOccluded(l.box) != l.occluded) {
+      printf("VKOcclusionRasterizer11: '%s', expected %s\n", l.name, l.occluded ? "occluded" : "visible");
+      numFailed++;
+    }
+  }
+
+  checkTest(numFailed == 0, "VKOcclusionRasterizer11", "synthetic layouts");
+
+  printf("VKOcclusionRasterizer11: %u synthetic layouts passed\n", (uint32_t)std::size(layouts));
+}
+
+// transforms.comp against recalculateGlobalTransforms() and BoundingBox::getTransformed(): rounds of moved subtrees, some of
+// them overlapping, on a synthetic hierarchy; the global transforms are read from a host-visible buffer, the boxes through
+// pollBoxes()
+void testSceneTransforms(const std::unique_ptr<lvk::IContext>& ctx) {
+  const char* test = "VKSceneTransforms11";
+
+  Scene scene             = createSyntheticScene(5000, 4);
+  const uint32_t numNodes = (uint32_t)scene.hierarchy.size();
+
+  MeshData meshData;
+  for (uint32_t i = 0; i != 16; i++)
+    meshData.boxes.emplace_back(vec3(-0.1f * (i + 1), -0.2f, -0.05f * i), vec3(0.3f, 0.1f * (i + 1), 0.2f));
+  // every third node has no mesh, transforms.comp skips its box
+  for (uint32_t n = 0; n != numNodes; n++)
+    if (n % 3)
+      scene.meshForNode[n] = n % 16;
+
+  markAsChanged(scene, 0);
+  recalculateGlobalTransforms(scene);
+
+  std::vector<BoundingBox> boxes(numNodes);
+  for (const auto& p : scene.meshForNode)
+    boxes[p.first] = meshData.boxes[p.second].getTransformed(scene.globalTransform[p.first]);
+
+  lvk::Holder<lvk::BufferHandle> bufferTransforms = ctx->createBuffer({
+      .usage     = lvk::BufferUsageBits_Storage,
+      .storage   = lvk::StorageType_HostVisible,
+      .size      = numNodes * sizeof(AffineTransform),
+      .data      = scene.globalTransform.data(),
+      .debugName = "Buffer: test transforms",
+  });
+  lvk::Holder<lvk::BufferHandle> bufferAABBs = ctx->createBuffer({
+      .usage     = lvk::BufferUsageBits_Storage,
+      .storage   = lvk::StorageType_Device,
+      .size      = numNodes * sizeof(BoundingBox),
+      .data      = boxes.data(),
+      .debugName = "Buffer: test AABBs",
+  });
+
+  VKSceneTransforms11 transforms(ctx, meshData, scene, bufferTransforms, bufferAABBs);
+
+  Scene reference = scene;
+
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+  // the sets and the readback slots of VKSceneTransforms11 wrap around a few times
+  for (uint32_t round = 0; round != 3 * (ctx->getNumSwapchainImages() + 1); round++) {
+    const uint32_t numMoved = 1 + rng() % 50;
+    for (uint32_t i = 0; i != numMoved; i++) {
+      const int node = int(rng() % numNodes);
+      const mat4 m   = glm::translate(mat4(1.0f), vec3(offset(rng), offset(rng), offset(rng))) *
+                     glm::rotate(mat4(1.0f), offset(rng), glm::normalize(vec3(offset(rng), offset(rng), 2.0f)));
+      scene.localTransform[node] = reference.localTransform[node] = m;
+      markAsChanged(scene, node);
+      markAsChanged(reference, node);
+    }
+    recalculateGlobalTransforms(reference);
+
+    // the GPU culling mode does not read the boxes back, the next update() with a readback copies them without moving anything
+    const bool readback = round % 3 != 2;
+    checkTest(transforms.update(scene, readback), test, "update() with moved nodes");
+    if (!readback) {
+      checkTest(transforms.areBoxesOutdated(), test, "the boxes are outdated without a readback");
+      checkTest(!transforms.update(scene, true), test, "update() without moved nodes");
+    }
+    checkTest(!transforms.areBoxesOutdated(), test, "the boxes are copied");
+
+    // waits for the device to be idle
+    ctx->wait({});
+
+    checkTest(transforms.pollBoxes(boxes), test, "pollBoxes() after the update has finished");
+    checkTest(!transforms.pollBoxes(boxes), test, "pollBoxes() returns every readback once");
+
+    std::vector<AffineTransform> global(numNodes);
+    ctx->download(bufferTransforms, global.data(), numNodes * sizeof(AffineTransform), 0);
+    for (uint32_t n = 0; n != numNodes; n++)
+      for (int r = 0; r != 3; r++)
+        checkTest(glm::length(global[n].rows[r] - reference.globalTransform[n].rows[r]) < 1e-3f, test, "global transforms");
+
+    for (const auto& p : reference.meshForNode) {
+      const BoundingBox box = meshData.boxes[p.second].getTransformed(reference.globalTransform[p.first]);
+      checkTest(
+          glm::length(boxes[p.first].min_ - box.min_) < 1e-3f && glm::length(boxes[p.first].max_ - box.max_) < 1e-3f, test,
+          "world-space boxes");
+    }
+  }
+
+  printf("VKSceneTransforms11: passed\n");
+}
+#endif // runSelfTests
+
+#if defined(fileNameCachedContainer) && defined(benchmarkCachedContainer)
+// writes the scene into a raw and an encoded container and compares bytes read and wall-clock load times
+void benchmarkBistroCache(const MeshData& meshData, const Scene& scene, uint32_t numIterations = 5) {
+  const std::string fileNameRaw     = std::string(fileNameCachedContainer) + ".raw";
+  const std::string fileNameEncoded = std::string(fileNameCachedContainer) + ".encoded";
+
+  saveMeshCache(fileNameRaw.c_str(), meshData, scene, false);
+  saveMeshCache(fileNameEncoded.c_str(), meshData, scene, true);
+
+  auto benchmark = [numIterations](const std::string& fileName, bool mapMeshData) {
+    FILE* f                = fopen(fileName.c_str(), "rb");
+    const int64_t fileSize = f ? getFileSize64(f) : 0;
+    if (f)
+      fclose(f);
+
+    uint64_t checksum        = 0;
+    const BenchmarkTime time = measureTime(numIterations, [&](uint32_t) {
+      MeshData md;
+      Scene s;
+      loadMeshCache(fileName.c_str(), md, s, mapMeshData);
+      // touch the geometry, so the mapped variant pays for its page faults as well
+      for (uint32_t idx : md.getIndexData())
+        checksum += idx;
+      for (size_t v = 0; v < md.getVertexData().size(); v += 4096)
+        checksum += md.getVertexData()[v];
+    });
+
+    printf(
+        "  %-40s %s: %8.1f MB read, avg %8.2f ms, min %8.2f ms (checksum %llu)\n", fileName.c_str(), mapMeshData ? "mapped" : "copied",
+        double(fileSize) / (1024.0 * 1024.0), time.avgMs, time.minMs, (unsigned long long)checksum);
+  };
+
+  printf("Mesh cache benchmark (%u iterations, warm file cache):\n", numIterations);
+  benchmark(fileNameRaw, false);
+  benchmark(fileNameRaw, true);
+  benchmark(fileNameEncoded, false);
+  benchmark(fileNameEncoded, true);
+}
+#endif
+
+#if defined(benchmarkSceneTransforms)
+// compares recalculateGlobalTransforms() against the level-parallel version, with and without the SIMD kernel
+void benchmarkGlobalTransforms(const Scene& scene, const char* name, uint32_t numIterations = 10) {
+  tf::Executor executor;
+
+  Scene reference = scene;
+  markAsChanged(reference, 0);
+  recalculateGlobalTransforms(reference);
+
+  auto benchmark = [&](const char* variant, auto&& recalculate) {
+    Scene s                  = scene;
+    const BenchmarkTime time = measureTime(numIterations, [&s](uint32_t) { markAsChanged(s, 0); }, [&](uint32_t) { recalculate(s); });
+    float maxError           = 0.0f;
+    for (size_t n = 0; n != s.globalTransform.size(); n++)
+      for (int r = 0; r != 3; r++)
+        for (int c = 0; c != 4; c++)
+          maxError = std::max(maxError, std::abs(s.globalTransform[n].rows[r][c] - reference.globalTransform[n].rows[r][c]));
+    printf("  %-20s avg %8.3f ms, min %8.3f ms, max error %g\n", variant, time.avgMs, time.minMs, maxError);
+  };
+
+  printf(
+      "Global transforms benchmark: %s, %u nodes, %u threads, %u iterations\n", name, (uint32_t)scene.hierarchy.size(),
+      (uint32_t)executor.num_workers(), numIterations);
+  benchmark("serial", [](Scene& s) { recalculateGlobalTransforms(s); });
+  benchmark("parallel", [&executor](Scene& s) { recalculateGlobalTransformsParallel(s, executor, false); });
+  benchmark("parallel + SIMD", [&executor](Scene& s) { recalculateGlobalTransformsParallel(s, executor, true); });
+}
+#endif
+
+#if defined(benchmarkSceneComponents)
+// compares NodeComponentMap against the std::unordered_map it replaced: a walk over all pairs and a lookup of every node
+void benchmarkNodeComponents(const Scene& scene, uint32_t numIterations = 10) {
+  const std::unordered_map<uint32_t, uint32_t> hashMap(scene.meshForNode.begin(), scene.meshForNode.end());
+  const NodeComponentMap& denseMap = scene.meshForNode;
+  const uint32_t numNodes          = (uint32_t)scene.hierarchy.size();
+
+  auto benchmark = [numIterations](const char* name, auto&& run) {
+    uint64_t checksum        = 0;
+    const BenchmarkTime time = measureTime(numIterations, [&](uint32_t) { checksum += run(); });
+    printf("  %-32s min %8.3f ms (checksum %llu)\n", name, time.minMs, (unsigned long long)checksum);
+  };
+
+  printf("Scene component benchmark: %u nodes, %u meshes, %u iterations\n", numNodes, (uint32_t)denseMap.size(), numIterations);
+  benchmark("iterate std::unordered_map", [&hashMap]() {
+    uint64_t sum = 0;
+    for (const auto& p : hashMap)
+      sum += p.first ^ p.second;
+    return sum;
+  });
+  benchmark("iterate NodeComponentMap", [&denseMap]() {
+    uint64_t sum = 0;
+    for (const auto& p : denseMap)
+      sum += p.first ^ p.second;
+    return sum;
+  });
+  benchmark("lookup std::unordered_map", [&hashMap, numNodes]() {
+    uint64_t sum = 0;
+    for (uint32_t n = 0; n != numNodes; n++) {
+      const auto it = hashMap.find(n);
+      if (it != hashMap.end())
+        sum += it->second;
+    }
+    return sum;
+  });
+  benchmark("lookup NodeComponentMap", [&denseMap, numNodes]() {
+    uint64_t sum = 0;
+    for (uint32_t n = 0; n != numNodes; n++) {
+      if (denseMap.contains(n))
+        sum += denseMap.at(n);
+    }
+    return sum;
+  });
+}
+#endif
+
+#if defined(benchmarkSceneNodeOrder)
+// marks all the roots, so the next recalculateGlobalTransforms() updates every node
+void markAllAsChanged(Scene& scene) {
+  for (int n = 0; n != (int)scene.hierarchy.size(); n++)
+    if (scene.hierarchy[n].parent == -1)
+      markAsChanged(scene, n);
+}
+
+// Misses of a direct-mapped cache (32 Kb, 64-byte lines) over the memory accesses of recalculateGlobalTransforms().
+// A rough model, but it does not depend on the hardware counters being available
+uint64_t countTransformCacheMisses(const Scene& scene) {
+  constexpr uintptr_t kLineSize = 64;
+  std::vector<uintptr_t> lines(32 * 1024 / kLineSize);
+
+  uint64_t misses = 0;
+
+  auto access = [&lines, &misses](const void* ptr, size_t size) {
+    for (uintptr_t line = uintptr_t(ptr) / kLineSize; line <= (uintptr_t(ptr) + size - 1) / kLineSize; line++) {
+      uintptr_t& cached = lines[line % lines.size()];
+      if (cached != line) {
+        cached = line;
+        misses++;
+      }
+    }
+  };
+
+  Scene s = scene;
+  markAllAsChanged(s);
+
+  for (const std::vector<int>& nodes : s.changedAtThisFrame) {
+    for (int c : nodes) {
+      access(&s.hierarchy[c], sizeof(Hierarchy));
+      if (s.hierarchy[c].parent >= 0)
+        access(&s.globalTransform[s.hierarchy[c].parent], sizeof(AffineTransform));
+      access(&s.localTransform[c], sizeof(AffineTransform));
+      access(&s.globalTransform[c], sizeof(AffineTransform));
+    }
+  }
+
+  return misses;
+}
+
+// the scene as loaded, a random node order, and the same random order after reorderSceneNodes()
+void benchmarkNodeOrder(const Scene& scene, uint32_t numIterations = 10) {
+  std::vector<int> order(scene.hierarchy.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+
+  Scene shuffled = scene;
+  permuteSceneNodes(shuffled, order);
+
+  Scene reordered = shuffled;
+  reorderSceneNodes(reordered);
+
+  auto benchmark = [numIterations](const char* name, const Scene& s) {
+    Scene copy;
+    const BenchmarkTime time = measureTime(
+        numIterations,
+        [&](uint32_t) {
+          copy = s;
+          markAllAsChanged(copy);
+        },
+        [&copy](uint32_t) { recalculateGlobalTransforms(copy); });
+    printf("  %-12s min %8.3f ms, simulated cache misses %9llu\n", name, time.minMs, (unsigned long long)countTransformCacheMisses(s));
+  };
+
+  printf(
+      "Scene node order benchmark: %u nodes, %u meshes, %u iterations\n", (uint32_t)scene.hierarchy.size(),
+      (uint32_t)scene.meshForNode.size(), numIterations);
+  benchmark("as loaded", scene);
+  benchmark("shuffled", shuffled);
+  benchmark("reordered", reordered);
+}
+#endif
+
+#if defined(benchmarkFrustumCulling)
+// culls the world-space boxes of all the mesh nodes from a ring of cameras around the scene, serially with isBoxInFrustum()
+// and with VKFrustumCuller11, and counts the boxes where the two disagree
+void benchmarkCulling(const MeshData& meshData, const Scene& scene, uint32_t numViews = 32, uint32_t numIterations = 10) {
+  const std::vector<BoundingBox> boxes = getMeshNodeBoxes(meshData, scene);
+
+  std::vector<DrawIndexedIndirectCommand> commands(boxes.size());
+  for (uint32_t i = 0; i != commands.size(); i++)
+    commands[i] = { .instanceCount = 1, .baseInstance = i };
+
+  struct Frustum {
+    vec4 planes[6];
+    vec4 corners[8];
+  };
+  std::vector<Frustum> frustums;
+  for (const mat4& viewProj : getBenchmarkViews(boxes, numViews)) {
+    Frustum& f = frustums.emplace_back();
+    getFrustumPlanes(viewProj, f.planes);
+    getFrustumCorners(viewProj, f.corners);
+  }
+
+  VKFrustumCuller11 culler;
+  culler.setCommands(commands, [&boxes](const DrawIndexedIndirectCommand& c) -> const BoundingBox& { return boxes[c.baseInstance]; });
+
+  std::vector<uint8_t> reference(boxes.size());
+
+  uint64_t numVisible    = 0;
+  uint64_t numMismatches = 0;
+
+  for (Frustum& f : frustums) {
+    numVisible += culler.test(f.planes, f.corners);
+    for (size_t b = 0; b != boxes.size(); b++)
+      numMismatches += isBoxInFrustum(f.planes, f.corners, boxes[b]) != culler.isVisible(b) ? 1 : 0;
+  }
+
+  const BenchmarkTime serial = measureTime(numIterations, [&](uint32_t) {
+    for (Frustum& f : frustums)
+      for (size_t b = 0; b != boxes.size(); b++)
+        reference[b] = isBoxInFrustum(f.planes, f.corners, boxes[b]) ? 1 : 0;
+  });
+  const BenchmarkTime parallel = measureTime(numIterations, [&](uint32_t) {
+    for (Frustum& f : frustums)
+      culler.test(f.planes, f.corners);
+  });
+
+  printf(
+      "Frustum culling benchmark: %u boxes, %u views, %u threads, %u iterations (min time of all the views)\n", (uint32_t)boxes.size(),
+      numViews, (uint32_t)culler.getNumThreads(), numIterations);
+  printf("  %-20s %8.3f ms\n", "isBoxInFrustum()", serial.minMs);
+  printf("  %-20s %8.3f ms, %.1f%% visible, %llu mismatches\n", "VKFrustumCuller11", parallel.minMs,
+      boxes.empty() ? 0.0 : 100.0 * double(numVisible) / double(boxes.size() * numViews), (unsigned long long)numMismatches);
+}
+#endif
+
+#if defined(benchmarkOcclusionCulling)
+// renders the automatically selected Bistro occluders from a ring of cameras around the scene and tests the boxes of all the
+// mesh nodes inside the frustum against them
+void benchmarkOcclusion(const MeshData& meshData, const Scene& scene, uint32_t numViews = 32, uint32_t numIterations = 10) {
+  const std::vector<BoundingBox> boxes = getMeshNodeBoxes(meshData, scene);
+
+  VKOcclusionRasterizer11 rasterizer;
+  rasterizer.setOccluders(selectOccluders(meshData, scene, [](uint32_t) { return false; }));
+
+  double renderMs = 0.0;
+  double testMs   = 0.0;
+
+  uint64_t numInFrustum = 0;
+  uint64_t numOccluded  = 0;
+
+  for (const mat4& viewProj : getBenchmarkViews(boxes, numViews)) {
+    vec4 planes[6];
+    vec4 corners[8];
+    getFrustumPlanes(viewProj, planes);
+    getFrustumCorners(viewProj, corners);
+
+    std::vector<const BoundingBox*> inFrustum;
+    for (const BoundingBox& b : boxes)
+      if (isBoxInFrustum(planes, corners, b))
+        inFrustum.push_back(&b);
+
+    renderMs += measureTime(numIterations, [&](uint32_t) { rasterizer.render(viewProj); }).minMs;
+
+    uint32_t occluded = 0;
+    testMs += measureTime(numIterations, [&](uint32_t) {
+                occluded = 0;
+                for (const BoundingBox* b : inFrustum)
+                  occluded += rasterizer.isOccluded(*b) ? 1 : 0;
+              }).minMs;
+
+    numInFrustum += inFrustum.size();
+    numOccluded += occluded;
+  }
+
+  printf(
+      "Occlusion culling benchmark: %u occluder triangles, %ux%u pixels, %u threads, %u views, %u iterations (sum of the min times of "
+      "the views)\n",
+      rasterizer.getNumTriangles(), rasterizer.getWidth(), rasterizer.getHeight(), (uint32_t)rasterizer.getNumThreads(), numViews,
+      numIterations);
+  printf("  %-20s %8.3f ms\n", "render()", renderMs);
+  printf("  %-20s %8.3f ms, %.1f%% of the boxes inside the frustum are occluded\n", "isOccluded()", testMs,
+      numInFrustum ? 100.0 * double(numOccluded) / double(numInFrustum) : 0.0);
+}
+#endif
+
+void runBistroTests() {
+#if defined(runSelfTests)
+  testMarkAsChanged();
+  testSceneEdit();
+  testOcclusionRasterizer();
+#endif
+}
+
+// the self-checks which need a Vulkan context
+void runBistroGPUTests(const std::unique_ptr<lvk::IContext>& ctx) {
+#if defined(runSelfTests)
+  testSceneTransforms(ctx);
+#endif
+}
+
+// the Bistro has to be loaded, and its mesh data has to stay mapped if it was loaded with mapMeshData
+void runBistroBenchmarks(const MeshData& meshData, const Scene& scene) {
+#if defined(fileNameCachedContainer) && defined(benchmarkCachedContainer)
+  benchmarkBistroCache(meshData, scene);
+#endif
+
+#if defined(benchmarkSceneTransforms)
+  benchmarkGlobalTransforms(createSyntheticScene(1000000), "synthetic");
+  benchmarkGlobalTransforms(scene, "Bistro");
+#endif
+
+#if defined(benchmarkSceneComponents)
+  benchmarkNodeComponents(scene);
+#endif
+
+#if defined(benchmarkSceneNodeOrder)
+  benchmarkNodeOrder(scene);
+#endif
+
+#if defined(benchmarkFrustumCulling)
+  benchmarkCulling(meshData, scene);
+#endif
+
+#if defined(benchmarkOcclusionCulling)
+  benchmarkOcclusion(meshData, scene);
+#endif
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Chapter11/VKMesh11.h"
+
+// Hierarchical depth buffer for the occlusion culling (see FrustumCulling.comp). Level 0 has the largest power-of-two size not
+// exceeding the depth texture, so every next level is exactly half of the previous one. Each texel keeps the farthest depth of
+// the area it covers: a box whose nearest depth is farther than that is hidden behind what has been drawn
+class VKDepthPyramid11 final
+{
+public:
+  static constexpr uint32_t kMaxLevels = 16;
+
+  VKDepthPyramid11(const std::unique_ptr<lvk::IContext>& ctx, const lvk::Dimensions& depthSize)
+  : depthSize_(depthSize)
+  {
+    auto previousPow2 = [](uint32_t v) {
+      uint32_t p = 1;
+      while (p * 2 <= v)
+        p *= 2;
+      return p;
+    };
+
+    width_  = previousPow2(std::max(depthSize.width, 1u));
+    height_ = previousPow2(std::max(depthSize.height, 1u));
+
+    while (numLevels_ < kMaxLevels && (std::max(width_, height_) >> numLevels_))
+      numLevels_++;
+
+    texPyramid_ = ctx->createTexture(
+        { .format       = lvk::Format_R_F32,
+          .dimensions   = { width_, height_ },
+          .usage        = lvk::TextureUsageBits_Sampled | lvk::TextureUsageBits_Storage,
+          .numMipLevels = numLevels_,
+          .debugName    = "Texture: depth pyramid" });
+
+    // the shaders write and read the levels as separate storage images
+    for (uint32_t i = 0; i != numLevels_; i++)
+      levels_.push_back(ctx->createTextureView(texPyramid_, { .mipLevel = i, .numMipLevels = 1 }, "Texture: depth pyramid level"));
+
+    comp_     = loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/depthPyramid.comp");
+    pipeline_ = ctx->createComputePipeline({
+        .smComp = comp_,
+    });
+  }
+
+  // texDepthMS has to be a multisampled depth texture of depthSize with sampled usage, level 0 keeps the farthest of its samples
+  void build(lvk::ICommandBuffer& buf, lvk::TextureHandle texDepthMS, uint32_t numSamples) const
+  {
+    buf.cmdBindComputePipeline(pipeline_);
+
+    for (uint32_t i = 0; i != numLevels_; i++) {
+      const struct {
+        uint32_t texIn;
+        uint32_t texOut;
+        uint32_t level;
+        uint32_t numSamples;
+        int32_t sizeIn[2];
+        int32_t sizeOut[2];
+      } pc = {
+        .texIn      = i ? levels_[i - 1].index() : texDepthMS.index(),
+        .texOut     = levels_[i].index(),
+        .level      = i,
+        .numSamples = numSamples,
+        .sizeIn     = { (int32_t)(i ? getLevelWidth(i - 1) : depthSize_.width), (int32_t)(i ? getLevelHeight(i - 1) : depthSize_.height) },
+        .sizeOut    = { (int32_t)getLevelWidth(i), (int32_t)getLevelHeight(i) },
+      };
+      buf.cmdPushConstants(pc);
+      // the barriers of the whole pyramid make the previous level visible
+      buf.cmdDispatchThreadGroups(
+          { 1 + (getLevelWidth(i) - 1) / 16, 1 + (getLevelHeight(i) - 1) / 16 }, { .textures = { texDepthMS, texPyramid_ } });
+    }
+  }
+
+  lvk::TextureHandle getTexture() const { return texPyramid_; }
+  // bindless indices of the storage views of all the levels
+  uint32_t getLevelIndex(uint32_t level) const { return levels_[level].index(); }
+
+  uint32_t getWidth() const { return width_; }
+  uint32_t getHeight() const { return height_; }
+  uint32_t getNumLevels() const { return numLevels_; }
+  uint32_t getLevelWidth(uint32_t level) const { return std::max(width_ >> level, 1u); }
+  uint32_t getLevelHeight(uint32_t level) const { return std::max(height_ >> level, 1u); }
+
+private:
+  lvk::Dimensions depthSize_;
+
+  uint32_t width_     = 1;
+  uint32_t height_    = 1;
+  uint32_t numLevels_ = 0;
+
+  lvk::Holder<lvk::TextureHandle> texPyramid_;
+  std::vector<lvk::Holder<lvk::TextureHandle>> levels_;
+  lvk::Holder<lvk::ShaderModuleHandle> comp_;
+  lvk::Holder<lvk::ComputePipelineHandle> pipeline_;
+};
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "Chapter11/VKMesh11.h"
+
+#include <bit>
+#include <thread>
+
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX 1
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define FRUSTUM_CULLER_NEON 1
+#endif
+
+// CPU frustum culling of the draw commands. The world-space boxes are kept as separate center/extent arrays (one entry per
+// command, padded to a multiple of 8) and tested 8 at a time: a box is outside a plane if dot(n, center) + d + dot(|n|, extent) < 0,
+// which gives the same result as the 8 corners of isBoxInFrustum(). A batch stops as soon as all its 8 boxes are outside.
+// The commands are split into fixed ranges processed by the worker threads. The first pass counts the visible boxes of every
+// range, the second pass writes the visible commands of each range straight into the mapped indirect buffer at the offset
+// given by the prefix sum of these counts, so the output keeps the order of the input commands
+class VKFrustumCuller11 final
+{
+public:
+  static constexpr uint32_t kBatchSize     = 8;
+  static constexpr uint32_t kBoxesPerRange = 2048; // a multiple of kBatchSize
+
+  explicit VKFrustumCuller11(size_t numThreads = std::thread::hardware_concurrency())
+  : executor_(std::max(numThreads, size_t(1)))
+  {
+  }
+
+  // getBox(const DrawIndexedIndirectCommand&) returns the world-space box of a command
+  template <typename GetBox> void setCommands(const std::vector<DrawIndexedIndirectCommand>& commands, GetBox&& getBox)
+  {
+    commands_ = commands;
+
+    const size_t numCommands = commands_.size();
+    const size_t numPadded   = (numCommands + kBatchSize - 1) / kBatchSize * kBatchSize;
+
+    for (std::vector<float>* v : { &centerX_, &centerY_, &centerZ_, &extentX_, &extentY_, &extentZ_ })
+      v->assign(numPadded, 0.0f);
+
+    for (size_t i = 0; i != numCommands; i++) {
+      const BoundingBox& box = getBox(commands_[i]);
+      const vec3 center      = 0.5f * (box.min_ + box.max_);
+      const vec3 extent      = 0.5f * (box.max_ - box.min_);
+      centerX_[i]            = center.x;
+      centerY_[i]            = center.y;
+      centerZ_[i]            = center.z;
+      extentX_[i]            = extent.x;
+      extentY_[i]            = extent.y;
+      extentZ_[i]            = extent.z;
+    }
+
+    // everything is visible until the first cull()
+    visible_.assign(numCommands, 1);
+    numVisible_ = (uint32_t)numCommands;
+
+    const uint32_t numRanges = (uint32_t)((numCommands + kBoxesPerRange - 1) / kBoxesPerRange);
+    rangeCounts_.assign(numRanges, 0);
+    rangeOffsets_.assign(numRanges, 0);
+  }
+
+  // Culls the commands against the frustum and writes them into the mapped (host-visible) indirect buffer dst.
+  // compact: only the visible commands are written, the number of commands in the beginning of the buffer and dst.drawCommands_
+  // are updated. Otherwise, all the commands are written in place with instanceCount = 0 for the invisible ones.
+  // onVisible(DrawIndexedIndirectCommand&) can modify the visible commands (LOD selection); it is called from the worker threads.
+  // Returns the number of visible commands
+  template <typename OnVisible>
+  uint32_t cull(const vec4* frustumPlanes, const vec4* frustumCorners, VKIndirectBuffer11& dst, bool compact, OnVisible&& onVisible)
+  {
+    return cull(frustumPlanes, frustumCorners, dst, compact, onVisible, [](uint32_t) { return false; });
+  }
+
+  // isOccluded(i) is called from the worker threads for the commands inside the frustum, the occluded ones are culled too
+  template <typename OnVisible, typename IsOccluded>
+  uint32_t cull(
+      const vec4* frustumPlanes, const vec4* frustumCorners, VKIndirectBuffer11& dst, bool compact, OnVisible&& onVisible,
+      IsOccluded&& isOccluded)
+  {
+    LVK_ASSERT(dst.ctx_->getMappedPtr(dst.bufferIndirect_));
+
+    DrawIndexedIndirectCommand* out = dst.getDrawIndexedIndirectCommandPtr();
+
+    const uint32_t numCommands = (uint32_t)commands_.size();
+
+    if (compact) {
+      run(
+          frustumPlanes, frustumCorners, isOccluded, [&dst](uint32_t numVisible) { dst.drawCommands_.resize(numVisible); },
+          [this, out, &dst, &onVisible](uint32_t begin, uint32_t end, uint32_t offset) {
+            for (uint32_t i = begin; i != end; i++) {
+              if (!visible_[i])
+                continue;
+              DrawIndexedIndirectCommand cmd = commands_[i];
+              onVisible(cmd);
+              dst.drawCommands_[offset] = cmd;
+              out[offset++]             = cmd;
+            }
+          });
+      *reinterpret_cast<uint32_t*>(dst.ctx_->getMappedPtr(dst.bufferIndirect_)) = numVisible_;
+      dst.ctx_->flushMappedMemory(dst.bufferIndirect_, 0, sizeof(uint32_t) + numVisible_ * sizeof(DrawIndexedIndirectCommand));
+    } else {
+      LVK_ASSERT(dst.drawCommands_.size() == numCommands);
+      run(
+          frustumPlanes, frustumCorners, isOccluded, [](uint32_t) {},
+          [this, out, &onVisible](uint32_t begin, uint32_t end, uint32_t) {
+            for (uint32_t i = begin; i != end; i++) {
+              DrawIndexedIndirectCommand cmd = commands_[i];
+              if (visible_[i])
+                onVisible(cmd);
+              else
+                cmd.instanceCount = 0;
+              out[i] = cmd;
+            }
+          });
+      dst.ctx_->flushMappedMemory(dst.bufferIndirect_, 0, sizeof(uint32_t) + numCommands * sizeof(DrawIndexedIndirectCommand));
+    }
+
+    return numVisible_;
+  }
+
+  // only classifies the boxes (see isVisible()), returns the number of visible ones
+  uint32_t test(const vec4* frustumPlanes, const vec4* frustumCorners)
+  {
+    run(frustumPlanes, frustumCorners, [](uint32_t) { return false; }, [](uint32_t) {}, [](uint32_t, uint32_t, uint32_t) {});
+    return numVisible_;
+  }
+
+  // the result of the last cull() for the i-th command passed to setCommands()
+  bool isVisible(size_t i) const { return visible_[i] != 0; }
+
+  // the world-space box of the i-th command passed to setCommands()
+  BoundingBox getBox(size_t i) const
+  {
+    const vec3 center = vec3(centerX_[i], centerY_[i], centerZ_[i]);
+    const vec3 extent = vec3(extentX_[i], extentY_[i], extentZ_[i]);
+    return BoundingBox(center - extent, center + extent);
+  }
+
+  size_t getNumCommands() const { return commands_.size(); }
+  size_t getNumThreads() const { return executor_.num_workers(); }
+
+private:
+  // prepare(numVisible) runs after the first pass, write(begin, end, firstOutput) once per range in the second pass
+  template <typename IsOccluded, typename Prepare, typename Write>
+  void run(const vec4* frustumPlanes, const vec4* frustumCorners, IsOccluded&& isOccluded, Prepare&& prepare, Write&& write)
+  {
+    setFrustum(frustumPlanes, frustumCorners);
+
+    const uint32_t numCommands = (uint32_t)commands_.size();
+    const uint32_t numRanges   = (uint32_t)rangeCounts_.size();
+
+    tf::Taskflow taskflow;
+
+    tf::Task testBoxes = taskflow.for_each_index(0u, numRanges, 1u, [this, numCommands, &isOccluded](uint32_t r) {
+      rangeCounts_[r] = testRange(r * kBoxesPerRange, std::min((r + 1) * kBoxesPerRange, numCommands), isOccluded);
+    });
+    tf::Task prefixSum = taskflow.emplace([this, numRanges, &prepare]() {
+      uint32_t numVisible = 0;
+      for (uint32_t r = 0; r != numRanges; r++) {
+        rangeOffsets_[r] = numVisible;
+        numVisible += rangeCounts_[r];
+      }
+      numVisible_ = numVisible;
+      prepare(numVisible);
+    });
+    tf::Task writeCommands = taskflow.for_each_index(0u, numRanges, 1u, [this, numCommands, &write](uint32_t r) {
+      write(r * kBoxesPerRange, std::min((r + 1) * kBoxesPerRange, numCommands), rangeOffsets_[r]);
+    });
+
+    testBoxes.precede(prefixSum);
+    prefixSum.precede(writeCommands);
+
+    executor_.run(taskflow).wait();
+  }
+
+  void setFrustum(const vec4* frustumPlanes, const vec4* frustumCorners)
+  {
+    for (int p = 0; p != 6; p++) {
+      planes_[p]    = frustumPlanes[p];
+      absPlanes_[p] = glm::abs(frustumPlanes[p]);
+    }
+    // isBoxInFrustum() also rejects the boxes which have all the frustum corners on the outer side of one of their faces
+    frustumMin_ = vec3(frustumCorners[0]);
+    frustumMax_ = vec3(frustumCorners[0]);
+    for (int i = 1; i != 8; i++) {
+      frustumMin_ = glm::min(frustumMin_, vec3(frustumCorners[i]));
+      frustumMax_ = glm::max(frustumMax_, vec3(frustumCorners[i]));
+    }
+  }
+
+  // updates visible_[begin..end) and returns the number of visible boxes, begin is a multiple of kBatchSize
+  template <typename IsOccluded> uint32_t testRange(uint32_t begin, uint32_t end, IsOccluded&& isOccluded)
+  {
+    uint32_t numVisible = 0;
+    for (uint32_t i = begin; i < end; i += kBatchSize) {
+      uint32_t mask = testBatch(i);
+      if (end - i < kBatchSize)
+        mask &= (1u << (end - i)) - 1; // the padding
+      for (uint32_t m = mask; m; m &= m - 1) {
+        const uint32_t j = (uint32_t)std::countr_zero(m);
+        if (isOccluded(i + j))
+          mask &= ~(1u << j);
+      }
+      const uint32_t n = std::min(end - i, kBatchSize);
+      for (uint32_t j = 0; j != n; j++)
+        visible_[i + j] = (mask >> j) & 1;
+      numVisible += std::popcount(mask);
+    }
+    return numVisible;
+  }
+
+  // returns a bit mask of the visible boxes i..i+7
+  uint32_t testBatch(uint32_t i) const
+  {
+#if defined(FRUSTUM_CULLER_AVX)
+    const __m256 cx   = _mm256_loadu_ps(&centerX_[i]);
+    const __m256 cy   = _mm256_loadu_ps(&centerY_[i]);
+    const __m256 cz   = _mm256_loadu_ps(&centerZ_[i]);
+    const __m256 ex   = _mm256_loadu_ps(&extentX_[i]);
+    const __m256 ey   = _mm256_loadu_ps(&extentY_[i]);
+    const __m256 ez   = _mm256_loadu_ps(&extentZ_[i]);
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 visible = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ); // all ones
+
+    for (int p = 0; p != 6; p++) {
+      const vec4& n = planes_[p];
+      const vec4& a = absPlanes_[p];
+      const __m256 dist =
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(n.x), cx), _mm256_mul_ps(_mm256_set1_ps(n.y), cy)),
+              _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(n.z), cz), _mm256_set1_ps(n.w)));
+      const __m256 radius =
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a.x), ex), _mm256_mul_ps(_mm256_set1_ps(a.y), ey)),
+              _mm256_mul_ps(_mm256_set1_ps(a.z), ez));
+      visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GE_OQ));
+      if (!_mm256_movemask_ps(visible))
+        return 0;
+    }
+
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(cx, ex), _mm256_set1_ps(frustumMin_.x), _CMP_GE_OQ));
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(cy, ey), _mm256_set1_ps(frustumMin_.y), _CMP_GE_OQ));
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(cz, ez), _mm256_set1_ps(frustumMin_.z), _CMP_GE_OQ));
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_sub_ps(cx, ex), _mm256_set1_ps(frustumMax_.x), _CMP_LE_OQ));
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_sub_ps(cy, ey), _mm256_set1_ps(frustumMax_.y), _CMP_LE_OQ));
+    visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_sub_ps(cz, ez), _mm256_set1_ps(frustumMax_.z), _CMP_LE_OQ));
+
+    return (uint32_t)_mm256_movemask_ps(visible);
+#elif defined(FRUSTUM_CULLER_SSE) || defined(FRUSTUM_CULLER_NEON)
+    // two halves of 4 boxes
+    const uint32_t lo = testBatch4(i);
+    return lo | (testBatch4(i + 4) << 4);
+#else
+    uint32_t mask = 0;
+    for (uint32_t j = 0; j != kBatchSize; j++) {
+      const vec3 c = vec3(centerX_[i + j], centerY_[i + j], centerZ_[i + j]);
+      const vec3 e = vec3(extentX_[i + j], extentY_[i + j], extentZ_[i + j]);
+      bool visible = c.x + e.x >= frustumMin_.x && c.y + e.y >= frustumMin_.y && c.z + e.z >= frustumMin_.z && c.x - e.x <= frustumMax_.x &&
+                     c.y - e.y <= frustumMax_.y && c.z - e.z <= frustumMax_.z;
+      for (int p = 0; p != 6 && visible; p++)
+        visible = glm::dot(vec3(planes_[p]), c) + planes_[p].w + glm::dot(vec3(absPlanes_[p]), e) >= 0.0f;
+      mask |= visible ? (1u << j) : 0u;
+    }
+    return mask;
+#endif
+  }
+
+#if defined(FRUSTUM_CULLER_SSE)
+  uint32_t testBatch4(uint32_t i) const
+  {
+    const __m128 cx   = _mm_loadu_ps(&centerX_[i]);
+    const __m128 cy   = _mm_loadu_ps(&centerY_[i]);
+    const __m128 cz   = _mm_loadu_ps(&centerZ_[i]);
+    const __m128 ex   = _mm_loadu_ps(&extentX_[i]);
+    const __m128 ey   = _mm_loadu_ps(&extentY_[i]);
+    const __m128 ez   = _mm_loadu_ps(&extentZ_[i]);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 visible = _mm_cmpeq_ps(zero, zero); // all ones
+
+    for (int p = 0; p != 6; p++) {
+      const vec4& n = planes_[p];
+      const vec4& a = absPlanes_[p];
+      const __m128 dist = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(n.x), cx), _mm_mul_ps(_mm_set1_ps(n.y), cy)),
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(n.z), cz), _mm_set1_ps(n.w)));
+      const __m128 radius = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.x), ex), _mm_mul_ps(_mm_set1_ps(a.y), ey)), _mm_mul_ps(_mm_set1_ps(a.z), ez));
+      visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+      if (!_mm_movemask_ps(visible))
+        return 0;
+    }
+
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(cx, ex), _mm_set1_ps(frustumMin_.x)));
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(cy, ey), _mm_set1_ps(frustumMin_.y)));
+    visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(cz, ez), _mm_set1_ps(frustumMin_.z)));
+    visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(cx, ex), _mm_set1_ps(frustumMax_.x)));
+    visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(cy, ey), _mm_set1_ps(frustumMax_.y)));
+    visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(cz, ez), _mm_set1_ps(frustumMax_.z)));
+
+    return (uint32_t)_mm_movemask_ps(visible);
+  }
+#elif defined(FRUSTUM_CULLER_NEON)
+  uint32_t testBatch4(uint32_t i) const
+  {
+    const float32x4_t cx = vld1q_f32(&centerX_[i]);
+    const float32x4_t cy = vld1q_f32(&centerY_[i]);
+    const float32x4_t cz = vld1q_f32(&centerZ_[i]);
+    const float32x4_t ex = vld1q_f32(&extentX_[i]);
+    const float32x4_t ey = vld1q_f32(&extentY_[i]);
+    const float32x4_t ez = vld1q_f32(&extentZ_[i]);
+
+    uint32x4_t visible = vdupq_n_u32(0xFFFFFFFF);
+
+    for (int p = 0; p != 6; p++) {
+      const vec4& n            = planes_[p];
+      const vec4& a            = absPlanes_[p];
+      const float32x4_t dist   = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(n.w), cx, n.x), cy, n.y), cz, n.z);
+      const float32x4_t radius = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(ex, a.x), ey, a.y), ez, a.z);
+      visible                  = vandq_u32(visible, vcgeq_f32(vaddq_f32(dist, radius), vdupq_n_f32(0.0f)));
+      if (!vmaxvq_u32(visible))
+        return 0;
+    }
+
+    visible = vandq_u32(visible, vcgeq_f32(vaddq_f32(cx, ex), vdupq_n_f32(frustumMin_.x)));
+    visible = vandq_u32(visible, vcgeq_f32(vaddq_f32(cy, ey), vdupq_n_f32(frustumMin_.y)));
+    visible = vandq_u32(visible, vcgeq_f32(vaddq_f32(cz, ez), vdupq_n_f32(frustumMin_.z)));
+    visible = vandq_u32(visible, vcleq_f32(vsubq_f32(cx, ex), vdupq_n_f32(frustumMax_.x)));
+    visible = vandq_u32(visible, vcleq_f32(vsubq_f32(cy, ey), vdupq_n_f32(frustumMax_.y)));
+    visible = vandq_u32(visible, vcleq_f32(vsubq_f32(cz, ez), vdupq_n_f32(frustumMax_.z)));
+
+    const uint32_t bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(visible, vld1q_u32(bits)));
+  }
+#endif
+
+private:
+  tf::Executor executor_;
+
+  std::vector<DrawIndexedIndirectCommand> commands_;
+
+  // SoA boxes, one per command
+  std::vector<float> centerX_;
+  std::vector<float> centerY_;
+  std::vector<float> centerZ_;
+  std::vector<float> extentX_;
+  std::vector<float> extentY_;
+  std::vector<float> extentZ_;
+
+  std::vector<uint8_t> visible_;
+  std::vector<uint32_t> rangeCounts_;
+  std::vector<uint32_t> rangeOffsets_;
+  uint32_t numVisible_ = 0;
+
+  vec4 planes_[6];
+  vec4 absPlanes_[6];
+  vec3 frustumMin_ = vec3(0.0f);
+  vec3 frustumMax_ = vec3(0.0f);
+};
@@ -2,6 +2,151 @@
 
 #include "Chapter08/VKMesh08.h"
 
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+// Host-visible staging memory for the small per-frame uploads, split into kNumSegments segments used round-robin. The data
+// of one submission goes into one segment and is copied with a single cmdCopyBuffers(); a segment is written again only
+// after the GPU has finished the submission that read it, so the CPU waits only if it runs kNumSegments submissions ahead
+class VKUploadRing11 final
+{
+public:
+  static constexpr uint32_t kNumSegments = 3;
+
+  VKUploadRing11() = default;
+  VKUploadRing11(const std::unique_ptr<lvk::IContext>& ctx, uint32_t segmentSize)
+  : segmentSize_(segmentSize)
+  {
+    buffer_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_HostVisible,
+          .size      = size_t(segmentSize) * kNumSegments,
+          .debugName = "Buffer: upload ring" },
+        nullptr);
+  }
+
+  // takes the next segment, waiting for its previous submission if that is still in flight
+  void begin(const std::unique_ptr<lvk::IContext>& ctx)
+  {
+    LVK_ASSERT(regions_.empty());
+    segment_ = (segment_ + 1) % kNumSegments;
+    if (!submitHandles_[segment_].empty())
+      ctx->wait(submitHandles_[segment_]);
+    used_ = 0;
+  }
+
+  // copies the data into the current segment and queues its copy into dst; false if it does not fit
+  bool upload(const std::unique_ptr<lvk::IContext>& ctx, lvk::BufferHandle dst, size_t dstOffset, const void* data, size_t size)
+  {
+    // vkCmdCopyBuffer() has no alignment requirements, 16 bytes keep the source elements aligned
+    const uint32_t offset = (used_ + 15) & ~15u;
+    if (offset + size > segmentSize_)
+      return false;
+
+    const size_t srcOffset = size_t(segment_) * segmentSize_ + offset;
+    memcpy(ctx->getMappedPtr(buffer_) + srcOffset, data, size);
+    ctx->flushMappedMemory(buffer_, srcOffset, size);
+    regions_.push_back({ .srcBuffer = buffer_, .srcOffset = srcOffset, .dstBuffer = dst, .dstOffset = dstOffset, .size = size });
+    used_ = offset + (uint32_t)size;
+    return true;
+  }
+
+  bool empty() const { return regions_.empty(); }
+
+  // records all the copies queued since begin()
+  void cmdCopy(lvk::ICommandBuffer& buf)
+  {
+    buf.cmdCopyBuffers(regions_.data(), (uint32_t)regions_.size());
+    regions_.clear();
+  }
+
+  // the submission which reads the current segment
+  void end(lvk::SubmitHandle handle) { submitHandles_[segment_] = handle; }
+
+private:
+  lvk::Holder<lvk::BufferHandle> buffer_;
+  uint32_t segmentSize_ = 0;
+  uint32_t segment_     = 0;
+  uint32_t used_        = 0;
+  lvk::SubmitHandle submitHandles_[kNumSegments] = {};
+  std::vector<lvk::BufferCopyRegion> regions_;
+};
+
+// Tracks the modified elements of a device-local buffer mirroring a CPU array. flush() sorts and merges the dirty ranges
+// and copies only those: through the upload ring if they fit, otherwise with IContext::upload()
+class VKDirtyRanges11 final
+{
+public:
+  VKDirtyRanges11() = default;
+  VKDirtyRanges11(lvk::BufferHandle buffer, uint32_t elementSize, uint32_t numElements)
+  : buffer_(buffer)
+  , elementSize_(elementSize)
+  , numElements_(numElements)
+  {
+  }
+
+  void markDirty(uint32_t first, uint32_t count = 1)
+  {
+    LVK_ASSERT(first + count <= numElements_);
+    if (count)
+      ranges_.push_back({ first, first + count });
+  }
+
+  bool empty() const { return ranges_.empty(); }
+
+  // 'data' is the CPU copy of the entire buffer. Returns the number of bytes copied
+  uint64_t flush(const std::unique_ptr<lvk::IContext>& ctx, VKUploadRing11& ring, const void* data)
+  {
+    if (ranges_.empty())
+      return 0;
+
+    std::sort(ranges_.begin(), ranges_.end());
+
+    // copying a few unchanged elements in between is cheaper than one more copy region
+    const uint32_t maxGap = kMergeGapBytes / elementSize_;
+
+    uint64_t numBytes = 0;
+
+    auto copyRange = [&](uint32_t begin, uint32_t end) {
+      const size_t offset = size_t(begin) * elementSize_;
+      const size_t size   = size_t(end - begin) * elementSize_;
+      const uint8_t* src  = static_cast<const uint8_t*>(data) + offset;
+      if (!ring.upload(ctx, buffer_, offset, src, size))
+        ctx->upload(buffer_, src, size, offset);
+      numBytes += size;
+    };
+
+    uint32_t begin = ranges_[0].first;
+    uint32_t end   = ranges_[0].second;
+
+    for (size_t i = 1; i != ranges_.size(); i++) {
+      if (ranges_[i].first <= end + maxGap) {
+        end = std::max(end, ranges_[i].second);
+        continue;
+      }
+      copyRange(begin, end);
+      begin = ranges_[i].first;
+      end   = ranges_[i].second;
+    }
+    copyRange(begin, end);
+
+    ranges_.clear();
+
+    return numBytes;
+  }
+
+private:
+  static constexpr uint32_t kMergeGapBytes = 256;
+
+  lvk::BufferHandle buffer_;
+  uint32_t elementSize_ = 0;
+  uint32_t numElements_ = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> ranges_; // [first, last) elements, unsorted until flush()
+};
+
 class VKIndirectBuffer11 final
 {
 public:
@@ -74,10 +219,20 @@ public:
     vert_ = vert.valid() ? std::move(vert) : loadShaderModule(ctx, "Chapter08/02_SceneGraph/src/main.vert");
     frag_ = frag.valid() ? std::move(frag) : loadShaderModule(ctx, "Chapter08/02_SceneGraph/src/main.frag");
 
+    // constant_id 0 switches the vertex shaders to the quantized vertex format
+    const uint32_t quantized = isVertexFormatQuantized(streams) ? 1u : 0u;
+
+    const lvk::SpecializationConstantDesc specInfo = {
+      .entries  = { { .constantId = 0, .size = sizeof(quantized) } },
+      .data     = &quantized,
+      .dataSize = sizeof(quantized),
+    };
+
     pipeline_ = ctx->createRenderPipeline({
         .vertexInput      = streams,
         .smVert           = vert_,
         .smFrag           = frag_,
+        .specInfo         = specInfo,
         .color            = { { .format = colorFormat } },
         .depthFormat      = depthFormat,
         .cullMode         = lvk::CullMode_None,
@@ -89,6 +244,7 @@ public:
         .vertexInput  = streams,
         .smVert       = vert_,
         .smFrag       = frag_,
+        .specInfo     = specInfo,
         .color        = { { .format = colorFormat } },
         .depthFormat  = depthFormat,
         .cullMode     = lvk::CullMode_None,
@@ -108,23 +264,177 @@ public:
   lvk::Holder<lvk::RenderPipelineHandle> pipelineWireframe_;
 };
 
+// Mesh-shader counterpart of VKPipeline11 (see VKMesh11::drawMeshlets()); the task shader culls the meshlets
+// and the mesh shader fetches the vertices from the vertex buffer address instead of the vertex input
+class VKMeshletPipeline11 final
+{
+public:
+  VKMeshletPipeline11(
+      const std::unique_ptr<lvk::IContext>& ctx, const lvk::VertexInput& streams, lvk::Format colorFormat, lvk::Format depthFormat,
+      uint32_t numSamples, lvk::Holder<lvk::ShaderModuleHandle>&& frag)
+  : frag_(std::move(frag))
+  {
+    LVK_ASSERT(ctx->isMeshShaderSupported());
+    // meshlet.mesh decodes either the quantized format or the 32-byte float format of loadBistro()
+    LVK_ASSERT(isVertexFormatQuantized(streams) || streams.getVertexSize() == 32);
+
+    // the shader stage cannot be deduced from the file extension here
+    task_ = ctx->createShaderModule(
+        { readShaderFile("Chapter11/07_MyFinalDemo/src/meshlet.task").c_str(), lvk::Stage_Task, "Shader Module: meshlet (task)" });
+    mesh_ = ctx->createShaderModule(
+        { readShaderFile("Chapter11/07_MyFinalDemo/src/meshlet.mesh").c_str(), lvk::Stage_Mesh, "Shader Module: meshlet (mesh)" });
+
+    const uint32_t quantized = isVertexFormatQuantized(streams) ? 1u : 0u;
+
+    const lvk::SpecializationConstantDesc specInfo = {
+      .entries  = { { .constantId = 0, .size = sizeof(quantized) } },
+      .data     = &quantized,
+      .dataSize = sizeof(quantized),
+    };
+
+    pipeline_ = ctx->createRenderPipeline({
+        .smTask           = task_,
+        .smMesh           = mesh_,
+        .smFrag           = frag_,
+        .specInfo         = specInfo,
+        .color            = { { .format = colorFormat } },
+        .depthFormat      = depthFormat,
+        .cullMode         = lvk::CullMode_None,
+        .samplesCount     = numSamples,
+        .minSampleShading = numSamples > 1 ? 0.25f : 0.0f,
+    });
+
+    pipelineWireframe_ = ctx->createRenderPipeline({
+        .smTask       = task_,
+        .smMesh       = mesh_,
+        .smFrag       = frag_,
+        .specInfo     = specInfo,
+        .color        = { { .format = colorFormat } },
+        .depthFormat  = depthFormat,
+        .cullMode     = lvk::CullMode_None,
+        .polygonMode  = lvk::PolygonMode_Line,
+        .samplesCount = numSamples,
+    });
+
+    LVK_ASSERT(pipeline_.valid());
+    LVK_ASSERT(pipelineWireframe_.valid());
+  }
+
+public:
+  lvk::Holder<lvk::ShaderModuleHandle> task_;
+  lvk::Holder<lvk::ShaderModuleHandle> mesh_;
+  lvk::Holder<lvk::ShaderModuleHandle> frag_;
+
+  lvk::Holder<lvk::RenderPipelineHandle> pipeline_;
+  lvk::Holder<lvk::RenderPipelineHandle> pipelineWireframe_;
+};
+
+// per-draw decoding parameters for quantized positions (see quantizeVertices()): pos = offset + scale * in_pos.
+// The identity transform is used when the vertices are not quantized
+struct MeshDequantization {
+  vec4 offset = vec4(0.0f);
+  vec4 scale  = vec4(1.0f);
+};
+
+// LOD ranges of the mesh referenced by a draw command, indexed by baseInstance like drawData.
+// The culling passes rewrite firstIndex/count of the draw commands from it (see applyLOD())
+struct DrawLODs {
+  uint32_t lodCount   = 1;
+  uint32_t firstIndex = 0; // of LOD 0, relative to the chunk's index buffer
+  uint32_t lodOffset[kMaxLODs + 1] = {};
+};
+
+// Picks the LOD from the projected diameter of the box's bounding sphere: every time it halves below lodThreshold pixels,
+// the next (twice coarser) LOD is used. pixelScale is proj[1][1] * 0.5 * viewport height; orthographic projections ignore the distance
+inline uint32_t selectLOD(
+    const BoundingBox& box, const vec3& eye, float pixelScale, bool perspective, float lodThreshold, uint32_t lodCount)
+{
+  const float radius   = 0.5f * glm::length(box.max_ - box.min_);
+  const float distance = glm::length(0.5f * (box.min_ + box.max_) - eye) - radius;
+
+  if (perspective && distance <= 0.0f)
+    return 0;
+
+  const float size = 2.0f * radius * pixelScale / (perspective ? distance : 1.0f);
+
+  if (size >= lodThreshold)
+    return 0;
+
+  return std::min((uint32_t)log2f(lodThreshold / std::max(size, 1e-6f)), lodCount - 1);
+}
+
+inline void applyLOD(DrawIndexedIndirectCommand& cmd, const DrawLODs& lods, uint32_t lod)
+{
+  cmd.firstIndex = lods.firstIndex + lods.lodOffset[lod];
+  cmd.count      = lods.lodOffset[lod + 1] - lods.lodOffset[lod];
+}
+
+// One task shader workgroup: up to kMeshletsPerTask meshlets of a single draw command (see meshlet.task)
+constexpr uint32_t kMeshletsPerTask        = 32;
+constexpr uint32_t kMeshletTaskConeCulling = 0x100; // in numMeshletsAndFlags, set for materials without alpha testing
+
+struct MeshletTask {
+  uint32_t drawId              = 0; // baseInstance of the draw command
+  uint32_t firstMeshlet        = 0;
+  uint32_t baseVertex          = 0; // Mesh::vertexOffset
+  uint32_t numMeshletsAndFlags = 0;
+};
+
+// A range of meshes whose indices and vertices live in their own pair of device buffers.
+// Scenes that fit into a single device buffer have exactly one chunk
+struct VKMeshChunk11 final {
+  uint64_t firstIndex  = 0; // in MeshData::indexData
+  uint64_t numIndices  = 0;
+  uint64_t firstVertex = 0; // in MeshData::vertexData
+  uint64_t numVertices = 0;
+
+  // the draw commands of this chunk have baseInstance in [firstDraw, firstDraw + numDraws)
+  uint32_t firstDraw = 0;
+  uint32_t numDraws  = 0;
+
+  lvk::Holder<lvk::BufferHandle> bufferIndices_;
+  lvk::Holder<lvk::BufferHandle> bufferVertices_;
+};
+
+// the vertices referenced by all LODs of a mesh: [begin, end) in MeshData::vertexData.
+// Mesh::vertexCount is not reliable for merged meshes, so the range is taken from the indices
+inline void getMeshVertexRange(const std::span<const uint32_t>& indices, const Mesh& mesh, uint64_t& begin, uint64_t& end)
+{
+  const uint64_t indexBegin = mesh.indexOffset;
+  const uint64_t indexEnd   = mesh.indexOffset + mesh.lodOffset[mesh.lodCount];
+
+  begin = indexBegin != indexEnd ? std::numeric_limits<uint64_t>::max() : mesh.vertexOffset;
+  end   = mesh.vertexOffset;
+
+  for (uint64_t i = indexBegin; i != indexEnd; i++) {
+    begin = std::min(begin, indices[i] + mesh.vertexOffset);
+    end   = std::max(end, indices[i] + mesh.vertexOffset + 1);
+  }
+}
+
+// geometry uploaded per frame in the streaming mode (see VKMesh11::processStreamedGeometry())
+constexpr uint64_t kStreamingBytesPerFrame = 32ull * 1024 * 1024;
+
 class VKMesh11
 {
 public:
+  // maxBufferSize: the largest vertex/index buffer to create, 0 means the device limit (maxStorageBufferRange).
+  // Scenes exceeding it are split into several chunks (large-scene mode).
+  // streamGeometry: the geometry buffers are allocated empty and filled over several frames by processStreamedGeometry(),
+  // only the draw commands with isDrawResident() can be submitted meanwhile. The index and vertex data of meshData have
+  // to stay alive until isStreamingComplete() unless they are memory-mapped
   VKMesh11(
       const std::unique_ptr<lvk::IContext>& ctx, const MeshData& meshData, const Scene& scene,
-      lvk::StorageType indirectBufferStorage = lvk::StorageType_Device, bool preloadMaterials = true)
+      lvk::StorageType indirectBufferStorage = lvk::StorageType_Device, bool preloadMaterials = true, uint64_t maxBufferSize = 0,
+      bool streamGeometry = false)
   : ctx(ctx)
-  , numIndices_((uint32_t)meshData.indexData.size())
+  , numIndices_(meshData.getIndexData().size())
   , numMeshes_((uint32_t)meshData.meshes.size())
   , indirectBuffer_(ctx, meshData.getMeshFileHeader().meshCount, indirectBufferStorage)
   , textureFiles_(meshData.textureFiles)
   {
     const MeshFileHeader header = meshData.getMeshFileHeader();
 
-    const uint32_t* indices   = meshData.indexData.data();
-    const uint8_t* vertexData = meshData.vertexData.data();
-
     materialsCPU_ = meshData.materials;
     materialsGPU_.reserve(meshData.materials.size());
 
@@ -132,24 +442,17 @@ public:
       materialsGPU_.push_back(preloadMaterials ? convertToGPUMaterial(ctx, mat, textureFiles_, textureCache_) : GLTFMaterialDataGPU{});
     }
 
-    bufferVertices_ = ctx->createBuffer(
-        { .usage     = lvk::BufferUsageBits_Vertex,
-          .storage   = lvk::StorageType_Device,
-          .size      = header.vertexDataSize,
-          .data      = vertexData,
-          .debugName = "Buffer: vertex" },
-        nullptr);
-    bufferIndices_ = ctx->createBuffer(
-        { .usage     = lvk::BufferUsageBits_Index,
-          .storage   = lvk::StorageType_Device,
-          .size      = header.indexDataSize,
-          .data      = indices,
-          .debugName = "Buffer: index" },
-        nullptr);
+    std::vector<uint32_t> chunkForMesh;
+
+    createChunks(meshData, maxBufferSize ? maxBufferSize : ctx->getMaxStorageBufferRange(), chunkForMesh, streamGeometry);
+
+    // the mesh shaders address the vertices with 32-bit indices, so large-scene mode always uses the classic path
+    const bool useMeshlets = !meshData.meshlets.empty() && chunks_.size() == 1 && ctx->isMeshShaderSupported();
+
     bufferTransforms_ = ctx->createBuffer(
         { .usage     = lvk::BufferUsageBits_Storage,
           .storage   = lvk::StorageType_Device,
-          .size      = scene.globalTransform.size() * sizeof(glm::mat4),
+          .size      = scene.globalTransform.size() * sizeof(AffineTransform),
           .data      = scene.globalTransform.data(),
           .debugName = "Buffer: transforms" },
         nullptr);
@@ -160,33 +463,79 @@ public:
           .data      = materialsGPU_.data(),
           .debugName = "Buffer: materials" },
         nullptr);
+    dirtyMaterials_ = VKDirtyRanges11(bufferMaterials_, sizeof(GLTFMaterialDataGPU), (uint32_t)materialsGPU_.size());
+    uploadRing_     = VKUploadRing11(ctx, kUploadRingSegmentSize);
 
     const uint32_t numCommands = header.meshCount;
 
     indirectBuffer_.drawCommands_.resize(numCommands);
     drawData_.resize(numCommands);
+    drawLODs_.resize(numCommands);
+    if (useMeshlets)
+      drawMeshlets_.resize(numCommands);
+    if (streamGeometry)
+      meshForDraw_.resize(numCommands);
+
+    const bool quantized = isVertexFormatQuantized(meshData.streams);
+
+    std::vector<MeshDequantization> dequantization(numCommands);
 
     DrawIndexedIndirectCommand* cmd = indirectBuffer_.drawCommands_.data();
     DrawData* dd                    = drawData_.data();
+    DrawLODs* lods                  = drawLODs_.data();
 
     LVK_ASSERT(scene.meshForNode.size() == numCommands);
 
+    // (node, mesh) pairs; the draw commands are grouped by chunks, keeping the scene order inside each chunk
+    std::vector<std::pair<uint32_t, uint32_t>> nodes(scene.meshForNode.begin(), scene.meshForNode.end());
+
+    if (chunks_.size() > 1) {
+      std::stable_sort(nodes.begin(), nodes.end(), [&chunkForMesh](const auto& a, const auto& b) {
+        return chunkForMesh[a.second] < chunkForMesh[b.second];
+      });
+    }
+
     uint32_t ddIndex = 0;
 
     // prepare indirect commands buffer
 	 // loop for every mesh node to populate the draw commands
-    for (auto& i : scene.meshForNode) {
-      const Mesh& mesh = meshData.meshes[i.second];
+    for (auto& i : nodes) {
+      const Mesh& mesh     = meshData.meshes[i.second];
+      VKMeshChunk11& chunk = chunks_[chunkForMesh[i.second]];
 
-      const uint32_t lod = std::min(0u, mesh.lodCount - 1); // TODO: implement dynamic lod
+      if (!chunk.numDraws)
+        chunk.firstDraw = ddIndex;
+      chunk.numDraws++;
 
+      // offsets inside the chunk's buffers always fit into 32 bits
+      *lods = {
+        .lodCount   = mesh.lodCount,
+        .firstIndex = (uint32_t)(mesh.indexOffset - chunk.firstIndex),
+      };
+      std::copy(mesh.lodOffset, mesh.lodOffset + mesh.lodCount + 1, lods->lodOffset);
+      // LOD 0 here, the culling passes select LODs per frame
       *cmd++ = {
-        .count         = mesh.getLODIndicesCount(lod),
+        .count         = mesh.getLODIndicesCount(0),
         .instanceCount = 1,
-        .firstIndex    = mesh.indexOffset, // + mesh.lodOffset[lod],
-        .baseVertex    = (int32_t)mesh.vertexOffset,
+        .firstIndex    = (lods++)->firstIndex,
+        .baseVertex    = (int32_t)((int64_t)mesh.vertexOffset - (int64_t)chunk.firstVertex),
         .baseInstance  = ddIndex++,
       };
+      if (quantized) {
+        const BoundingBox& box = meshData.boxes[i.second];
+        dequantization[ddIndex - 1] = {
+          .offset = vec4(box.min_, 0.0f),
+          .scale  = vec4(box.max_ - box.min_, 0.0f),
+        };
+      }
+      if (streamGeometry)
+        meshForDraw_[ddIndex - 1] = i.second;
+      if (useMeshlets) {
+        drawMeshlets_[ddIndex - 1] = {
+          .range      = meshData.meshletRanges[i.second],
+          .baseVertex = (uint32_t)mesh.vertexOffset,
+        };
+      }
       *dd++ = {
         .transformId = i.first,
         .materialId  = mesh.materialID,
@@ -204,6 +553,189 @@ public:
           .data      = drawData_.data(),
           .debugName = "Buffer: drawData" },
         nullptr);
+
+    bufferDrawLODs_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = sizeof(DrawLODs) * numCommands,
+          .data      = drawLODs_.data(),
+          .debugName = "Buffer: drawLODs" },
+        nullptr);
+
+    // indexed by baseInstance, same as drawData
+    bufferDequantization_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = sizeof(MeshDequantization) * numCommands,
+          .data      = dequantization.data(),
+          .debugName = "Buffer: dequantization" },
+        nullptr);
+
+    if (useMeshlets)
+      createMeshlets(meshData);
+
+    if (streamGeometry)
+      initStreaming(meshData, scene, chunkForMesh);
+  }
+
+  bool hasMeshlets() const { return bufferMeshlets_.valid(); }
+
+  // Update materialsGPU_ first, then mark the changed elements. The transforms have a single writer, VKSceneTransforms11
+  void markMaterialsDirty(uint32_t firstMaterial, uint32_t numMaterials = 1) { dirtyMaterials_.markDirty(firstMaterial, numMaterials); }
+
+  // Copies everything marked dirty since the previous call in a separately submitted command buffer, so it has to be called
+  // before the frame's command buffer is acquired. Returns the number of bytes uploaded, also kept in uploadedBytes_
+  uint64_t uploadDirtyRanges()
+  {
+    uploadedBytes_ = 0;
+
+    if (dirtyMaterials_.empty())
+      return 0;
+
+    uploadRing_.begin(ctx);
+
+    uploadedBytes_ += dirtyMaterials_.flush(ctx, uploadRing_, materialsGPU_.data());
+
+    if (!uploadRing_.empty()) {
+      lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
+      uploadRing_.cmdCopy(buf);
+      uploadRing_.end(ctx->submit(buf));
+    }
+
+    return uploadedBytes_;
+  }
+
+  bool isStreamingComplete() const { return streamNext_ == streamQueue_.size(); }
+
+  bool isDrawResident(uint32_t baseInstance) const { return meshResident_.empty() || meshResident_[meshForDraw_[baseInstance]]; }
+
+  // upload the meshes closest to 'eye' first; the mesh being uploaded right now is finished first
+  void prioritizeStreaming(const vec3& eye)
+  {
+    if (isStreamingComplete())
+      return;
+
+    auto distance = [this, &eye](uint32_t m) {
+      const BoundingBox& box = streamedMeshes_[m].boxWS;
+      return glm::length(glm::max(glm::max(box.min_ - eye, eye - box.max_), vec3(0.0f)));
+    };
+
+    const bool started = streamIndexProgress_ || streamVertexProgress_;
+
+    std::stable_sort(streamQueue_.begin() + streamNext_ + (started ? 1 : 0), streamQueue_.end(), [&distance](uint32_t a, uint32_t b) {
+      return distance(a) < distance(b);
+    });
+  }
+
+  // Uploads up to bytesPerFrame of the streamed geometry through the staging buffer, meshes larger than that take several frames.
+  // Returns true if more meshes became resident, so the caller can rebuild its lists of draw commands
+  bool processStreamedGeometry(uint64_t bytesPerFrame = kStreamingBytesPerFrame)
+  {
+    if (isStreamingComplete())
+      return false;
+
+    const uint32_t vertexSize = streamVertexSize_;
+
+    uint64_t budget       = bytesPerFrame;
+    bool residencyChanged = false;
+
+    while (budget && !isStreamingComplete()) {
+      const uint32_t m           = streamQueue_[streamNext_];
+      const StreamedMesh& sm     = streamedMeshes_[m];
+      const VKMeshChunk11& chunk = chunks_[sm.chunk];
+      const uint64_t indexBytes  = (sm.indexEnd - sm.indexBegin) * sizeof(uint32_t);
+      const uint64_t vertexBytes = (sm.vertexEnd - sm.vertexBegin) * vertexSize;
+
+      if (streamIndexProgress_ < indexBytes) {
+        const uint64_t size = std::min(budget, indexBytes - streamIndexProgress_);
+        ctx->upload(
+            chunk.bufferIndices_, reinterpret_cast<const uint8_t*>(streamIndices_.data() + sm.indexBegin) + streamIndexProgress_, size,
+            (sm.indexBegin - chunk.firstIndex) * sizeof(uint32_t) + streamIndexProgress_);
+        streamIndexProgress_ += size;
+        budget -= size;
+      } else if (streamVertexProgress_ < vertexBytes) {
+        const uint64_t size = std::min(budget, vertexBytes - streamVertexProgress_);
+        ctx->upload(
+            chunk.bufferVertices_, streamVertices_.data() + sm.vertexBegin * vertexSize + streamVertexProgress_, size,
+            (sm.vertexBegin - chunk.firstVertex) * vertexSize + streamVertexProgress_);
+        streamVertexProgress_ += size;
+        budget -= size;
+      }
+
+      if (streamIndexProgress_ == indexBytes && streamVertexProgress_ == vertexBytes) {
+        meshResident_[m]      = 1;
+        residencyChanged      = true;
+        streamedBytes_       += indexBytes + vertexBytes;
+        streamIndexProgress_  = 0;
+        streamVertexProgress_ = 0;
+        streamNext_++;
+      }
+    }
+
+    streamFrames_++;
+
+    if (isStreamingComplete()) {
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - streamStart_).count();
+      printf(
+          "Streamed %.1f MB of geometry in %u frames (%.3f s)\n", double(streamedBytes_) / (1024.0 * 1024.0), streamFrames_, seconds);
+      // nothing references the source data anymore
+      streamIndices_  = {};
+      streamVertices_ = {};
+      streamFile_.reset();
+    }
+
+    return residencyChanged;
+  }
+
+  // Replaces the list of task shader workgroups with the meshlets of the given draw commands (LOD 0, no per-frame LOD selection).
+  // Every command is split into workgroups of up to kMeshletsPerTask meshlets which are culled individually on the GPU
+  void uploadMeshletTasks(const std::vector<DrawIndexedIndirectCommand>& commands)
+  {
+    LVK_ASSERT(hasMeshlets());
+
+    std::vector<MeshletTask> tasks;
+
+    for (const DrawIndexedIndirectCommand& c : commands) {
+      const DrawMeshlets& dm = drawMeshlets_[c.baseInstance];
+      // alpha-tested geometry (foliage) is double-sided, so its back faces cannot be culled
+      const bool coneCulling = materialsCPU_[drawData_[c.baseInstance].materialId].alphaTest == 0.0f;
+      for (uint32_t i = 0; i < dm.range.numMeshlets; i += kMeshletsPerTask) {
+        tasks.push_back({
+            .drawId              = c.baseInstance,
+            .firstMeshlet        = dm.range.firstMeshlet + i,
+            .baseVertex          = dm.baseVertex,
+            .numMeshletsAndFlags = std::min(kMeshletsPerTask, dm.range.numMeshlets - i) | (coneCulling ? kMeshletTaskConeCulling : 0u),
+        });
+      }
+    }
+
+    // layout: | uint32_t numTasks | 3 x uint32_t padding | MeshletTask | MeshletTask | ...
+    const uint32_t header[4] = { (uint32_t)tasks.size() };
+
+    LVK_ASSERT(tasks.size() <= maxMeshletTasks_);
+
+    ctx->upload(bufferMeshletTasks_, header, sizeof(header));
+    if (!tasks.empty())
+      ctx->upload(bufferMeshletTasks_, tasks.data(), tasks.size() * sizeof(MeshletTask), sizeof(header));
+
+    numMeshletTasks_ = (uint32_t)tasks.size();
+  }
+
+  // the push constants have to be layout-compatible with the task and mesh shaders (see meshlet.sp)
+  void drawMeshlets(
+      lvk::ICommandBuffer& buf, const VKMeshletPipeline11& pipeline, const void* pushConstants, size_t pcSize,
+      const lvk::DepthState depthState = { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, bool wireframe = false) const
+  {
+    if (!numMeshletTasks_)
+      return;
+
+    // VK_EXT_mesh_shader guarantees only 65535 workgroups per dimension
+    const uint32_t kMaxGroupsX = 65535;
+
+    buf.cmdBindRenderPipeline(wireframe ? pipeline.pipelineWireframe_ : pipeline.pipeline_);
+    buf.cmdBindDepthState(depthState);
+    buf.cmdPushConstants(pushConstants, pcSize);
+    buf.cmdDrawMeshTasks({ std::min(numMeshletTasks_, kMaxGroupsX), (numMeshletTasks_ + kMaxGroupsX - 1) / kMaxGroupsX, 1 });
   }
 
   // we can use different indirect command buffers for the same VKMesh object
@@ -213,8 +745,6 @@ public:
       lvk::ICommandBuffer& buf, const VKPipeline11& pipeline, const mat4& view, const mat4& proj,
       lvk::TextureHandle texSkyboxIrradiance = {}, bool wireframe = false, const VKIndirectBuffer11* indirectBuffer = nullptr) const
   {
-    buf.cmdBindIndexBuffer(bufferIndices_, lvk::IndexFormat_UI32);
-    buf.cmdBindVertexBuffer(0, bufferVertices_);
     buf.cmdBindRenderPipeline(wireframe ? pipeline.pipelineWireframe_ : pipeline.pipeline_);
     buf.cmdBindDepthState({ .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true });
     const struct {
@@ -223,20 +753,19 @@ public:
       uint64_t bufferDrawData;
       uint64_t bufferMaterials;
       uint32_t texSkyboxIrradiance;
+      uint32_t padding0;
+      uint64_t bufferDequantization;
     } pc = {
-      .viewProj            = proj * view,
-      .bufferTransforms    = ctx->gpuAddress(bufferTransforms_),
-      .bufferDrawData      = ctx->gpuAddress(bufferDrawData_),
-      .bufferMaterials     = ctx->gpuAddress(bufferMaterials_),
-      .texSkyboxIrradiance = texSkyboxIrradiance.index(),
+      .viewProj             = proj * view,
+      .bufferTransforms     = ctx->gpuAddress(bufferTransforms_),
+      .bufferDrawData       = ctx->gpuAddress(bufferDrawData_),
+      .bufferMaterials      = ctx->gpuAddress(bufferMaterials_),
+      .texSkyboxIrradiance  = texSkyboxIrradiance.index(),
+      .bufferDequantization = ctx->gpuAddress(bufferDequantization_),
     };
     static_assert(sizeof(pc) <= 128);
     buf.cmdPushConstants(pc);
-    if (!indirectBuffer)
-      indirectBuffer = &indirectBuffer_;
-    buf.cmdDrawIndexedIndirectCount(
-        indirectBuffer->bufferIndirect_, sizeof(uint32_t), indirectBuffer->bufferIndirect_, 0, numMeshes_,
-        sizeof(DrawIndexedIndirectCommand));
+    drawIndirect(buf, indirectBuffer ? *indirectBuffer : indirectBuffer_);
   }
 
   // this draw function takes custom push constants and depth state 
@@ -245,35 +774,269 @@ public:
       const lvk::DepthState depthState = { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, bool wireframe = false,
       const VKIndirectBuffer11* indirectBuffer = nullptr) const
   {
-    buf.cmdBindIndexBuffer(bufferIndices_, lvk::IndexFormat_UI32);
-    buf.cmdBindVertexBuffer(0, bufferVertices_);
     buf.cmdBindRenderPipeline(wireframe ? pipeline.pipelineWireframe_ : pipeline.pipeline_);
     buf.cmdBindDepthState(depthState);
     buf.cmdPushConstants(pushConstants, pcSize);
-    if (!indirectBuffer)
-      indirectBuffer = &indirectBuffer_;
-
-	 // the draw commands counter is in the bufferIndirect_, and the offset is 0 (very beginning of the buffer)
-    buf.cmdDrawIndexedIndirectCount(
-        indirectBuffer->bufferIndirect_, sizeof(uint32_t), indirectBuffer->bufferIndirect_, 0, numMeshes_,
-        sizeof(DrawIndexedIndirectCommand));
+    drawIndirect(buf, indirectBuffer ? *indirectBuffer : indirectBuffer_);
   }
 
   DrawIndexedIndirectCommand* getDrawIndexedIndirectCommandPtr() const { return indirectBuffer_.getDrawIndexedIndirectCommandPtr(); };
 
+private:
+  void drawIndirect(lvk::ICommandBuffer& buf, const VKIndirectBuffer11& indirectBuffer) const
+  {
+    if (chunks_.size() == 1) {
+      buf.cmdBindIndexBuffer(chunks_[0].bufferIndices_, lvk::IndexFormat_UI32);
+      buf.cmdBindVertexBuffer(0, chunks_[0].bufferVertices_);
+      // the draw commands counter is in the bufferIndirect_, and the offset is 0 (very beginning of the buffer)
+      buf.cmdDrawIndexedIndirectCount(
+          indirectBuffer.bufferIndirect_, sizeof(uint32_t), indirectBuffer.bufferIndirect_, 0, numMeshes_,
+          sizeof(DrawIndexedIndirectCommand));
+      return;
+    }
+
+    // large-scene mode: each chunk binds its own buffers and is drawn separately. The CPU-side commands are sorted
+    // by baseInstance (selectTo() and CPU culling keep the order), so they are grouped by chunks as well
+    const std::vector<DrawIndexedIndirectCommand>& commands = indirectBuffer.drawCommands_;
+
+    auto first = commands.begin();
+
+    for (const VKMeshChunk11& chunk : chunks_) {
+      const uint32_t end = chunk.firstDraw + chunk.numDraws;
+      const auto last    = std::partition_point(first, commands.end(), [end](const DrawIndexedIndirectCommand& c) { return c.baseInstance < end; });
+      if (last != first) {
+        buf.cmdBindIndexBuffer(chunk.bufferIndices_, lvk::IndexFormat_UI32);
+        buf.cmdBindVertexBuffer(0, chunk.bufferVertices_);
+        buf.cmdDrawIndexedIndirect(
+            indirectBuffer.bufferIndirect_, sizeof(uint32_t) + (first - commands.begin()) * sizeof(DrawIndexedIndirectCommand),
+            (uint32_t)(last - first), sizeof(DrawIndexedIndirectCommand));
+      }
+      first = last;
+    }
+  }
+
+  void initStreaming(const MeshData& meshData, const Scene& scene, const std::vector<uint32_t>& chunkForMesh)
+  {
+    streamIndices_    = meshData.getIndexData();
+    streamVertices_   = meshData.getVertexData();
+    streamFile_       = meshData.mappedFile;
+    streamVertexSize_ = meshData.streams.getVertexSize();
+    streamStart_      = std::chrono::steady_clock::now();
+
+    const uint32_t numMeshes = (uint32_t)meshData.meshes.size();
+
+    streamedMeshes_.resize(numMeshes);
+    meshResident_.assign(numMeshes, 0);
+
+    for (uint32_t m = 0; m != numMeshes; m++) {
+      const Mesh& mesh = meshData.meshes[m];
+      StreamedMesh& sm = streamedMeshes_[m];
+      sm.chunk         = chunkForMesh[m];
+      sm.indexBegin    = mesh.indexOffset;
+      sm.indexEnd      = mesh.indexOffset + mesh.lodOffset[mesh.lodCount];
+      sm.boxWS         = BoundingBox(vec3(std::numeric_limits<float>::max()), vec3(std::numeric_limits<float>::lowest()));
+      getMeshVertexRange(streamIndices_, mesh, sm.vertexBegin, sm.vertexEnd);
+    }
+
+    // a mesh can be instanced by several nodes, so it is as close as its closest instance
+    for (const auto& i : scene.meshForNode) {
+      const BoundingBox box = meshData.boxes[i.second].getTransformed(scene.globalTransform[i.first]);
+      StreamedMesh& sm      = streamedMeshes_[i.second];
+      sm.boxWS.combinePoint(box.min_);
+      sm.boxWS.combinePoint(box.max_);
+    }
+
+    streamQueue_.resize(numMeshes);
+    std::iota(streamQueue_.begin(), streamQueue_.end(), 0u);
+  }
+
+  void createMeshlets(const MeshData& meshData)
+  {
+    // enough to split every draw command, so the task buffer never moves and its address can be stored in other buffers
+    for (const DrawMeshlets& dm : drawMeshlets_)
+      maxMeshletTasks_ += (dm.range.numMeshlets + kMeshletsPerTask - 1) / kMeshletsPerTask;
+
+    bufferMeshletTasks_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = 4 * sizeof(uint32_t) + std::max(maxMeshletTasks_, 1u) * sizeof(MeshletTask),
+          .debugName = "Buffer: meshlet tasks" },
+        nullptr);
+    bufferMeshlets_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = meshData.meshlets.size() * sizeof(Meshlet),
+          .data      = meshData.meshlets.data(),
+          .debugName = "Buffer: meshlets" },
+        nullptr);
+    bufferMeshletVertices_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = meshData.meshletVertices.size() * sizeof(uint32_t),
+          .data      = meshData.meshletVertices.data(),
+          .debugName = "Buffer: meshlet vertices" },
+        nullptr);
+    // buildMeshlets() pads the triangles to whole 32-bit words
+    LVK_ASSERT(meshData.meshletTriangles.size() % sizeof(uint32_t) == 0);
+    bufferMeshletTriangles_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = meshData.meshletTriangles.size(),
+          .data      = meshData.meshletTriangles.data(),
+          .debugName = "Buffer: meshlet triangles" },
+        nullptr);
+  }
+
+  // split the geometry into chunks no larger than maxBufferSize and upload them
+  void createChunks(const MeshData& meshData, uint64_t maxBufferSize, std::vector<uint32_t>& chunkForMesh, bool streamGeometry)
+  {
+    // when the mesh file is memory-mapped, these point straight into the mapped pages
+    // and the staging device copies them to the GPU without an intermediate CPU copy
+    const std::span<const uint32_t> indices = meshData.getIndexData();
+    const std::span<const uint8_t> vertices = meshData.getVertexData();
+
+    const uint32_t vertexSize = meshData.streams.getVertexSize();
+
+    chunkForMesh.assign(meshData.meshes.size(), 0);
+
+    if (indices.size_bytes() <= maxBufferSize && vertices.size_bytes() <= maxBufferSize) {
+      chunks_.push_back({ .numIndices = indices.size(), .numVertices = vertices.size() / vertexSize });
+    } else {
+      // walk the meshes in the index buffer order and start a new chunk whenever the current one would overflow
+      std::vector<uint32_t> order(meshData.meshes.size());
+      std::iota(order.begin(), order.end(), 0u);
+      std::sort(order.begin(), order.end(), [&meshData](uint32_t a, uint32_t b) {
+        return meshData.meshes[a].indexOffset < meshData.meshes[b].indexOffset;
+      });
+
+      VKMeshChunk11 chunk;
+      uint64_t chunkVertexEnd = 0;
+
+      for (uint32_t m : order) {
+        const Mesh& mesh = meshData.meshes[m];
+
+        const uint64_t indexBegin = mesh.indexOffset;
+        const uint64_t indexEnd   = mesh.indexOffset + mesh.lodOffset[mesh.lodCount];
+
+        uint64_t vertexBegin = 0;
+        uint64_t vertexEnd   = 0;
+        getMeshVertexRange(indices, mesh, vertexBegin, vertexEnd);
+
+        if ((indexEnd - indexBegin) * sizeof(uint32_t) > maxBufferSize || (vertexEnd - vertexBegin) * vertexSize > maxBufferSize) {
+          printf("Mesh %u does not fit into a single buffer of %llu bytes.\n", m, (unsigned long long)maxBufferSize);
+          assert(false);
+          exit(EXIT_FAILURE);
+        }
+
+        const bool overflow = chunk.numIndices &&
+                              ((indexEnd - chunk.firstIndex) * sizeof(uint32_t) > maxBufferSize ||
+                               (std::max(vertexEnd, chunkVertexEnd) - std::min(vertexBegin, chunk.firstVertex)) * vertexSize > maxBufferSize);
+
+        if (overflow) {
+          chunk.numVertices = chunkVertexEnd - chunk.firstVertex;
+          chunks_.push_back(std::move(chunk));
+          chunk = {};
+        }
+
+        if (!chunk.numIndices) {
+          chunk.firstIndex  = indexBegin;
+          chunk.firstVertex = vertexBegin;
+          chunkVertexEnd    = vertexEnd;
+        }
+
+        chunk.numIndices  = std::max(chunk.numIndices, indexEnd - chunk.firstIndex);
+        chunk.firstVertex = std::min(chunk.firstVertex, vertexBegin);
+        chunkVertexEnd    = std::max(chunkVertexEnd, vertexEnd);
+
+        chunkForMesh[m] = (uint32_t)chunks_.size();
+      }
+
+      if (chunk.numIndices) {
+        chunk.numVertices = chunkVertexEnd - chunk.firstVertex;
+        chunks_.push_back(std::move(chunk));
+      }
+
+      printf("Large-scene mode: the geometry is split into %u chunks of up to %.1f MB\n", (uint32_t)chunks_.size(),
+             double(maxBufferSize) / (1024.0 * 1024.0));
+    }
+
+    for (VKMeshChunk11& chunk : chunks_) {
+      chunk.bufferVertices_ = ctx->createBuffer(
+          { .usage     = lvk::BufferUsageBits_Vertex | lvk::BufferUsageBits_Storage, // the mesh shaders fetch vertices by address
+            .storage   = lvk::StorageType_Device,
+            .size      = chunk.numVertices * vertexSize,
+            .data      = streamGeometry ? nullptr : vertices.data() + chunk.firstVertex * vertexSize,
+            .debugName = "Buffer: vertex" },
+          nullptr);
+      chunk.bufferIndices_ = ctx->createBuffer(
+          { .usage     = lvk::BufferUsageBits_Index,
+            .storage   = lvk::StorageType_Device,
+            .size      = chunk.numIndices * sizeof(uint32_t),
+            .data      = streamGeometry ? nullptr : indices.data() + chunk.firstIndex,
+            .debugName = "Buffer: index" },
+          nullptr);
+    }
+  }
+
 public:
   const std::unique_ptr<lvk::IContext>& ctx;
 
-  uint32_t numIndices_ = 0;
+  uint64_t numIndices_ = 0;
   uint32_t numMeshes_  = 0;
 
-  lvk::Holder<lvk::BufferHandle> bufferIndices_;
-  lvk::Holder<lvk::BufferHandle> bufferVertices_;
+  std::vector<VKMeshChunk11> chunks_;
   lvk::Holder<lvk::BufferHandle> bufferTransforms_;
   lvk::Holder<lvk::BufferHandle> bufferDrawData_;
   lvk::Holder<lvk::BufferHandle> bufferMaterials_;
+  lvk::Holder<lvk::BufferHandle> bufferDequantization_;
+  lvk::Holder<lvk::BufferHandle> bufferDrawLODs_;
+
+  static constexpr uint32_t kUploadRingSegmentSize = 256 * 1024;
+
+  VKDirtyRanges11 dirtyMaterials_;
+  VKUploadRing11 uploadRing_;
+  uint64_t uploadedBytes_ = 0; // by the last uploadDirtyRanges()
+
+  // meshlets, empty if the mesh shader path is not available
+  lvk::Holder<lvk::BufferHandle> bufferMeshlets_;
+  lvk::Holder<lvk::BufferHandle> bufferMeshletVertices_;
+  lvk::Holder<lvk::BufferHandle> bufferMeshletTriangles_;
+  lvk::Holder<lvk::BufferHandle> bufferMeshletTasks_;
+  uint32_t maxMeshletTasks_ = 0;
+  uint32_t numMeshletTasks_ = 0;
 
   std::vector<DrawData> drawData_;
+  std::vector<DrawLODs> drawLODs_;
+
+  struct DrawMeshlets {
+    MeshletRange range;
+    uint32_t baseVertex = 0;
+  };
+  std::vector<DrawMeshlets> drawMeshlets_; // indexed by baseInstance
+
+  // streaming mode, empty otherwise
+  struct StreamedMesh {
+    uint32_t chunk       = 0;
+    uint64_t indexBegin  = 0;
+    uint64_t indexEnd    = 0;
+    uint64_t vertexBegin = 0;
+    uint64_t vertexEnd   = 0;
+    BoundingBox boxWS; // of all the instances
+  };
+  std::vector<StreamedMesh> streamedMeshes_; // indexed by mesh
+  std::vector<uint8_t> meshResident_;        // indexed by mesh
+  std::vector<uint32_t> meshForDraw_;        // indexed by baseInstance
+  std::vector<uint32_t> streamQueue_;        // meshes in the upload order
+  size_t streamNext_             = 0;
+  uint64_t streamIndexProgress_  = 0; // bytes of streamQueue_[streamNext_] uploaded so far
+  uint64_t streamVertexProgress_ = 0;
+  uint64_t streamedBytes_        = 0;
+  uint32_t streamFrames_         = 0;
+  uint32_t streamVertexSize_     = 0;
+  std::span<const uint32_t> streamIndices_;
+  std::span<const uint8_t> streamVertices_;
+  std::shared_ptr<MappedFile> streamFile_; // keeps a memory-mapped source alive
+  std::chrono::steady_clock::time_point streamStart_;
 
   VKIndirectBuffer11 indirectBuffer_;
 
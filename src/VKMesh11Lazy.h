@@ -110,16 +110,20 @@ class VKMesh11Lazy final : public VKMesh11
 public:
   VKMesh11Lazy(
       const std::unique_ptr<lvk::IContext>& ctx, const MeshData& meshData, const Scene& scene,
-      lvk::StorageType indirectBufferStorage = lvk::StorageType_Device)
+      lvk::StorageType indirectBufferStorage = lvk::StorageType_Device, bool streamGeometry = false)
 	  // call the constructor of base class before running own constructor
-  : VKMesh11(ctx, meshData, scene, indirectBufferStorage, false)
+  : VKMesh11(ctx, meshData, scene, indirectBufferStorage, false, 0, streamGeometry)
   {
     materialsGPU_.resize(materialsCPU_.size());
 
     // construct Taskflow
 	 // step is 1, which means i will be 1, 2, 3, 4...
     taskflow_.for_each_index(0u, static_cast<uint32_t>(materialsCPU_.size()), 1u, [&](int i) {
-      materialsGPU_[i] = convertToGPUMaterialLazy(ctx, materialsCPU_[i], textureFiles_, textureCache_, loadedTextureData_, loadingMutex_);
+      const GLTFMaterialDataGPU mtl =
+          convertToGPUMaterialLazy(ctx, materialsCPU_[i], textureFiles_, textureCache_, loadedTextureData_, loadingMutex_);
+      std::lock_guard lock(loadingMutex_);
+      materialsGPU_[i] = mtl;
+      markMaterialsDirty(i);
     });
 
     // start loading
@@ -171,24 +175,41 @@ public:
 
       // go through the texture cache and update materials
 		// map the texture index from CPU to GPU (descriptor array)
+      // only the materials which actually changed are marked, uploadDirtyRanges() copies just those
       for (size_t i = 0; i != materialsCPU_.size(); i++) {
         const Material& mtl = materialsCPU_[i];
 
         GLTFMaterialDataGPU& m = materialsGPU_[i];
 
-        m.baseColorTexture    = getTextureFromCache(mtl.baseColorTexture);
-        m.emissiveTexture     = getTextureFromCache(mtl.emissiveTexture);
-        m.normalTexture       = getTextureFromCache(mtl.normalTexture);
-        m.transmissionTexture = getTextureFromCache(mtl.opacityTexture);
+        const uint32_t baseColorTexture    = getTextureFromCache(mtl.baseColorTexture);
+        const uint32_t emissiveTexture     = getTextureFromCache(mtl.emissiveTexture);
+        const uint32_t normalTexture       = getTextureFromCache(mtl.normalTexture);
+        const uint32_t transmissionTexture = getTextureFromCache(mtl.opacityTexture);
+
+        if (m.baseColorTexture == baseColorTexture && m.emissiveTexture == emissiveTexture && m.normalTexture == normalTexture &&
+            m.transmissionTexture == transmissionTexture)
+          continue;
+
+        m.baseColorTexture    = baseColorTexture;
+        m.emissiveTexture     = emissiveTexture;
+        m.normalTexture       = normalTexture;
+        m.transmissionTexture = transmissionTexture;
+
+        markMaterialsDirty((uint32_t)i);
       }
     }
 
-	 // upload the materialsGPU data to the GPU buffer
-    ctx->upload(bufferMaterials_, materialsGPU_.data(), materialsGPU_.size() * sizeof(decltype(materialsGPU_)::value_type));
-
     return true;
   }
 
+  // the loading threads write materialsGPU_ and mark it dirty
+  uint64_t uploadDirtyRanges()
+  {
+    std::lock_guard lock(loadingMutex_);
+
+    return VKMesh11::uploadDirtyRanges();
+  }
+
 public:
   // multithreading
   std::mutex loadingMutex_;
@@ -0,0 +1,379 @@
+#pragma once
+
+#include "Chapter11/VKMesh11.h"
+
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_RASTERIZER_SSE 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define OCCLUSION_RASTERIZER_NEON 1
+#endif
+
+// Software depth buffer for the CPU occlusion culling. A few large occluders (see selectOccluders()) are rasterized at a low
+// resolution into the nearest depth of every pixel, then isOccluded() rejects the boxes whose nearest depth is farther than
+// every pixel they cover. The screen is split into tiles: the worker threads first project the triangles and bin them into the
+// tiles they overlap (one bin list per range of triangles, so no locking), then every tile is rasterized by one thread, 4 pixels
+// at a time. The depth of each tile is stored contiguously together with its farthest value for a quick rejection.
+// There is no Vulkan here, the class can be used without a GPU
+class VKOcclusionRasterizer11 final
+{
+public:
+  static constexpr uint32_t kTileWidth         = 32; // a multiple of 4
+  static constexpr uint32_t kTileHeight        = 16;
+  static constexpr uint32_t kTrianglesPerRange = 1024;
+
+  // the size is rounded up to whole tiles
+  explicit VKOcclusionRasterizer11(
+      uint32_t width = 256, uint32_t height = 128, size_t numThreads = std::thread::hardware_concurrency())
+  : tilesX_((std::max(width, 1u) + kTileWidth - 1) / kTileWidth)
+  , tilesY_((std::max(height, 1u) + kTileHeight - 1) / kTileHeight)
+  , width_(tilesX_ * kTileWidth)
+  , height_(tilesY_ * kTileHeight)
+  , executor_(std::max(numThreads, size_t(1)))
+  {
+    depth_.assign(width_ * height_, kFar);
+    tileMaxDepth_.assign(tilesX_ * tilesY_, kFar);
+  }
+
+  // world-space triangles, 3 vertices per triangle
+  void setOccluders(std::vector<vec3> vertices)
+  {
+    vertices_ = std::move(vertices);
+
+    const uint32_t numTriangles = getNumTriangles();
+    const uint32_t numRanges    = (numTriangles + kTrianglesPerRange - 1) / kTrianglesPerRange;
+
+    triangles_.resize(numTriangles);
+    bins_.assign(numRanges * tilesX_ * tilesY_, {});
+  }
+
+  // rasterizes the occluders as seen through viewProj, the result is used by isOccluded() until the next call
+  void render(const mat4& viewProj)
+  {
+    viewProj_ = viewProj;
+
+    const uint32_t numTriangles = getNumTriangles();
+    const uint32_t numRanges    = (numTriangles + kTrianglesPerRange - 1) / kTrianglesPerRange;
+    const uint32_t numTiles     = tilesX_ * tilesY_;
+
+    tf::Taskflow taskflow;
+
+    tf::Task binTriangles = taskflow.for_each_index(0u, numRanges, 1u, [this, numTriangles, numTiles](uint32_t r) {
+      std::vector<uint32_t>* bins = &bins_[r * numTiles];
+      for (uint32_t t = 0; t != numTiles; t++)
+        bins[t].clear();
+      for (uint32_t i = r * kTrianglesPerRange; i != std::min((r + 1) * kTrianglesPerRange, numTriangles); i++) {
+        if (!setupTriangle(i))
+          continue;
+        const Triangle& tri = triangles_[i];
+        for (int32_t ty = tri.minY / (int32_t)kTileHeight; ty <= tri.maxY / (int32_t)kTileHeight; ty++)
+          for (int32_t tx = tri.minX / (int32_t)kTileWidth; tx <= tri.maxX / (int32_t)kTileWidth; tx++)
+            bins[ty * tilesX_ + tx].push_back(i);
+      }
+    });
+    tf::Task rasterizeTiles = taskflow.for_each_index(0u, numTiles, 1u, [this, numRanges, numTiles](uint32_t t) {
+      float* tile = &depth_[t * kTileWidth * kTileHeight];
+      std::fill(tile, tile + kTileWidth * kTileHeight, kFar);
+      for (uint32_t r = 0; r != numRanges; r++)
+        for (uint32_t i : bins_[r * numTiles + t])
+          rasterizeTriangle(triangles_[i], t);
+      tileMaxDepth_[t] = *std::max_element(tile, tile + kTileWidth * kTileHeight);
+    });
+
+    binTriangles.precede(rasterizeTiles);
+
+    executor_.run(taskflow).wait();
+  }
+
+  // true if the box is entirely behind the occluders of the last render(); can be called from any number of threads
+  bool isOccluded(const BoundingBox& box) const
+  {
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float minZ = std::numeric_limits<float>::max();
+
+    for (int i = 0; i != 8; i++) {
+      const vec3 p = vec3(i & 1 ? box.max_.x : box.min_.x, i & 2 ? box.max_.y : box.min_.y, i & 4 ? box.max_.z : box.min_.z);
+      const vec4 clip = viewProj_ * vec4(p, 1.0f);
+      // the box reaches the camera plane
+      if (clip.w < kMinW)
+        return false;
+      const vec3 s = toScreen(clip);
+      minX         = std::min(minX, s.x);
+      minY         = std::min(minY, s.y);
+      maxX         = std::max(maxX, s.x);
+      maxY         = std::max(maxY, s.y);
+      minZ         = std::min(minZ, s.z);
+    }
+
+    // all the pixels touched by the screen-space rectangle of the box
+    const int32_t x0 = std::max((int32_t)std::floor(std::clamp(minX, -1.0f, float(width_))), 0);
+    const int32_t y0 = std::max((int32_t)std::floor(std::clamp(minY, -1.0f, float(height_))), 0);
+    const int32_t x1 = std::min((int32_t)std::floor(std::clamp(maxX, -1.0f, float(width_))), (int32_t)width_ - 1);
+    const int32_t y1 = std::min((int32_t)std::floor(std::clamp(maxY, -1.0f, float(height_))), (int32_t)height_ - 1);
+
+    if (x0 > x1 || y0 > y1)
+      return false;
+
+    for (int32_t ty = y0 / (int32_t)kTileHeight; ty <= y1 / (int32_t)kTileHeight; ty++) {
+      for (int32_t tx = x0 / (int32_t)kTileWidth; tx <= x1 / (int32_t)kTileWidth; tx++) {
+        const uint32_t t = ty * tilesX_ + tx;
+        if (minZ > tileMaxDepth_[t])
+          continue;
+        const float* tile = &depth_[t * kTileWidth * kTileHeight];
+        for (int32_t y = std::max(y0, ty * (int32_t)kTileHeight); y <= std::min(y1, (ty + 1) * (int32_t)kTileHeight - 1); y++)
+          for (int32_t x = std::max(x0, tx * (int32_t)kTileWidth); x <= std::min(x1, (tx + 1) * (int32_t)kTileWidth - 1); x++)
+            if (tile[(y - ty * kTileHeight) * kTileWidth + (x - tx * kTileWidth)] >= minZ)
+              return false;
+      }
+    }
+
+    return true;
+  }
+
+  // the nearest depth at the pixel (x, y), or std::numeric_limits<float>::max() where no occluder was drawn
+  float getDepth(uint32_t x, uint32_t y) const
+  {
+    const uint32_t t = (y / kTileHeight) * tilesX_ + x / kTileWidth;
+    return depth_[t * kTileWidth * kTileHeight + (y % kTileHeight) * kTileWidth + x % kTileWidth];
+  }
+
+  uint32_t getWidth() const { return width_; }
+  uint32_t getHeight() const { return height_; }
+  uint32_t getNumTriangles() const { return (uint32_t)(vertices_.size() / 3); }
+  size_t getNumThreads() const { return executor_.num_workers(); }
+
+private:
+  static constexpr float kFar  = std::numeric_limits<float>::max();
+  static constexpr float kMinW = 1e-3f;
+
+  // edge functions and depth as planes in screen space: a * x + b * y + c
+  struct Triangle {
+    vec3 edge[3]; // >= 0 inside
+    vec3 depth;
+    // the pixels with the centers inside the bounding rectangle, clamped to the screen
+    int32_t minX = 0;
+    int32_t minY = 0;
+    int32_t maxX = -1;
+    int32_t maxY = -1;
+  };
+
+  // x, y in pixels, z is the depth
+  vec3 toScreen(const vec4& clip) const
+  {
+    const float invW = 1.0f / clip.w;
+    return vec3((clip.x * invW * 0.5f + 0.5f) * float(width_), (clip.y * invW * 0.5f + 0.5f) * float(height_), clip.z * invW);
+  }
+
+  // returns false if the triangle covers no pixels or crosses the camera plane (skipping an occluder is always safe)
+  bool setupTriangle(uint32_t i)
+  {
+    Triangle& tri = triangles_[i];
+    tri.maxX      = -1;
+
+    vec3 v[3];
+    for (int k = 0; k != 3; k++) {
+      const vec4 clip = viewProj_ * vec4(vertices_[3 * i + k], 1.0f);
+      if (clip.w < kMinW)
+        return false;
+      v[k] = toScreen(clip);
+    }
+
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+    if (std::abs(area) < 1e-8f)
+      return false;
+    // both sides of the occluders are drawn
+    if (area < 0.0f) {
+      std::swap(v[1], v[2]);
+      area = -area;
+    }
+
+    const float w = float(width_);
+    const float h = float(height_);
+    tri.minX      = std::max((int32_t)std::ceil(std::clamp(std::min({ v[0].x, v[1].x, v[2].x }), -1.0f, w) - 0.5f), 0);
+    tri.minY      = std::max((int32_t)std::ceil(std::clamp(std::min({ v[0].y, v[1].y, v[2].y }), -1.0f, h) - 0.5f), 0);
+    tri.maxX      = std::min((int32_t)std::floor(std::clamp(std::max({ v[0].x, v[1].x, v[2].x }), -1.0f, w) - 0.5f), (int32_t)width_ - 1);
+    tri.maxY      = std::min((int32_t)std::floor(std::clamp(std::max({ v[0].y, v[1].y, v[2].y }), -1.0f, h) - 0.5f), (int32_t)height_ - 1);
+
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+      return false;
+
+    for (int k = 0; k != 3; k++) {
+      const vec3& a = v[k];
+      const vec3& b = v[(k + 1) % 3];
+      tri.edge[k]   = vec3(a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x);
+    }
+
+    const float dzdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+    const float dzdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+    tri.depth        = vec3(dzdx, dzdy, v[0].z - dzdx * v[0].x - dzdy * v[0].y);
+
+    return true;
+  }
+
+  void rasterizeTriangle(const Triangle& tri, uint32_t t)
+  {
+    const int32_t tileX = (int32_t)(t % tilesX_ * kTileWidth);
+    const int32_t tileY = (int32_t)(t / tilesX_ * kTileHeight);
+    const int32_t x0    = std::max(tri.minX, tileX);
+    const int32_t x1    = std::min(tri.maxX, tileX + (int32_t)kTileWidth - 1);
+    const int32_t y0    = std::max(tri.minY, tileY);
+    const int32_t y1    = std::min(tri.maxY, tileY + (int32_t)kTileHeight - 1);
+
+    float* tile = &depth_[t * kTileWidth * kTileHeight];
+
+    // groups of 4 pixels aligned within the tile row
+    const int32_t groupX0 = x0 & ~3;
+
+    for (int32_t y = y0; y <= y1; y++) {
+      const float py = float(y) + 0.5f;
+      float* row     = tile + (y - tileY) * kTileWidth;
+      for (int32_t x = groupX0; x <= x1; x += 4) {
+#if defined(OCCLUSION_RASTERIZER_SSE)
+        const __m128 lane = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+        const __m128 px   = _mm_add_ps(lane, _mm_set1_ps(0.5f));
+        __m128 inside     = _mm_and_ps(_mm_cmpge_ps(lane, _mm_set1_ps(float(x0))), _mm_cmple_ps(lane, _mm_set1_ps(float(x1))));
+        for (int k = 0; k != 3; k++) {
+          const vec3& e = tri.edge[k];
+          const __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e.x), px), _mm_set1_ps(e.y * py + e.z));
+          inside         = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        if (!_mm_movemask_ps(inside))
+          continue;
+        const __m128 z   = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.depth.x), px), _mm_set1_ps(tri.depth.y * py + tri.depth.z));
+        const __m128 old = _mm_loadu_ps(row + x - tileX);
+        _mm_storeu_ps(row + x - tileX, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+#elif defined(OCCLUSION_RASTERIZER_NEON)
+        const float offsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        const float32x4_t lane = vaddq_f32(vdupq_n_f32(float(x)), vld1q_f32(offsets));
+        const float32x4_t px   = vaddq_f32(lane, vdupq_n_f32(0.5f));
+        uint32x4_t inside      = vandq_u32(vcgeq_f32(lane, vdupq_n_f32(float(x0))), vcleq_f32(lane, vdupq_n_f32(float(x1))));
+        for (int k = 0; k != 3; k++) {
+          const vec3& e        = tri.edge[k];
+          const float32x4_t d = vmlaq_n_f32(vdupq_n_f32(e.y * py + e.z), px, e.x);
+          inside               = vandq_u32(inside, vcgeq_f32(d, vdupq_n_f32(0.0f)));
+        }
+        if (!vmaxvq_u32(inside))
+          continue;
+        const float32x4_t z   = vmlaq_n_f32(vdupq_n_f32(tri.depth.y * py + tri.depth.z), px, tri.depth.x);
+        const float32x4_t old = vld1q_f32(row + x - tileX);
+        vst1q_f32(row + x - tileX, vbslq_f32(inside, vminq_f32(old, z), old));
+#else
+        for (int32_t j = std::max(x, x0); j <= std::min(x + 3, x1); j++) {
+          const vec3 p = vec3(float(j) + 0.5f, py, 1.0f);
+          if (glm::dot(tri.edge[0], p) >= 0.0f && glm::dot(tri.edge[1], p) >= 0.0f && glm::dot(tri.edge[2], p) >= 0.0f)
+            row[j - tileX] = std::min(row[j - tileX], glm::dot(tri.depth, p));
+        }
+#endif
+      }
+    }
+  }
+
+private:
+  uint32_t tilesX_ = 0;
+  uint32_t tilesY_ = 0;
+  uint32_t width_  = 0;
+  uint32_t height_ = 0;
+
+  tf::Executor executor_;
+
+  std::vector<vec3> vertices_;
+  std::vector<Triangle> triangles_; // screen space, valid after render()
+  std::vector<std::vector<uint32_t>> bins_; // [range * numTiles + tile] -> triangles
+
+  mat4 viewProj_ = mat4(1.0f);
+
+  std::vector<float> depth_; // tile by tile, kTileWidth * kTileHeight floats each
+  std::vector<float> tileMaxDepth_;
+};
+
+// Picks the occluders for VKOcclusionRasterizer11 among the opaque mesh nodes and returns their LOD 0 triangles in world space.
+// The nodes with isTagged(node) come first, then the ones with the largest face of their world-space box (a wall has almost
+// no volume), as long as the total stays within maxTriangles. Meshes with more than maxTrianglesPerMesh triangles are detailed
+// props rather than building shells and are skipped, as well as the transparent and alpha-tested ones.
+// Needs the index and vertex data, so it has to run before MeshData::releaseMappedData()
+template <typename IsTagged>
+std::vector<vec3> selectOccluders(
+    const MeshData& meshData, const Scene& scene, IsTagged&& isTagged, uint32_t maxTriangles = 32768,
+    uint32_t maxTrianglesPerMesh = 4096)
+{
+  struct Candidate {
+    uint32_t node  = 0;
+    uint32_t mesh  = 0;
+    bool tagged    = false;
+    float faceArea = 0.0f;
+  };
+
+  std::vector<Candidate> candidates;
+  candidates.reserve(scene.meshForNode.size());
+
+  for (const auto& p : scene.meshForNode) {
+    const Mesh& mesh    = meshData.meshes[p.second];
+    const Material& mtl = meshData.materials[mesh.materialID];
+    if ((mtl.flags & sMaterialFlags_Transparent) || mtl.alphaTest > 0.0f)
+      continue;
+    if (mesh.getLODIndicesCount(0) / 3 > maxTrianglesPerMesh)
+      continue;
+    const BoundingBox box = meshData.boxes[p.second].getTransformed(scene.globalTransform[p.first]);
+    const vec3 size       = box.max_ - box.min_;
+    candidates.push_back({
+        .node     = p.first,
+        .mesh     = p.second,
+        .tagged   = isTagged(p.first),
+        .faceArea = std::max({ size.x * size.y, size.y * size.z, size.z * size.x }),
+    });
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+    return a.tagged != b.tagged ? a.tagged : a.faceArea > b.faceArea;
+  });
+
+  const std::span<const uint32_t> indices = meshData.getIndexData();
+  const std::span<const uint8_t> vertices = meshData.getVertexData();
+
+  const bool quantized      = isVertexFormatQuantized(meshData.streams);
+  const uint32_t vertexSize = meshData.streams.getVertexSize();
+  const uint32_t posOffset  = meshData.streams.attributes[0].offset;
+
+  LVK_ASSERT(quantized || meshData.streams.attributes[0].format == lvk::VertexFormat::Float3);
+
+  std::vector<vec3> triangles;
+  uint32_t numTriangles = 0;
+
+  for (const Candidate& c : candidates) {
+    const Mesh& mesh          = meshData.meshes[c.mesh];
+    const uint32_t numIndices = mesh.getLODIndicesCount(0);
+    if (numTriangles + numIndices / 3 > maxTriangles)
+      continue;
+    numTriangles += numIndices / 3;
+
+    const AffineTransform& t = scene.globalTransform[c.node];
+    const BoundingBox& box   = meshData.boxes[c.mesh];
+
+    for (uint32_t i = 0; i != numIndices; i++) {
+      const uint8_t* v = vertices.data() + (mesh.vertexOffset + indices[mesh.indexOffset + mesh.lodOffset[0] + i]) * vertexSize + posOffset;
+      vec3 pos;
+      if (quantized) {
+        // UShort4Norm, relative to the box of the mesh
+        uint16_t q[3];
+        memcpy(q, v, sizeof(q));
+        pos = box.min_ + (box.max_ - box.min_) * vec3(q[0] / 65535.0f, q[1] / 65535.0f, q[2] / 65535.0f);
+      } else {
+        memcpy(&pos, v, sizeof(pos));
+      }
+      triangles.push_back(t.transformPoint(pos));
+    }
+  }
+
+  return triangles;
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "Chapter11/VKMesh11.h"
+
+// Propagates the scene hierarchy on the GPU. The local transforms of the changed nodes (Scene::changedAtThisFrame[])
+// are copied into a storage buffer, and transforms.comp runs once per hierarchy level, writing the global transforms
+// into VKMesh11::bufferTransforms_ and refitting the world-space AABBs (one per node) used by the GPU culling.
+// Scene::globalTransform is not updated. Nothing waits for the GPU in the steady state: the host-visible node lists and
+// local transforms come in one set more than there are frames in flight (swapchain images), used round-robin, and the
+// refitted AABBs are copied into a ring of readback slots tagged with submit handles (as in VKStatsReadback11), one more
+// again, so a finished slot is not overwritten before pollBoxes() has seen it. pollBoxes() hands the newest finished slot
+// to the CPU culling, the LOD selection and the light frustum, a few frames after the update
+class VKSceneTransforms11 final
+{
+public:
+  VKSceneTransforms11(
+      const std::unique_ptr<lvk::IContext>& ctx, const MeshData& meshData, const Scene& scene, lvk::BufferHandle bufferTransforms,
+      lvk::BufferHandle bufferAABBs)
+  : ctx_(ctx)
+  , bufferTransforms_(bufferTransforms)
+  , bufferAABBs_(bufferAABBs)
+  , numNodes_((uint32_t)scene.hierarchy.size())
+  , sets_(ctx->getNumSwapchainImages() + 1)
+  , readbackSlots_(sets_.size() + 1)
+  {
+    std::vector<int> parents(numNodes_);
+    for (uint32_t i = 0; i != numNodes_; i++)
+      parents[i] = scene.hierarchy[i].parent;
+
+    // nodes without a mesh get an empty box, transforms.comp skips them
+    const float maxValue = std::numeric_limits<float>::max();
+    std::vector<BoundingBox> localBoxes(numNodes_, BoundingBox(vec3(maxValue), vec3(-maxValue)));
+    for (const auto& p : scene.meshForNode)
+      localBoxes[p.first] = meshData.boxes[p.second];
+
+    bufferParents_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = parents.size() * sizeof(int),
+          .data      = parents.data(),
+          .debugName = "Buffer: parents" },
+        nullptr);
+    bufferLocalBoxes_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_Device,
+          .size      = localBoxes.size() * sizeof(BoundingBox),
+          .data      = localBoxes.data(),
+          .debugName = "Buffer: local AABBs" },
+        nullptr);
+    for (Set& set : sets_) {
+      // host-visible: update() writes only the entries of the changed nodes, transforms.comp reads only those
+      set.bufferLocalTransforms = ctx->createBuffer(
+          { .usage     = lvk::BufferUsageBits_Storage,
+            .storage   = lvk::StorageType_HostVisible,
+            .size      = scene.localTransform.size() * sizeof(AffineTransform),
+            .debugName = "Buffer: local transforms" },
+          nullptr);
+      // the changed nodes of all levels back to back, every node at most once
+      set.bufferNodes = ctx->createBuffer(
+          { .usage     = lvk::BufferUsageBits_Storage,
+            .storage   = lvk::StorageType_HostVisible,
+            .size      = numNodes_ * sizeof(uint32_t),
+            .debugName = "Buffer: changed nodes" },
+          nullptr);
+    }
+    bufferReadbackBoxes_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_HostVisible,
+          .size      = readbackSlots_.size() * numNodes_ * sizeof(BoundingBox),
+          .debugName = "Buffer: readback AABBs" },
+        nullptr);
+
+    comp_     = loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/transforms.comp");
+    pipeline_ = ctx->createComputePipeline({
+        .smComp = comp_,
+    });
+  }
+
+  // Consumes scene.changedAtThisFrame[] and calls clearChangedNodes(). The dispatches are recorded into a separate command buffer and submitted
+  // right away; lvk chains its submissions, so the command buffers submitted afterwards see the new transforms and boxes.
+  // readbackBoxes: copy the boxes for pollBoxes() if they have changed since the last copy; the GPU culling reads them in
+  // place and does not need it. Returns false if nothing has changed
+  bool update(Scene& scene, bool readbackBoxes)
+  {
+    Set& set = sets_[nextSet_];
+
+    // submitted more frames ago than can be in flight, it has finished unless the update() calls outpace the frames
+    if (!set.handle.empty() && !ctx_->isReady(set.handle))
+      ctx_->wait(set.handle);
+
+    uint32_t* nodes                  = reinterpret_cast<uint32_t*>(ctx_->getMappedPtr(set.bufferNodes));
+    AffineTransform* localTransforms = reinterpret_cast<AffineTransform*>(ctx_->getMappedPtr(set.bufferLocalTransforms));
+
+    uint32_t levelOffsets[MAX_NODE_LEVEL + 1] = {};
+
+    uint32_t numChangedNodes = 0;
+
+    // markAsChanged() queues every node at most once, so the node list cannot overflow
+    for (int level = 0; level != MAX_NODE_LEVEL; level++) {
+      levelOffsets[level] = numChangedNodes;
+      LVK_ASSERT(numChangedNodes + scene.changedAtThisFrame[level].size() <= numNodes_);
+      for (int node : scene.changedAtThisFrame[level]) {
+        nodes[numChangedNodes++] = (uint32_t)node;
+        localTransforms[node]    = scene.localTransform[node];
+      }
+    }
+    levelOffsets[MAX_NODE_LEVEL] = numChangedNodes;
+
+    clearChangedNodes(scene);
+
+    numUpdatedNodes_ = numChangedNodes;
+
+    if (numChangedNodes)
+      boxesOutdated_ = true;
+
+    // a slot still in flight is never waited for, the copy is retried by a later update()
+    ReadbackSlot& slot     = readbackSlots_[nextSlot_];
+    const bool copyBoxes   = readbackBoxes && boxesOutdated_ && !(slot.pending && !ctx_->isReady(slot.handle));
+    const size_t boxesSize = numNodes_ * sizeof(BoundingBox);
+
+    if (!numChangedNodes && !copyBoxes)
+      return false;
+
+    lvk::ICommandBuffer& buf = ctx_->acquireCommandBuffer();
+
+    if (numChangedNodes) {
+      ctx_->flushMappedMemory(set.bufferNodes, 0, numChangedNodes * sizeof(uint32_t));
+      ctx_->flushMappedMemory(set.bufferLocalTransforms, 0, numNodes_ * sizeof(AffineTransform));
+
+      struct {
+        uint64_t localTransforms;
+        uint64_t globalTransforms;
+        uint64_t parents;
+        uint64_t nodes;
+        uint64_t localBoxes;
+        uint64_t worldBoxes;
+        uint32_t firstNode;
+        uint32_t numNodes;
+      } pc = {
+        .localTransforms  = ctx_->gpuAddress(set.bufferLocalTransforms),
+        .globalTransforms = ctx_->gpuAddress(bufferTransforms_),
+        .parents          = ctx_->gpuAddress(bufferParents_),
+        .nodes            = ctx_->gpuAddress(set.bufferNodes),
+        .localBoxes       = ctx_->gpuAddress(bufferLocalBoxes_),
+        .worldBoxes       = ctx_->gpuAddress(bufferAABBs_),
+      };
+
+      buf.cmdBindComputePipeline(pipeline_);
+
+      for (int level = 0; level != MAX_NODE_LEVEL; level++) {
+        pc.firstNode = levelOffsets[level];
+        pc.numNodes  = levelOffsets[level + 1] - levelOffsets[level];
+        if (!pc.numNodes)
+          continue;
+        buf.cmdPushConstants(pc);
+        // the barrier makes the global transforms of the previous level visible
+        buf.cmdDispatchThreadGroups({ 1 + (pc.numNodes - 1) / 64 }, { .buffers = { bufferTransforms_ } });
+      }
+    }
+
+    if (copyBoxes)
+      buf.cmdCopyBuffer(bufferAABBs_, 0, bufferReadbackBoxes_, nextSlot_ * boxesSize, boxesSize);
+
+    const lvk::SubmitHandle handle = ctx_->submit(buf);
+
+    if (numChangedNodes) {
+      set.handle = handle;
+      nextSet_   = (nextSet_ + 1) % (uint32_t)sets_.size();
+    }
+
+    if (copyBoxes) {
+      slot           = { .handle = handle, .serial = ++lastSerial_, .pending = true };
+      nextSlot_      = (nextSlot_ + 1) % (uint32_t)readbackSlots_.size();
+      boxesOutdated_ = false;
+    }
+
+    return numChangedNodes != 0;
+  }
+
+  // Non-blocking: copies the world-space AABBs of all the nodes from the newest finished readback into boxes. Returns true
+  // if boxes has changed
+  bool pollBoxes(std::vector<BoundingBox>& boxes)
+  {
+    ReadbackSlot* newest = nullptr;
+
+    for (ReadbackSlot& slot : readbackSlots_) {
+      if (!slot.pending || !ctx_->isReady(slot.handle))
+        continue;
+      slot.pending = false;
+      if (slot.serial > deliveredSerial_ && (!newest || slot.serial > newest->serial))
+        newest = &slot;
+    }
+
+    if (!newest)
+      return false;
+
+    deliveredSerial_       = newest->serial;
+    const size_t boxesSize = numNodes_ * sizeof(BoundingBox);
+    boxes.resize(numNodes_);
+    // a host-visible buffer is read directly, there is no wait here
+    ctx_->download(bufferReadbackBoxes_, boxes.data(), boxesSize, (newest - readbackSlots_.data()) * boxesSize);
+
+    return true;
+  }
+
+  // the boxes have moved since the last copy for pollBoxes(), e.g. the updates did not ask for it
+  bool areBoxesOutdated() const { return boxesOutdated_; }
+
+  uint32_t getNumUpdatedNodes() const { return numUpdatedNodes_; }
+
+private:
+  const std::unique_ptr<lvk::IContext>& ctx_;
+
+  lvk::BufferHandle bufferTransforms_;
+  lvk::BufferHandle bufferAABBs_;
+
+  lvk::Holder<lvk::BufferHandle> bufferParents_;
+  lvk::Holder<lvk::BufferHandle> bufferLocalBoxes_;
+  lvk::Holder<lvk::BufferHandle> bufferReadbackBoxes_;
+  lvk::Holder<lvk::ShaderModuleHandle> comp_;
+  lvk::Holder<lvk::ComputePipelineHandle> pipeline_;
+
+  uint32_t numNodes_        = 0;
+  uint32_t numUpdatedNodes_ = 0;
+
+  struct Set {
+    lvk::Holder<lvk::BufferHandle> bufferLocalTransforms;
+    lvk::Holder<lvk::BufferHandle> bufferNodes;
+    lvk::SubmitHandle handle;
+  };
+  std::vector<Set> sets_;
+  uint32_t nextSet_ = 0;
+
+  struct ReadbackSlot {
+    lvk::SubmitHandle handle;
+    uint32_t serial = 0; // increases with every copy, pollBoxes() never goes back to an older one
+    bool pending    = false;
+  };
+  std::vector<ReadbackSlot> readbackSlots_;
+  uint32_t nextSlot_        = 0;
+  uint32_t lastSerial_      = 0;
+  uint32_t deliveredSerial_ = 0;
+
+  bool boxesOutdated_ = false;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Chapter11/VKMesh11.h"
+
+// Asynchronous readback of small GPU results (counters, statistics) without stalling the CPU. Every frame copies its counters
+// into the next slot of a host-visible ring buffer, the slot is tagged with the submit handle of that frame and read back by
+// poll() once the GPU has finished it, a few frames later. A slot still in flight is never waited for: the counters of that
+// frame are not copied at all. T is a plain struct of the counters; the fields a frame did not copy keep the values of an
+// older frame, so every frame tags its slot with flags telling which of them are valid
+template <typename T> class VKStatsReadback11 final
+{
+public:
+  static constexpr uint32_t kNoSlot = ~0u;
+
+  // size bytes at srcOffset of src go into the field at fieldOffset of T (use offsetof())
+  struct Copy {
+    lvk::BufferHandle src;
+    size_t srcOffset   = 0;
+    size_t fieldOffset = 0;
+    size_t size        = 0;
+  };
+
+  explicit VKStatsReadback11(
+      const std::unique_ptr<lvk::IContext>& ctx, uint32_t numSlots = 4, const char* debugName = "Buffer: stats readback")
+  : ctx_(ctx)
+  , slots_(std::max(numSlots, 1u))
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0);
+
+    const std::vector<T> empty(slots_.size());
+    buffer_ = ctx->createBuffer(
+        { .usage     = lvk::BufferUsageBits_Storage,
+          .storage   = lvk::StorageType_HostVisible,
+          .size      = sizeof(T) * slots_.size(),
+          .data      = empty.data(),
+          .debugName = debugName },
+        nullptr);
+  }
+
+  // takes the next slot for the frame being recorded; false if it is still in flight, cmdCopy() does nothing then
+  bool beginFrame()
+  {
+    poll();
+    current_ = slots_[next_].pending ? kNoSlot : next_;
+    return current_ != kNoSlot;
+  }
+
+  // all the copies of a frame in one call, they share their barriers
+  void cmdCopy(lvk::ICommandBuffer& buf, std::initializer_list<Copy> copies) const
+  {
+    if (current_ == kNoSlot)
+      return;
+
+    std::vector<lvk::BufferCopyRegion> regions;
+    regions.reserve(copies.size());
+    for (const Copy& c : copies) {
+      LVK_ASSERT(c.fieldOffset + c.size <= sizeof(T));
+      regions.push_back(
+          { .srcBuffer = c.src, .srcOffset = c.srcOffset, .dstBuffer = buffer_, .dstOffset = current_ * sizeof(T) + c.fieldOffset, .size = c.size });
+    }
+    buf.cmdCopyBuffers(regions.data(), (uint32_t)regions.size());
+  }
+
+  // call with the submit handle of every frame, after beginFrame(); flags are returned by getLatestFlags()
+  void endFrame(lvk::SubmitHandle handle, uint32_t flags = 0)
+  {
+    if (current_ != kNoSlot) {
+      slots_[current_] = { .handle = handle, .frame = frame_, .flags = flags, .pending = true };
+      next_            = (next_ + 1) % (uint32_t)slots_.size();
+      current_         = kNoSlot;
+    }
+    frame_++;
+  }
+
+  // non-blocking: reads back every finished slot, oldest first; returns true if getLatest() has changed
+  bool poll()
+  {
+    bool updated = false;
+
+    for (uint32_t i = 0; i != slots_.size(); i++) {
+      const uint32_t s = (next_ + i) % (uint32_t)slots_.size();
+      Slot& slot       = slots_[s];
+      if (!slot.pending || !ctx_->isReady(slot.handle))
+        continue;
+      // a host-visible buffer is read directly, there is no wait here
+      ctx_->download(buffer_, &latest_, sizeof(T), s * sizeof(T));
+      latestFrame_ = slot.frame;
+      latestFlags_ = slot.flags;
+      slot.pending = false;
+      updated      = true;
+    }
+
+    return updated;
+  }
+
+  // the counters of the most recent finished frame
+  const T& getLatest() const { return latest_; }
+  // the flags passed to endFrame() by the frame of getLatest()
+  uint32_t getLatestFlags() const { return latestFlags_; }
+  // how many frames ago the frame of getLatest() was submitted
+  uint32_t getLatency() const { return frame_ - latestFrame_; }
+
+private:
+  struct Slot {
+    lvk::SubmitHandle handle;
+    uint32_t frame = 0;
+    uint32_t flags = 0;
+    bool pending   = false;
+  };
+
+  const std::unique_ptr<lvk::IContext>& ctx_;
+
+  lvk::Holder<lvk::BufferHandle> buffer_;
+  std::vector<Slot> slots_;
+
+  uint32_t next_    = 0;
+  uint32_t current_ = kNoSlot;
+
+  uint32_t frame_       = 0;
+  uint32_t latestFrame_ = 0;
+  uint32_t latestFlags_ = 0;
+  T latest_             = {};
+};
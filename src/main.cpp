@@ -9,10 +9,26 @@ for the whole Vulkan 3D graphics and rendering book*/
 #define fileNameCachedMeshes ".cache/ch11_bistro.meshes"
 #define fileNameCachedMaterials ".cache/ch11_bistro.materials"
 #define fileNameCachedHierarchy ".cache/ch11_bistro.scene"
+#define fileNameCachedContainer ".cache/ch11_bistro.cache"
+// #define compressCachedContainer
+// #define benchmarkCachedContainer
+// #define benchmarkSceneTransforms
+// #define benchmarkSceneComponents
+// #define benchmarkSceneNodeOrder
+// #define benchmarkFrustumCulling
+// #define benchmarkOcclusionCulling
+// #define quantizeCachedVertices
+// #define runSelfTests
 
 #include "Chapter10/Bistro.h"
 #include "Chapter10/Skybox.h"
 #include "Chapter11/VKMesh11Lazy.h"
+#include "Chapter11/VKDepthPyramid11.h"
+#include "Chapter11/VKFrustumCuller11.h"
+#include "Chapter11/VKOcclusionRasterizer11.h"
+#include "Chapter11/VKSceneTransforms11.h"
+#include "Chapter11/VKStatsReadback11.h"
+#include "Chapter11/BistroBenchmarks.h"
 
 bool drawMeshesOpaque      = true;
 bool drawMeshesTransparent = true;
@@ -39,13 +55,27 @@ enum CullingMode {
   CullingMode_CPU  = 1,
   CullingMode_GPU  = 2,
 };
-mat4 cullingView       = mat4(1.0f);
-int cullingMode        = CullingMode_CPU;
-bool freezeCullingView = false;
+mat4 cullingView         = mat4(1.0f);
+int cullingMode          = CullingMode_CPU;
+bool freezeCullingView   = false;
+bool occlusionCulling    = false; // GPU culling only: two-phase occlusion culling against a depth pyramid
+bool cpuOcclusionCulling = false; // CPU culling only: the large occluders are rasterized in software
+bool occludersValid      = true;  // the software occluders are selected with the load-time transforms
+// GPU culling compacts the draw commands in arbitrary order, which breaks the per-chunk draws of the large-scene mode
+bool gpuCullingAvailable = true;
 
 int frameCount = 0; // use if we don't do culling every frame 
 bool cullingEveryFrame = true;
 bool compactedBuffer = true;
+// LODs
+bool enableLODs    = true;
+float lodThreshold = 256.0f; // projected diameter in pixels below which coarser LODs are used
+bool lodsChanged   = false;  // re-render the shadow maps with the new LOD settings (or newly streamed or moved meshes)
+// Streaming: the geometry is uploaded over several frames, starting with the meshes near the camera, so the first frame
+// does not wait for the whole scene
+bool streamMeshes = false;
+// Mesh shaders: the opaque meshes are culled per meshlet on the GPU, the other culling modes stay as the fallback
+bool useMeshShaders = false;
 
 // the directional light params struct isn't uploaded to GPU
 // but is used to compute light view and proj matrices, then the martices are uploaded to GPU
@@ -108,7 +138,10 @@ int main()
 {
   MeshData meshData;
   Scene scene;
+  // the self-checks use synthetic data only, they run before the Bistro is loaded
+  runBistroTests();
   loadBistro(meshData, scene);
+  runBistroBenchmarks(meshData, scene);
 
   VulkanApp app({
       .initialCameraPos    = vec3(-18.621f, 4.621f, -6.359f),
@@ -121,6 +154,8 @@ int main()
 
   std::unique_ptr<lvk::IContext> ctx(app.ctx_.get());
 
+  runBistroGPUTests(ctx);
+
   // get the dimension (size) of the swapchain image (window size)
   const lvk::Dimensions sizeFb = ctx->getDimensions(ctx->getCurrentSwapchainTexture());
 
@@ -153,6 +188,30 @@ int main()
       .debugName  = "msaaDepth",
   });
 
+  // the occlusion culling splits the opaque pass in two and builds the depth pyramid from the multisampled depth in between,
+  // so it renders into stored MSAA textures instead; they are created the first time it is enabled
+  lvk::Holder<lvk::TextureHandle> msaaColorStored;
+  lvk::Holder<lvk::TextureHandle> msaaDepthStored;
+
+  auto createStoredMSAATextures = [&]() {
+    msaaColorStored = ctx->createTexture({
+        .format     = kOffscreenFormat,
+        .dimensions = sizeFb,
+        .numSamples = kNumSamples,
+        .usage      = lvk::TextureUsageBits_Attachment,
+        .storage    = lvk::StorageType_Device,
+        .debugName  = "msaaColorStored",
+    });
+    msaaDepthStored = ctx->createTexture({
+        .format     = app.getDepthFormat(),
+        .dimensions = sizeFb,
+        .numSamples = kNumSamples,
+        .usage      = lvk::TextureUsageBits_Attachment | lvk::TextureUsageBits_Sampled,
+        .storage    = lvk::StorageType_Device,
+        .debugName  = "msaaDepthStored",
+    });
+  };
+
   // resolve texture for msaaDepth
   lvk::Holder<lvk::TextureHandle> texOpaqueDepth = ctx->createTexture({
       .format     = app.getDepthFormat(),
@@ -405,7 +464,18 @@ int main()
   const Skybox skyBox(
       ctx, "data/immenstadter_horn_2k_prefilter.ktx", "data/immenstadter_horn_2k_irradiance.ktx", kOffscreenFormat, app.getDepthFormat(),
       kNumSamples);
-  VKMesh11Lazy mesh(ctx, meshData, scene);
+  VKMesh11Lazy mesh(ctx, meshData, scene, lvk::StorageType_Device, streamMeshes);
+  gpuCullingAvailable = mesh.chunks_.size() == 1;
+  // the nearest meshes become visible first
+  mesh.prioritizeStreaming(app.camera_.getPosition());
+  // the CPU occlusion culling renders the largest opaque meshes and the nodes named "...occluder..." into a small depth buffer
+  VKOcclusionRasterizer11 occlusionRasterizer;
+  occlusionRasterizer.setOccluders(selectOccluders(meshData, scene, [&scene](uint32_t node) {
+    const auto it = scene.nameForNode.find(node);
+    return it != scene.nameForNode.end() && scene.nodeNames[it->second].find("occluder") != std::string::npos;
+  }));
+  // the geometry is either resident on the GPU now or referenced by the streaming, no need to keep the cache mapped here
+  meshData.releaseMappedData();
   const VKPipeline11 pipelineOpaque(
       ctx, meshData.streams, kOffscreenFormat, app.getDepthFormat(), kNumSamples,
       loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/main.vert"), loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/opaque.frag"));
@@ -414,14 +484,21 @@ int main()
       loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/main.vert"), loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/transparent.frag"));
   const VKPipeline11 pipelineShadow(
       ctx, meshData.streams, lvk::Format_Invalid, ctx->getFormat(texShadowMap), 1,
-      loadShaderModule(ctx, "Chapter11/03_DirectionalShadows/src/shadow.vert"),
-      loadShaderModule(ctx, "Chapter11/03_DirectionalShadows/src/shadow.frag"));
+      loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/shadow.vert"),
+      loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/shadow.frag"));
 
    const VKPipeline11 pipelineShadowCubeMap(
       ctx, meshData.streams, ctx->getFormat(texShadowCubeMap[0]), app.getDepthFormat(), 1,
       loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/shadowCubeMap.vert"),
       loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/shadowCubeMap.frag"));
 
+  // null if the device has no mesh shaders or the scene has no meshlets (large-scene mode, old caches)
+  std::unique_ptr<VKMeshletPipeline11> pipelineMeshlets =
+      mesh.hasMeshlets() ? std::make_unique<VKMeshletPipeline11>(
+                               ctx, meshData.streams, kOffscreenFormat, app.getDepthFormat(), kNumSamples,
+                               loadShaderModule(ctx, "Chapter11/07_MyFinalDemo/src/opaque.frag"))
+                         : nullptr;
+
   lvk::Holder<lvk::ShaderModuleHandle> vertOIT       = loadShaderModule(ctx, "data/shaders/QuadFlip.vert");
   lvk::Holder<lvk::ShaderModuleHandle> fragOIT       = loadShaderModule(ctx, "Chapter11/04_OIT/src/oit.frag");
   lvk::Holder<lvk::RenderPipelineHandle> pipelineOIT = ctx->createRenderPipeline({
@@ -585,7 +662,7 @@ int main()
       cullingMode = CullingMode_None;
     if (key == GLFW_KEY_C)
       cullingMode = CullingMode_CPU;
-    if (key == GLFW_KEY_G)
+    if (key == GLFW_KEY_G && gpuCullingAvailable)
       cullingMode = CullingMode_GPU;
   });
 
@@ -604,21 +681,46 @@ int main()
       .debugName = "Buffer: AABBs",
   });
 
+  // nodes marked with markAsChanged() get their global transforms and AABBs recomputed on the GPU
+  VKSceneTransforms11 sceneTransforms(ctx, meshData, scene, mesh.bufferTransforms_, bufferAABBs);
+
   // create the scene AABB in world space
-  BoundingBox bigBoxWS = reorderedBoxes.front();
-  for (const auto& b : reorderedBoxes) {
-    bigBoxWS.combinePoint(b.min_);
-    bigBoxWS.combinePoint(b.max_);
-  }
+  BoundingBox bigBoxWS;
+  auto updateSceneBox = [&bigBoxWS, &reorderedBoxes]() {
+    bigBoxWS = reorderedBoxes.front();
+    for (const auto& b : reorderedBoxes) {
+      bigBoxWS.combinePoint(b.min_);
+      bigBoxWS.combinePoint(b.max_);
+    }
+  };
+  updateSceneBox();
 
   struct CullingData {
     vec4 frustumPlanes[6];
     vec4 frustumCorners[8];
     uint32_t numMeshesToCull  = 0;
     uint32_t numVisibleMeshes = 0; // GPU
+    uint32_t enableLODs       = 0;
+    float lodThreshold        = 0.0f;
+    vec4 cameraPos            = vec4(0.0f); // w: pixel scale for selectLOD()
+    // occlusion culling, see FrustumCulling.comp
+    mat4 viewProj                                      = mat4(1.0f);
+    uint32_t numVisibleLate                            = 0; // GPU
+    uint32_t numOccluded                               = 0; // GPU
+    uint32_t resetVisibility                           = 0;
+    uint32_t pyramidNumLevels                          = 0;
+    uint32_t pyramidWidth                              = 0;
+    uint32_t pyramidHeight                             = 0;
+    uint32_t pad[2]                                    = {};
+    uint32_t pyramidLevels[VKDepthPyramid11::kMaxLevels] = {};
   } emptyCullingData;
+  static_assert(sizeof(CullingData) == 416, "CullingData has to match FrustumCulling.comp");
 
   int numVisibleMeshes = 0; // CPU
+  // occlusion culling stats: the meshes drawn in the first and in the second phase, and the ones hidden by the depth pyramid
+  uint32_t numVisibleFirstPhase  = 0;
+  uint32_t numVisibleSecondPhase = 0;
+  uint32_t numOccludedMeshes     = 0;
 
   // round-robin
   const lvk::BufferDesc cullingDataDesc = {
@@ -632,9 +734,31 @@ int main()
     ctx->createBuffer(cullingDataDesc, "Buffer: CullingData 0"),
     ctx->createBuffer(cullingDataDesc, "Buffer: CullingData 1"),
   };
-  lvk::SubmitHandle submitHandle[LVK_ARRAY_NUM_ELEMENTS(bufferCullingData)] = {};
 
-  uint32_t currentBufferId = 0; // for culling stats
+  uint32_t currentBufferId = 0; // round-robin index of bufferCullingData, meshesOpaqueArray and meshesShadow
+
+  // the two-phase occlusion culling: the meshes visible in the last frame are drawn first, the depth pyramid is built from
+  // msaaDepthStored, the remaining meshes are tested against it and the newly visible ones are drawn in a second render pass
+  enum CullingPhase : uint32_t {
+    CullingPhase_FrustumOnly  = 0,
+    CullingPhase_LastVisible  = 1,
+    CullingPhase_DepthPyramid = 2,
+  };
+
+  VKDepthPyramid11 depthPyramid(ctx, sizeFb);
+
+  // one uint per opaque draw command: visible after the second phase of the last frame
+  const std::vector<uint32_t> allVisible(mesh.numMeshes_, 1u);
+  lvk::Holder<lvk::BufferHandle> bufferVisibility = ctx->createBuffer(
+      { .usage     = lvk::BufferUsageBits_Storage,
+        .storage   = lvk::StorageType_Device,
+        .size      = allVisible.size() * sizeof(uint32_t),
+        .data      = allVisible.data(),
+        .debugName = "Buffer: occlusion visibility" },
+      nullptr);
+
+  // the draw commands changed or the occlusion culling was off, the visibility of the last frame is meaningless
+  bool resetOcclusionVisibility = true;
 
   struct {
     uint64_t commands;
@@ -642,24 +766,30 @@ int main()
     uint64_t AABBs;
     uint64_t meshes;
     uint64_t compactedCommands;
+    uint64_t drawLODs;
+    uint64_t visibility;
+    uint32_t phase;
   } pcCulling = {
-    .commands = 0,
-    .drawData = ctx->gpuAddress(mesh.bufferDrawData_),
-    .AABBs    = ctx->gpuAddress(bufferAABBs),
+    .commands   = 0,
+    .drawData   = ctx->gpuAddress(mesh.bufferDrawData_),
+    .AABBs      = ctx->gpuAddress(bufferAABBs),
+    .drawLODs   = ctx->gpuAddress(mesh.bufferDrawLODs_),
+    .visibility = ctx->gpuAddress(bufferVisibility),
+    .phase      = CullingPhase_FrustumOnly,
   };
 
   // filtered indirect buffers (only for opaque draw commands or transparent draw commands)
   VKIndirectBuffer11 meshesOpaque(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
   VKIndirectBuffer11 meshesTransparent(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
 
-  VKIndirectBuffer11 meshesOpaqueNotCulled(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
-
   // round-robin buffers for indirect command buffers for drawing opaque objects (CPU camera culling and compacted buffer)
   VKIndirectBuffer11 meshesOpaqueArray[2] = { VKIndirectBuffer11(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible),
                                          VKIndirectBuffer11(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible) };
 
   // GPU compacted indirect command buffer for drawing opaque obejcts (GPU camera culling)
   VKIndirectBuffer11 meshesOpaqueGPU(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
+  // the meshes found visible by the second phase of the occlusion culling
+  VKIndirectBuffer11 meshesOpaqueGPULate(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
 
   auto isTransparent = [&meshData, &mesh](const DrawIndexedIndirectCommand& c) -> bool {
     const uint32_t mtlIndex = mesh.drawData_[c.baseInstance].materialId;
@@ -667,19 +797,98 @@ int main()
     return (mtl.flags & sMaterialFlags_Transparent) > 0;
   };
 
-  // filter the indirect buffers
-  mesh.indirectBuffer_.selectTo(meshesOpaque, [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return !isTransparent(c); });
-  mesh.indirectBuffer_.selectTo(
-      meshesTransparent, [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return isTransparent(c); });
+  std::vector<DrawIndexedIndirectCommand> fullDrawCommands;
+
+  // CPU culling of fullDrawCommands
+  VKFrustumCuller11 frustumCuller;
+  // the same commands culled against the views of the shadow maps
+  VKFrustumCuller11 shadowCasterCuller;
+
+  // the CPU cullers keep their own copies of the boxes
+  auto updateCullerBoxes = [&]() {
+    auto getBox = [&reorderedBoxes, &mesh](const DrawIndexedIndirectCommand& c) -> const BoundingBox& {
+      return reorderedBoxes[mesh.drawData_[c.baseInstance].transformId];
+    };
+    frustumCuller.setCommands(fullDrawCommands, getBox);
+    shadowCasterCuller.setCommands(fullDrawCommands, getBox);
+  };
+
+  // filter the indirect buffers; while the geometry is streamed in, only the resident meshes are drawn, so this is
+  // repeated every time more meshes become resident
+  auto updateDrawLists = [&]() {
+    auto isOpaque = [&isTransparent, &mesh](const DrawIndexedIndirectCommand& c) -> bool {
+      return mesh.isDrawResident(c.baseInstance) && !isTransparent(c);
+    };
+    mesh.indirectBuffer_.selectTo(meshesOpaque, isOpaque);
+    mesh.indirectBuffer_.selectTo(meshesTransparent, [&isTransparent, &mesh](const DrawIndexedIndirectCommand& c) -> bool {
+      return mesh.isDrawResident(c.baseInstance) && isTransparent(c);
+    });
+
+    mesh.indirectBuffer_.selectTo(meshesOpaqueArray[0], isOpaque);
+    mesh.indirectBuffer_.selectTo(meshesOpaqueArray[1], isOpaque);
 
-  mesh.indirectBuffer_.selectTo(meshesOpaqueNotCulled, [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return !isTransparent(c); });
+    fullDrawCommands = meshesOpaque.drawCommands_;
 
-  mesh.indirectBuffer_.selectTo(meshesOpaqueArray[0], [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return !isTransparent(c); });
-  mesh.indirectBuffer_.selectTo(meshesOpaqueArray[1], [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return !isTransparent(c); });
+    updateCullerBoxes();
 
-  //mesh.indirectBuffer_.selectTo(meshesOpaqueGPU, [&isTransparent](const DrawIndexedIndirectCommand& c) -> bool { return !isTransparent(c); });
+    // the task shader culls every meshlet, so all the opaque draw commands are submitted every frame
+    if (mesh.hasMeshlets())
+      mesh.uploadMeshletTasks(fullDrawCommands);
 
-  std::vector<DrawIndexedIndirectCommand> fullDrawCommands = meshesOpaque.drawCommands_;
+    // the shadow maps have to include the new meshes
+    lodsChanged = true;
+
+    resetOcclusionVisibility = true;
+  };
+
+  updateDrawLists();
+
+  // every shadow map view draws its own compacted list of casters with its own LOD selection:
+  // 0 - directional light, 1 + 6 * j + face - the cube map faces of the point light j
+  // the lists are written by the CPU, so there are two sets of them and a set is rewritten only after the last frame which
+  // used it has finished
+  constexpr uint32_t kNumShadowViews = 1 + 2 * 6;
+  std::vector<VKIndirectBuffer11> meshesShadow[2];
+  lvk::SubmitHandle meshesShadowSubmitted[2];
+  for (std::vector<VKIndirectBuffer11>& views : meshesShadow) {
+    views.reserve(kNumShadowViews);
+    for (uint32_t i = 0; i != kNumShadowViews; i++)
+      views.emplace_back(ctx, mesh.numMeshes_, lvk::StorageType_HostVisible);
+  }
+
+  uint32_t numShadowCasters[kNumShadowViews] = {};
+
+  // cull the opaque draw commands against the frustum of a shadow map view and select the LODs as seen from eye;
+  // without planes, all the commands are taken
+  auto cullShadowCasters = [&ctx, &mesh, &reorderedBoxes, &fullDrawCommands, &shadowCasterCuller, &meshesShadow,
+                            &meshesShadowSubmitted, &currentBufferId, &numShadowCasters](
+                               uint32_t viewIndex, const mat4& viewProj, const vec4* planes, const vec4* corners, const vec3& eye,
+                               bool perspective) {
+    lvk::SubmitHandle& submitted = meshesShadowSubmitted[currentBufferId];
+    if (!submitted.empty()) {
+      ctx->wait(submitted);
+      submitted = {};
+    }
+    // the size of the shadow maps: 4096x4096 and 2048x2048 cube map faces
+    const float pixelScale = viewProj[1][1] * 0.5f * (perspective ? 2048.0f : 4096.0f);
+    auto selectShadowLOD   = [&](DrawIndexedIndirectCommand& c) {
+      if (enableLODs) {
+        const DrawLODs& lods   = mesh.drawLODs_[c.baseInstance];
+        const BoundingBox& box = reorderedBoxes[mesh.drawData_[c.baseInstance].transformId];
+        applyLOD(c, lods, selectLOD(box, eye, pixelScale, perspective, lodThreshold, lods.lodCount));
+      }
+    };
+    VKIndirectBuffer11& dst = meshesShadow[currentBufferId][viewIndex];
+    if (!planes) {
+      dst.drawCommands_ = fullDrawCommands;
+      for (DrawIndexedIndirectCommand& c : dst.drawCommands_)
+        selectShadowLOD(c);
+      dst.uploadIndirectBuffer();
+      numShadowCasters[viewIndex] = (uint32_t)dst.drawCommands_.size();
+      return;
+    }
+    numShadowCasters[viewIndex] = shadowCasterCuller.cull(planes, corners, dst, true, selectShadowLOD);
+  };
 
   struct TransparentFragment {
     uint64_t rgba; // f16vec4
@@ -696,6 +905,20 @@ int main()
       .debugName = "Buffer: atomic counter",
   });
 
+  // GPU counters of a frame are copied into a ring of host-visible slots and read back a few frames later, the CPU never waits
+  struct FrameStats {
+    uint32_t numVisibleMeshes = 0; // CullingData::numVisibleMeshes
+    uint32_t numVisibleLate   = 0; // CullingData::numVisibleLate
+    uint32_t numOccluded      = 0; // CullingData::numOccluded
+    uint32_t numOITFragments  = 0; // bufferAtomicCounter
+  };
+  // FrameStats::numOITFragments is copied every frame, the culling counters only by the frames which dispatched the GPU culling
+  enum {
+    FrameStatsFlags_Culling = 1,
+  };
+  VKStatsReadback11<FrameStats> statsReadback(ctx);
+  uint32_t numOITFragments = 0;
+
   lvk::Holder<lvk::BufferHandle> bufferListsOIT = ctx->createBuffer({
       .usage     = lvk::BufferUsageBits_Storage,
       .storage   = lvk::StorageType_Device,
@@ -738,13 +961,26 @@ int main()
  const struct AddressTable {
     uint64_t bufferTransforms;
     uint64_t bufferDrawData;
+    uint64_t bufferDequantization;
+    uint64_t bufferMeshletTasks;
+    uint64_t bufferMeshlets;
+    uint64_t bufferMeshletVertices;
+    uint64_t bufferMeshletTriangles;
+    uint64_t bufferVertices;
     //uint64_t bufferMaterials;
     //uint32_t texSkybox;
     //uint32_t texSkyboxIrradiance;
    
  } addressTable = {
-    .bufferTransforms    = ctx->gpuAddress(mesh.bufferTransforms_),
-    .bufferDrawData      = ctx->gpuAddress(mesh.bufferDrawData_),
+    .bufferTransforms     = ctx->gpuAddress(mesh.bufferTransforms_),
+    .bufferDrawData       = ctx->gpuAddress(mesh.bufferDrawData_),
+    .bufferDequantization = ctx->gpuAddress(mesh.bufferDequantization_),
+    // zeros without meshlets; the vertex buffer address is used only by the mesh shaders (single chunk)
+    .bufferMeshletTasks     = mesh.hasMeshlets() ? ctx->gpuAddress(mesh.bufferMeshletTasks_) : 0,
+    .bufferMeshlets         = mesh.hasMeshlets() ? ctx->gpuAddress(mesh.bufferMeshlets_) : 0,
+    .bufferMeshletVertices  = mesh.hasMeshlets() ? ctx->gpuAddress(mesh.bufferMeshletVertices_) : 0,
+    .bufferMeshletTriangles = mesh.hasMeshlets() ? ctx->gpuAddress(mesh.bufferMeshletTriangles_) : 0,
+    .bufferVertices         = mesh.hasMeshlets() ? ctx->gpuAddress(mesh.chunks_[0].bufferVertices_) : 0,
     //.bufferMaterials     = ctx->gpuAddress(mesh.bufferMaterials_),
     //.texSkybox           = skyBox.texSkybox.index(),
    // .texSkyboxIrradiance = skyBox.texSkyboxIrradiance.index(),
@@ -847,6 +1083,28 @@ int main()
     // loading texture asynchronously
 	 mesh.processLoadedTextures();
 
+    // streaming geometry, the draw lists grow as meshes become resident
+    if (mesh.processStreamedGeometry())
+      updateDrawLists();
+
+    // the CPU culling, the LOD selection and the light frustum use the boxes of an update a few frames old; until they
+    // arrive (or in the GPU culling mode), the last boxes read back
+    if (sceneTransforms.pollBoxes(reorderedBoxes)) {
+      updateSceneBox();
+      updateCullerBoxes();
+      lodsChanged = true;
+    }
+    // submitted separately before this frame's command buffer; the GPU culling reads the moved boxes in place, so they are
+    // read back only for the other modes
+    if (sceneTransforms.update(scene, cullingMode != CullingMode_GPU)) {
+      // the shadow maps have to be redrawn
+      lodsChanged = true;
+      // the occluder triangles are world-space copies taken at load time
+      occludersValid      = false;
+      cpuOcclusionCulling = false;
+    }
+    mesh.uploadDirtyRanges();
+
     const mat4 view = app.camera_.getViewMatrix();
     const mat4 proj = glm::perspective(45.0f, aspectRatio, pcSSAO.zNear, pcSSAO.zFar);
 
@@ -854,9 +1112,22 @@ int main()
     if (!freezeCullingView)
       cullingView = app.camera_.getViewMatrix();
 
+    // LODs are selected from the culling camera, so freezing the culling view freezes them as well
+    const vec3 cullingEye     = vec3(glm::inverse(cullingView)[3]);
+    const float lodPixelScale = proj[1][1] * 0.5f * (float)sizeFb.height;
+
     CullingData cullingData = {
       .numMeshesToCull = static_cast<uint32_t>(meshesOpaque.drawCommands_.size()),
+      .enableLODs      = enableLODs ? 1u : 0u,
+      .lodThreshold    = lodThreshold,
+      .cameraPos       = vec4(cullingEye, lodPixelScale),
+      .viewProj        = proj * view,
+      .pyramidNumLevels = depthPyramid.getNumLevels(),
+      .pyramidWidth     = depthPyramid.getWidth(),
+      .pyramidHeight    = depthPyramid.getHeight(),
     };
+    for (uint32_t i = 0; i != depthPyramid.getNumLevels(); i++)
+      cullingData.pyramidLevels[i] = depthPyramid.getLevelIndex(i);
 
 	 // extract viewing frustum planes and corners
     getFrustumPlanes(proj * cullingView, cullingData.frustumPlanes);
@@ -893,18 +1164,25 @@ int main()
 
 
 
-	 // store the bool values of whether the object is culled or not
-	 // for drawing the boundary box when we use the compacted command buffer way
-    // here we cannot use the instance count way to judge whether the object is culled or not
-	 // so we store the bool value in a vectorw
-	 std::vector<bool> ifCulling;
+    // the task shaders cull every resident meshlet on their own, the culled draw lists are not drawn then
+    const bool drawMeshlets = useMeshShaders && pipelineMeshlets;
+
+    // before the UI can change the culling mode; tags the GPU counters read back for this frame
+    const bool gpuCulledThisFrame = cullingMode == CullingMode_GPU && !drawMeshlets && (frameCount % 3 == 0 || cullingEveryFrame);
 
     lvk::ICommandBuffer& buf = ctx->acquireCommandBuffer();
     {
 		// clear the OIT buffers 
       clearTransparencyBuffers(buf);
 
-		if (frameCount % 3 == 0 || cullingEveryFrame) {
+      const bool cullThisFrame = frameCount % 3 == 0 || cullingEveryFrame;
+      // the second phase draws the compacted GPU commands with the regular pipeline, the mesh shaders cull on their own
+      const bool occlusionCullingActive = occlusionCulling && cullingMode == CullingMode_GPU && !drawMeshlets;
+
+      if (occlusionCullingActive && msaaDepthStored.empty())
+        createStoredMSAATextures();
+
+		if (cullThisFrame && !drawMeshlets) {
         // cull scene (we only cull opaque meshes)
         // because we only cull opaque meshes, only the meshesOpaque indirect buffer has been culled (modified)
         // not culling mode
@@ -912,62 +1190,42 @@ int main()
           numVisibleMeshes                = static_cast<uint32_t>(scene.meshForNode.size()); // all meshes
           DrawIndexedIndirectCommand* cmd = meshesOpaque.getDrawIndexedIndirectCommandPtr();
           for (auto& c : meshesOpaque.drawCommands_) {
+            applyLOD(*cmd, mesh.drawLODs_[cmd->baseInstance], 0);
             (cmd++)->instanceCount = 1;
           }
           ctx->flushMappedMemory(meshesOpaque.bufferIndirect_, 0, meshesOpaque.drawCommands_.size() * sizeof(DrawIndexedIndirectCommand));
         }
         // CPU culling mode
         else if (cullingMode == CullingMode_CPU) {
-
-
-			  if (compactedBuffer) { // if we use the compacted command buffer way instead of setting the instance count to be 0
-            std::vector<DrawIndexedIndirectCommand> compactedDrawCommands;
-            numVisibleMeshes =
-                static_cast<uint32_t>(meshesTransparent.drawCommands_.size()); // all transparent meshes are visible - we don't cull them
-
-				ifCulling.resize(fullDrawCommands.size());
-            // get the CPU mapped pointer of the GPU indirect buffer (host visible), and update the data on CPU
-           // DrawIndexedIndirectCommand* cmd = meshesOpaque.getDrawIndexedIndirectCommandPtr();
-            DrawIndexedIndirectCommand* cmd = fullDrawCommands.data();
-            for (size_t i = 0; i != fullDrawCommands.size(); i++) {
-              const BoundingBox box = reorderedBoxes[mesh.drawData_[cmd->baseInstance].transformId];
-
-              ifCulling[i] = true;
-              if (isBoxInFrustum(cullingData.frustumPlanes, cullingData.frustumCorners, box)) {
-                compactedDrawCommands.push_back(*cmd);
-                numVisibleMeshes++;
-                ifCulling[i] = false;
-              }
-              cmd++;
-              
+          numVisibleMeshes = static_cast<uint32_t>(meshesTransparent.drawCommands_.size()); // all transparent meshes are visible - we don't cull them
+
+          // runs on the culler's worker threads for every visible command
+          auto selectVisibleLOD = [&](DrawIndexedIndirectCommand& c) {
+            if (enableLODs) {
+              const DrawLODs& lods   = mesh.drawLODs_[c.baseInstance];
+              const BoundingBox& box = reorderedBoxes[mesh.drawData_[c.baseInstance].transformId];
+              applyLOD(c, lods, selectLOD(box, cullingEye, lodPixelScale, true, lodThreshold, lods.lodCount));
             }
-            meshesOpaqueArray[currentBufferId].drawCommands_ = std::move(compactedDrawCommands);
-            
-            meshesOpaqueArray[currentBufferId].uploadIndirectBuffer();
-          
-            // flush memory here is not needed since it has already been done in the uploadIndirectBuffer function
-          }
-		  
-            
-			 else {
-          
-            numVisibleMeshes = static_cast<uint32_t>(meshesTransparent.drawCommands_.size()); // all transparent meshes are visible - we don't cull them
-
-            // get the CPU mapped pointer of the GPU indirect buffer (host visible), and update the data on CPU
-            DrawIndexedIndirectCommand* cmd = meshesOpaque.getDrawIndexedIndirectCommandPtr();
-            for (size_t i = 0; i != meshesOpaque.drawCommands_.size(); i++) {
-              const BoundingBox box = reorderedBoxes[mesh.drawData_[cmd->baseInstance].transformId];
-               const uint32_t count   = isBoxInFrustum(cullingData.frustumPlanes, cullingData.frustumCorners, box) ? 1 : 0;
-               (cmd++)->instanceCount = count;
-                numVisibleMeshes += count;
-             
-            }
-            
-            // we need to flush the mapped memory to notify GPU that the indirect buffer data on CPU has been updated
-            ctx->flushMappedMemory(meshesOpaque.bufferIndirect_, 0, meshesOpaque.drawCommands_.size() * sizeof(DrawIndexedIndirectCommand));
+          };
 
-			  }
-			  
+          // compacted: the visible commands are written back to back into the mapped indirect buffer (the CPU copy of the
+          // commands is updated as well, the large-scene mode needs it); otherwise the instance count of the culled commands is 0
+          VKIndirectBuffer11& culledBuffer = compactedBuffer ? meshesOpaqueArray[currentBufferId] : meshesOpaque;
+
+          // the boxes inside the frustum are tested against the occluders as seen from the culling camera
+          if (cpuOcclusionCulling)
+            occlusionRasterizer.render(proj * cullingView);
+          std::atomic<uint32_t> numOccluded = 0;
+          auto isOccluded = [&](uint32_t i) -> bool {
+            if (!cpuOcclusionCulling || !occlusionRasterizer.isOccluded(frustumCuller.getBox(i)))
+              return false;
+            numOccluded++;
+            return true;
+          };
+
+          numVisibleMeshes += frustumCuller.cull(
+              cullingData.frustumPlanes, cullingData.frustumCorners, culledBuffer, compactedBuffer, selectVisibleLOD, isOccluded);
+          numOccludedMeshes = numOccluded;
 			  }
         // GPU culling mode
         else if (cullingMode == CullingMode_GPU) {
@@ -975,9 +1233,12 @@ int main()
           pcCulling.meshes   = ctx->gpuAddress(bufferCullingData[currentBufferId]);
           pcCulling.commands = ctx->gpuAddress(meshesOpaque.bufferIndirect_);
           pcCulling.compactedCommands = ctx->gpuAddress(meshesOpaqueGPU.bufferIndirect_);
+          // with the occlusion culling, only the meshes visible in the last frame are drawn first
+          pcCulling.phase             = occlusionCullingActive ? CullingPhase_LastVisible : CullingPhase_FrustumOnly;
 
 		    // set the numVisibleMeshes to be 0 since it'll be the index for indirect commands on GPU
           cullingData.numVisibleMeshes = 0;
+          cullingData.resetVisibility  = resetOcclusionVisibility ? 1u : 0u;
 			 buf.cmdPushConstants(pcCulling);
           // cullingData buffer uses round robin buffers
           buf.cmdUpdateBuffer(bufferCullingData[currentBufferId], cullingData);
@@ -987,6 +1248,9 @@ int main()
           },
               { .buffers = { lvk::BufferHandle(meshesOpaque.bufferIndirect_), lvk::BufferHandle(meshesOpaqueGPU.bufferIndirect_) } });
         }
+
+        // the reset is consumed by both phases of this frame
+        resetOcclusionVisibility = !occlusionCullingActive;
       }
 
 		
@@ -995,8 +1259,10 @@ int main()
       // 0-1. Update 2D shadow map for directional light
 		// the shadow map is not be culled since we don't use the meshesOpaque indirect buffer when drawing the mesh
 		// we use the default indirect buffer
-      if (prevLight != light) {
+      if (prevLight != light || lodsChanged) {
         prevLight = light;
+        // not culled: lightProj is fitted to the box of the whole scene, so every caster is inside it
+        cullShadowCasters(0, lightProj, nullptr, nullptr, vec3(0.0f), false);
         buf.cmdBeginRendering(
             lvk::RenderPass{
                 .depth = {.loadOp = lvk::LoadOp_Clear, .clearDepth = 1.0f}
@@ -1007,7 +1273,7 @@ int main()
         buf.cmdSetDepthBiasEnable(true);
        // mesh.draw(buf, pipelineShadow, lightView, lightProj); // render the shadow map for both opaque and transparent objects
        // mesh.draw(buf, pipelineShadow, lightView, lightProj, {}, false, &meshesOpaque); // wrong way, since meshOpaque has been culled through camera frustum, and cannot be used for shadow map rendering (from light frustum)
-        mesh.draw(buf, pipelineShadow, lightView, lightProj, {}, false, &meshesOpaqueNotCulled); // only render shadow map for opaque objects (not for transparent objects)
+        mesh.draw(buf, pipelineShadow, lightView, lightProj, {}, false, &meshesShadow[currentBufferId][0]); // only the opaque casters inside the light frustum
         buf.cmdSetDepthBiasEnable(false);
         buf.cmdPopDebugGroupLabel();
         buf.cmdEndRendering();
@@ -1030,10 +1296,25 @@ int main()
 
 		// 0-2. Update shadow cube map for point lights
 		// should only update the cubemap when the point light data is changed
-		if (pointLightChanged) {
+		if (pointLightChanged || lodsChanged) {
+          // the moved boxes are not read back in the GPU culling mode, the stale ones could cull a caster which has moved in
+          const bool cullPointLightCasters = !sceneTransforms.areBoxesOutdated();
 
 			// there are two point lights enabled shadows
 			for (uint8_t j = 0; j < 2; j++) { 
+          // the faces are rendered up to the radius of the light 0 (pointLightProj), and a caster farther from the light than
+          // its own radius cannot shadow anything it lights
+          const float casterRadius = std::min(pointLightBlock.pointLightData[j].radius, pointLightBlock.pointLightData[0].radius);
+          const mat4 casterProj    = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, std::max(casterRadius, 0.2f));
+          for (uint32_t i = 0; i != 6; i++) {
+            vec4 planes[6];
+            vec4 corners[8];
+            getFrustumPlanes(casterProj * pointLightViews[j][i], planes);
+            getFrustumCorners(casterProj * pointLightViews[j][i], corners);
+            cullShadowCasters(
+                1 + 6 * j + i, pointLightProj, cullPointLightCasters ? planes : nullptr, corners,
+                vec3(pointLightBlock.pointLightData[j].lightPos), true);
+          }
           const lvk::Framebuffer cubeMapFrameBuffer = { .color        = { { .texture = texShadowCubeMap[j] } },
                                                         .depthStencil = { .texture = texDepthShadowPass } };
 
@@ -1070,17 +1351,14 @@ int main()
               uint64_t bufferTransforms;
               uint64_t bufferDrawData;
               uint64_t bufferMaterials;
-              uint32_t padding0;
-              uint32_t cubemapIndex;
-              vec4     lightPos[2]; // each shadowed point light has one position
-            } shadowPassPC = { .viewProj         = pointLightProj * pointLightViews[j][i],
-                               .bufferTransforms = ctx->gpuAddress(mesh.bufferTransforms_),
-                               .bufferDrawData   = ctx->gpuAddress(mesh.bufferDrawData_),
-                               .bufferMaterials  = ctx->gpuAddress(mesh.bufferMaterials_),
-                               .padding0         = 0,
-					                .cubemapIndex     = j,
-                               .lightPos         = { pointLightBlock.pointLightData[0].lightPos, pointLightBlock.pointLightData[1].lightPos },
-
+              uint64_t bufferDequantization;
+              vec4     lightPos; // position of the shadowed point light rendered into this cubemap
+            } shadowPassPC = { .viewProj             = pointLightProj * pointLightViews[j][i],
+                               .bufferTransforms     = ctx->gpuAddress(mesh.bufferTransforms_),
+                               .bufferDrawData       = ctx->gpuAddress(mesh.bufferDrawData_),
+                               .bufferMaterials      = ctx->gpuAddress(mesh.bufferMaterials_),
+                               .bufferDequantization = ctx->gpuAddress(mesh.bufferDequantization_),
+                               .lightPos             = pointLightBlock.pointLightData[j].lightPos,
 				};
 
             // mesh.draw( // set the correct view matrix for each cube map face
@@ -1090,7 +1368,7 @@ int main()
             mesh.draw( // set the correct view matrix for each cube map face
                 buf, pipelineShadowCubeMap, &shadowPassPC, sizeof(shadowPassPC),
                 { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, false,
-                &meshesOpaqueNotCulled); // only render shadow map for opaque objects (not for transparent objects)
+                &meshesShadow[currentBufferId][1 + 6 * j + i]); // only the opaque casters inside this cube map face
 
             // buf.cmdSetDepthBiasEnable(false);
             buf.cmdPopDebugGroupLabel();
@@ -1102,13 +1380,17 @@ int main()
       // 1. Render scene
 		// using MSAA textures as render target and resolve it
       const lvk::Framebuffer framebufferMSAA = {
-        .color        = { { .texture = msaaColor, .resolveTexture = texOpaqueColor } },
-        .depthStencil = { .texture = msaaDepth, .resolveTexture = texOpaqueDepth },
+        .color        = { { .texture = occlusionCullingActive ? msaaColorStored : msaaColor, .resolveTexture = texOpaqueColor } },
+        .depthStencil = { .texture = occlusionCullingActive ? msaaDepthStored : msaaDepth, .resolveTexture = texOpaqueDepth },
       };
       buf.cmdBeginRendering(
           lvk::RenderPass{
-              .color = { { .loadOp = lvk::LoadOp_Clear, .storeOp = lvk::StoreOp_MsaaResolve, .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } },
-              .depth = { .loadOp = lvk::LoadOp_Clear, .storeOp = lvk::StoreOp_MsaaResolve, .clearDepth = 1.0f }
+              .color = { { .loadOp     = lvk::LoadOp_Clear,
+                           .storeOp    = occlusionCullingActive ? lvk::StoreOp_MsaaResolveAndStore : lvk::StoreOp_MsaaResolve,
+                           .clearColor = { 1.0f, 1.0f, 1.0f, 1.0f } } },
+              .depth = { .loadOp     = lvk::LoadOp_Clear,
+                         .storeOp    = occlusionCullingActive ? lvk::StoreOp_MsaaResolveAndStore : lvk::StoreOp_MsaaResolve,
+                         .clearDepth = 1.0f }
       },
           framebufferMSAA,
           { .buffers = { lvk::BufferHandle(meshesOpaque.bufferIndirect_), lvk::BufferHandle(meshesOpaqueGPU.bufferIndirect_) } });
@@ -1158,8 +1440,13 @@ int main()
       if (drawMeshesOpaque) {
         buf.cmdPushDebugGroupLabel("Mesh opaque", 0xff0000ff);
 
+		  // per-meshlet culling in the task shader (see meshlet.task)
+		  if (drawMeshlets)
+          mesh.drawMeshlets(
+              buf, *pipelineMeshlets, &pc, sizeof(pc), { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, drawWireframe);
+
 		  // if CPU culling and compacted buffer are used
-		  if (cullingMode == CullingMode_CPU && compactedBuffer)
+		  else if (cullingMode == CullingMode_CPU && compactedBuffer)
 		  mesh.draw(
             buf, pipelineOpaque, &pc, sizeof(pc), { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, drawWireframe,
            // &meshesOpaque);
@@ -1178,6 +1465,42 @@ int main()
         buf.cmdPopDebugGroupLabel();
       }
 
+      // occlusion culling, second phase: the depth of the meshes drawn so far has been stored in msaaDepthStored
+      if (occlusionCullingActive) {
+        buf.cmdEndRendering();
+
+        if (cullThisFrame) {
+          depthPyramid.build(buf, msaaDepthStored, kNumSamples);
+
+          // test the remaining meshes against the depth pyramid, the newly visible ones go into meshesOpaqueGPULate
+          pcCulling.compactedCommands = ctx->gpuAddress(meshesOpaqueGPULate.bufferIndirect_);
+          pcCulling.phase             = CullingPhase_DepthPyramid;
+          buf.cmdBindComputePipeline(pipelineCulling);
+          buf.cmdPushConstants(pcCulling);
+          buf.cmdDispatchThreadGroups(
+              { 1 + cullingData.numMeshesToCull / 64 },
+              { .textures = { depthPyramid.getTexture() },
+                .buffers  = { lvk::BufferHandle(meshesOpaqueGPULate.bufferIndirect_), lvk::BufferHandle(bufferVisibility),
+                              lvk::BufferHandle(bufferCullingData[currentBufferId]) } });
+        }
+
+        // continue on top of the stored multisampled color and depth
+        buf.cmdBeginRendering(
+            lvk::RenderPass{
+                .color = { { .loadOp = lvk::LoadOp_Load, .storeOp = lvk::StoreOp_MsaaResolve } },
+                .depth = { .loadOp = lvk::LoadOp_Load, .storeOp = lvk::StoreOp_MsaaResolve },
+            },
+            framebufferMSAA, { .buffers = { lvk::BufferHandle(meshesOpaqueGPULate.bufferIndirect_) } });
+
+        if (drawMeshesOpaque) {
+          buf.cmdPushDebugGroupLabel("Mesh opaque (newly visible)", 0xff0000ff);
+          mesh.draw(
+              buf, pipelineOpaque, &pc, sizeof(pc), { .compareOp = lvk::CompareOp_Less, .isDepthWriteEnabled = true }, drawWireframe,
+              &meshesOpaqueGPULate);
+          buf.cmdPopDebugGroupLabel();
+        }
+      }
+
 
   // draw point light markers (can be toggled off through UI)
 	if (drawPointLightMarker) {
@@ -1224,29 +1547,25 @@ int main()
         canvas3d.frustum(cullingView, proj, vec4(1, 1, 0, 1));
       if (drawLightFrustum)
         canvas3d.frustum(lightView, lightProj, vec4(1, 1, 0, 1));
-      // render all bounding boxes
+      // render all bounding boxes; the world-space boxes of the culling, scene.globalTransform is not updated once nodes move
       if (drawBoxes) {
 		  // draw transparent boxes (always visible)
         for (auto& c : meshesTransparent.drawCommands_) {
-          const uint32_t transformId = mesh.drawData_[c.baseInstance].transformId;
-          const uint32_t meshId      = scene.meshForNode[transformId];
-          const BoundingBox box      = meshData.boxes[meshId];
-          canvas3d.box(scene.globalTransform[transformId], box, vec4(0, 1, 0, 1));
+          const BoundingBox& box = reorderedBoxes[mesh.drawData_[c.baseInstance].transformId];
+          canvas3d.box(mat4(1.0f), box, vec4(0, 1, 0, 1));
         }
         // draw opaque boxes
         const DrawIndexedIndirectCommand* cmd = meshesOpaque.getDrawIndexedIndirectCommandPtr();
         int boundingBoxCount                  = 0;
 		  for (auto& c : meshesOpaque.drawCommands_) {
-          const uint32_t transformId = mesh.drawData_[c.baseInstance].transformId;
-          const uint32_t meshId      = scene.meshForNode[transformId];
-          const BoundingBox box      = meshData.boxes[meshId];
+          const BoundingBox& box = reorderedBoxes[mesh.drawData_[c.baseInstance].transformId];
           // when using the compacted buffer way for CPU culling
 			 // we cannot use the instance count way to judge whether the object is culled or not
 			 if (cullingMode == CullingMode_CPU && compactedBuffer) { 
-            canvas3d.box(scene.globalTransform[transformId], box, ifCulling[boundingBoxCount++] ? vec4(1, 0, 0, 1) : vec4(0, 1, 0, 1));
+            canvas3d.box(mat4(1.0f), box, frustumCuller.isVisible(boundingBoxCount++) ? vec4(0, 1, 0, 1) : vec4(1, 0, 0, 1));
 			 }
 			 else {
-         canvas3d.box(scene.globalTransform[transformId], box, (cmd++)->instanceCount ? vec4(0, 1, 0, 1) : vec4(1, 0, 0, 1));
+         canvas3d.box(mat4(1.0f), box, (cmd++)->instanceCount ? vec4(0, 1, 0, 1) : vec4(1, 0, 0, 1));
 			 }
 
         }
@@ -1256,6 +1575,7 @@ int main()
 
 		// update the buffer after one dynamic rendering (a render pass) is ended
 		pointLightChanged = false;
+		lodsChanged       = false;
 		for (int i = 0; i < pointLightsNum; i++) {
 			if (pointLightBlock.pointLightData[i] != pointLightDataPrevious[i]) {
            pointLightChanged = true;
@@ -1493,6 +1813,7 @@ int main()
         ImGui::SetNextWindowSizeConstraints(ImVec2(-1, 0), ImVec2(-1, v->WorkSize.y - 210));
         ImGui::Begin("Controls", nullptr, ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Checkbox("Draw wireframe", &drawWireframe);
+        ImGui::Text("Buffer uploads: %llu bytes", (unsigned long long)mesh.uploadedBytes_);
         ImGui::Text("Draw:");
         const float indentSize = 16.0f;
         ImGui::Indent(indentSize);
@@ -1506,19 +1827,61 @@ int main()
           ImGui::Indent(indentSize);
           ImGui::RadioButton("None (N)", &cullingMode, CullingMode_None);
           ImGui::RadioButton("CPU  (C)", &cullingMode, CullingMode_CPU);
+          ImGui::BeginDisabled(!gpuCullingAvailable);
           ImGui::RadioButton("GPU  (G)", &cullingMode, CullingMode_GPU);
+          ImGui::EndDisabled();
+          if (!gpuCullingAvailable)
+            ImGui::Text("GPU culling is not available: %u geometry chunks", (uint32_t)mesh.chunks_.size());
           ImGui::Unindent(indentSize);
           ImGui::Checkbox("Freeze culling frustum (P)", &freezeCullingView);
           ImGui::Checkbox("Using compacted buffer for culling", &compactedBuffer);
 			 ImGui::Checkbox("Culling every frame", &cullingEveryFrame);
           ImGui::Separator();
-          ImGui::Text("Visible meshes: %i", numVisibleMeshes);
+          if (drawMeshlets)
+            ImGui::Text("Visible meshes: culled per meshlet by the task shaders");
+          else
+            ImGui::Text("Visible meshes: %i", numVisibleMeshes);
+          if (cullingMode == CullingMode_GPU) {
+            ImGui::Text("GPU stats latency: %u frames", statsReadback.getLatency());
+            // the second phase draws the compacted commands with the regular pipeline, so it cannot be combined with the mesh shaders
+            if (ImGui::Checkbox("Occlusion culling (two-phase)", &occlusionCulling) && occlusionCulling)
+              useMeshShaders = false;
+            if (occlusionCulling)
+              ImGui::Text("First phase: %u, second phase: %u, occluded: %u", numVisibleFirstPhase, numVisibleSecondPhase, numOccludedMeshes);
+          }
+          if (cullingMode == CullingMode_CPU) {
+            ImGui::BeginDisabled(!occludersValid);
+            ImGui::Checkbox("Occlusion culling (software)", &cpuOcclusionCulling);
+            ImGui::EndDisabled();
+            if (!occludersValid)
+              ImGui::Text("Software occlusion culling is not available: the scene has moved since the occluders were selected");
+            if (cpuOcclusionCulling)
+              ImGui::Text("Occluder triangles: %u, occluded: %u", occlusionRasterizer.getNumTriangles(), numOccludedMeshes);
+          }
+          ImGui::Separator();
+          if (pipelineMeshlets) {
+            if (ImGui::Checkbox("Mesh shaders (per-meshlet culling)", &useMeshShaders) && useMeshShaders)
+              occlusionCulling = false;
+            if (cullingMode == CullingMode_GPU)
+              ImGui::Text("Mesh shaders and the two-phase occlusion culling are exclusive");
+            ImGui::Text("Meshlet tasks: %u", mesh.numMeshletTasks_);
+          } else {
+            ImGui::Text("Mesh shaders are not available");
+          }
+          ImGui::Separator();
+        }
+        if (ImGui::CollapsingHeader("Level of Detail")) {
+          ImGui::Indent(indentSize);
+          lodsChanged |= ImGui::Checkbox("Enable LODs", &enableLODs);
+          lodsChanged |= ImGui::SliderFloat("LOD threshold (pixels)", &lodThreshold, 16.0f, 1024.0f);
+          ImGui::Unindent(indentSize);
           ImGui::Separator();
         }
         if (ImGui::CollapsingHeader("Order-Independent Transparency")) {
           ImGui::Indent(indentSize);
           ImGui::SliderFloat("Opacity boost", &oitOpacityBoost, -1.0f, +1.0f);
           ImGui::Checkbox("Show transparency heat map", &oitShowHeatmap);
+          ImGui::Text("Fragments: %u / %u", std::min(numOITFragments, kMaxOITFragments), kMaxOITFragments);
           ImGui::Unindent(indentSize);
           ImGui::Separator();
         }
@@ -1553,6 +1916,15 @@ int main()
           ImGui::SliderFloat("Phi", &light.phi, -85.0f, +85.0f);
           ImGui::Unindent(indentSize);
           ImGui::Separator();
+          uint32_t numPointLightCasters = 0;
+          for (uint32_t v = 1; v != kNumShadowViews; v++)
+            numPointLightCasters += numShadowCasters[v];
+          ImGui::Text("Shadow casters (of %u opaque meshes):", (uint32_t)fullDrawCommands.size());
+          ImGui::Indent(indentSize);
+          ImGui::Text("directional light (the whole scene): %u", numShadowCasters[0]);
+          ImGui::Text("point lights, 12 cube map faces: %u", numPointLightCasters);
+          ImGui::Unindent(indentSize);
+          ImGui::Separator();
           ImGui::Text("2D Shadow Map: ");
           ImGui::Image(texShadowMap.index(), ImVec2(512, 512));
           ImGui::Separator();
@@ -1684,17 +2056,45 @@ int main()
 	 // set the indirect command count of opaque objects drawing to be 0
 	 // for GPU camera culling (compacted buffer way)
 	 // if not culling every frame, we reset the command count to 0 only when next frame is about to cull
-    if (frameCount % 3 == 0 || cullingEveryFrame)
+    if (frameCount % 3 == 0 || cullingEveryFrame) {
 	 buf.cmdFillBuffer(meshesOpaqueGPU.bufferIndirect_, 0, sizeof(uint32_t), 0);
+      buf.cmdFillBuffer(meshesOpaqueGPULate.bufferIndirect_, 0, sizeof(uint32_t), 0);
+    }
+
+    // copy the counters of this frame; skipped if the slot of an earlier frame is still in flight
+    if (statsReadback.beginFrame()) {
+      const lvk::BufferHandle bufferStats = bufferCullingData[currentBufferId];
+      using Copy                          = VKStatsReadback11<FrameStats>::Copy;
+      const Copy copyOIT = { bufferAtomicCounter, 0, offsetof(FrameStats, numOITFragments), sizeof(uint32_t) };
+      if (gpuCulledThisFrame) {
+        statsReadback.cmdCopy(
+            buf, { { bufferStats, offsetof(CullingData, numVisibleMeshes), offsetof(FrameStats, numVisibleMeshes), sizeof(uint32_t) },
+                   // numVisibleLate and numOccluded are adjacent in both structs
+                   { bufferStats, offsetof(CullingData, numVisibleLate), offsetof(FrameStats, numVisibleLate), 2 * sizeof(uint32_t) },
+                   copyOIT });
+      } else {
+        statsReadback.cmdCopy(buf, { copyOIT });
+      }
+    }
+
+    const lvk::SubmitHandle submitHandle = ctx->submit(buf, ctx->getCurrentSwapchainTexture());
 
-    submitHandle[currentBufferId] = ctx->submit(buf, ctx->getCurrentSwapchainTexture());
+    statsReadback.endFrame(submitHandle, gpuCulledThisFrame ? FrameStatsFlags_Culling : 0);
+    meshesShadowSubmitted[currentBufferId] = submitHandle;
 
-    // retrieve culling results
     currentBufferId = (currentBufferId + 1) % LVK_ARRAY_NUM_ELEMENTS(bufferCullingData);
 
-    if (cullingMode == CullingMode_GPU && app.fpsCounter_.numFrames_ > 1) {
-      ctx->wait(submitHandle[currentBufferId]);
-      ctx->download(bufferCullingData[currentBufferId], &numVisibleMeshes, sizeof(uint32_t), offsetof(CullingData, numVisibleMeshes));
+    // retrieve the stats of a finished earlier frame, if any
+    if (statsReadback.poll()) {
+      const FrameStats& stats = statsReadback.getLatest();
+      // the culling counters are stale unless that frame has dispatched the GPU culling
+      if (cullingMode == CullingMode_GPU && (statsReadback.getLatestFlags() & FrameStatsFlags_Culling)) {
+        numVisibleFirstPhase  = stats.numVisibleMeshes;
+        numVisibleSecondPhase = stats.numVisibleLate;
+        numOccludedMeshes     = stats.numOccluded;
+        numVisibleMeshes      = static_cast<int>(numVisibleFirstPhase + numVisibleSecondPhase);
+      }
+      numOITFragments = stats.numOITFragments;
     }
 
     // swap ping-pong textures
@@ -14,12 +14,13 @@ layout (location=4) out vec4 shadowCoords;
 
 
 void main() {
-  mat4 model = pc.addressTable.transforms.model[pc.addressTable.drawData.dd[gl_BaseInstance].transformId];
-  gl_Position = pc.viewProj * model * vec4(in_pos, 1.0);
+  mat3x4 model = pc.addressTable.transforms.model[pc.addressTable.drawData.dd[gl_BaseInstance].transformId];
+  vec3 pos = decodePosition(pc.addressTable.dequantization, gl_BaseInstance, in_pos);
+  vec4 posClip = vec4(transformPoint(model, pos), 1.0);
+  gl_Position = pc.viewProj * posClip;
   uv = vec2(in_tc.x, 1.0-in_tc.y);
-  normal = transpose( inverse(mat3(model)) ) * in_normal;
-  vec4 posClip = model * vec4(in_pos, 1.0);
-  worldPos = posClip.xyz/posClip.w;
+  normal = getNormalMatrix(model) * decodeNormal(in_normal);
+  worldPos = posClip.xyz;
   materialId = pc.addressTable.drawData.dd[gl_BaseInstance].materialId;
 
   // for directional light shadow mapping
@@ -0,0 +1,36 @@
+//
+
+#include <Chapter11/07_MyFinalDemo/src/quantization.sp>
+#include <Chapter11/07_MyFinalDemo/src/transform.sp>
+
+// depth-only pass for the directional light, the push constants are set by VKMesh11::draw()
+
+struct DrawData {
+  uint transformId;
+  uint materialId;
+};
+
+layout(std430, buffer_reference) readonly buffer TransformBuffer {
+  mat3x4 model[];
+};
+
+layout(std430, buffer_reference) readonly buffer DrawDataBuffer {
+  DrawData dd[];
+};
+
+layout(push_constant) uniform PerFrameData {
+  mat4 viewProj;
+  TransformBuffer transforms;
+  DrawDataBuffer drawData;
+  uvec2 materials;
+  uint texSkyboxIrradiance;
+  uint padding0;
+  DequantizationBuffer dequantization;
+} pc;
+
+layout (location=0) in vec3 in_pos;
+
+void main() {
+  mat3x4 model = pc.transforms.model[pc.drawData.dd[gl_BaseInstance].transformId];
+  gl_Position = pc.viewProj * vec4(transformPoint(model, decodePosition(pc.dequantization, gl_BaseInstance, in_pos)), 1.0);
+}
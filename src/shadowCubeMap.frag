@@ -22,7 +22,7 @@ void main() {
 //  float linearDepth = length(pc.lightPos - worldPos) * factor / 100.0f ;
   
 //  vec3 lightPos = pc.cubemapIndex == 0? pc.lightPos[0] : pc.lightPos[1];
-  float linearDepth = clamp ((length(pc.lightPos[pc.cubemapIndex].xyz - worldPos) - 0.1f)  / 9.9f, 0.f, 1.f);
+  float linearDepth = clamp ((length(pc.lightPos.xyz - worldPos) - 0.1f)  / 9.9f, 0.f, 1.f);
 
   out_FragColor = vec4(linearDepth, 0.0f, 0.0f, 1.0f);
 
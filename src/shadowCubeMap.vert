@@ -15,13 +15,12 @@ layout (location=3) out float factor;
 
 
 void main() {
-  mat4 model = pc.transforms.model[pc.drawData.dd[gl_BaseInstance].transformId];
-  gl_Position = pc.viewProj * model * vec4(in_pos, 1.0);
+  mat3x4 model = pc.transforms.model[pc.drawData.dd[gl_BaseInstance].transformId];
+  vec3 pos = decodePosition(pc.dequantization, gl_BaseInstance, in_pos);
+  worldPos = transformPoint(model, pos);
+  gl_Position = pc.viewProj * vec4(worldPos, 1.0);
   uv = vec2(in_tc.x, 1.0-in_tc.y);
   materialId = pc.drawData.dd[gl_BaseInstance].materialId;
-
-  vec4 posClip = model * vec4(in_pos, 1.0);
-  worldPos = posClip.xyz/posClip.w;
  // factor = gl_ViewIndex;
  factor = gl_Position.w;
 }